@@ -0,0 +1,240 @@
+/*
+ * Traffic update throughput: the old global rwlock path against the
+ * lock-free path (atomic per-edge EMA + weight snapshots), each with and
+ * without concurrent routing.
+ *
+ *   make bench
+ *   ./traffic_bench [data_dir] [seconds] [writers] [readers]
+ *
+ * rwlock: writers take the write lock for every update; routers hold the
+ *         read lock for a whole A* query (the server before snapshots).
+ * atomic: writers CAS the edge's EMA and report the slot; routers pin a
+ *         published snapshot; a publisher thread swaps every 5 ms.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "graph.h"
+#include "graph_loader.h"
+#include "routing.h"
+#include "traffic.h"
+#include "weights.h"
+
+typedef enum { PATH_RWLOCK, PATH_ATOMIC } UpdatePath;
+
+typedef struct {
+    Graph* g;
+    UpdatePath path;
+    atomic_int stop;
+
+    /* rwlock path: the pre-snapshot server state */
+    pthread_rwlock_t lock;
+    double* ema;
+    int* count;
+
+    /* atomic path */
+    TrafficTable traffic;
+    WeightStore weights;
+
+    atomic_long updates;
+    atomic_long routes;
+} Bench;
+
+typedef struct {
+    Bench* b;
+    unsigned int seed;
+} Worker;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void* writer_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    Bench* b = w->b;
+    Graph* g = b->g;
+    long n = 0;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        int e = (int)(rand_r(&w->seed) % (unsigned int)g->num_edges);
+        double speed = 1.0 + (double)(rand_r(&w->seed) % 3000) / 100.0;
+
+        if (b->path == PATH_RWLOCK) {
+            pthread_rwlock_wrlock(&b->lock);
+            double alpha = b->count[e] == 0 ? 1.0 : 0.2;
+            b->ema[e] = alpha * (g->edges[e].base_length / speed) + (1.0 - alpha) * b->ema[e];
+            b->count[e]++;
+            graph_set_travel_time(g, e, b->ema[e]);
+            pthread_rwlock_unlock(&b->lock);
+        } else {
+            traffic_observe(&b->traffic, g, e, speed);
+            weights_mark_dirty(&b->weights, g->edge_slot[e]);
+        }
+        n++;
+    }
+    atomic_fetch_add(&b->updates, n);
+    return NULL;
+}
+
+static void* reader_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    Bench* b = w->b;
+    Graph* g = b->g;
+    RouteWorkspace ws;
+    if (routing_workspace_init(&ws, g->num_nodes) != 0) return NULL;
+    long n = 0;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        int s = (int)(rand_r(&w->seed) % (unsigned int)g->num_nodes);
+        int t = (int)(rand_r(&w->seed) % (unsigned int)g->num_nodes);
+
+        if (b->path == PATH_RWLOCK) {
+            pthread_rwlock_rdlock(&b->lock);
+            find_route_path(g, &ws, ROUTE_MODE_ASTAR, s, t);
+            pthread_rwlock_unlock(&b->lock);
+        } else {
+            int token;
+            const WeightSnapshot* snap = weights_acquire(&b->weights, &token);
+            routing_workspace_set_weights(&ws, snap->w, &snap->stats);
+            find_route_path(g, &ws, ROUTE_MODE_ASTAR, s, t);
+            weights_release(&b->weights, token);
+        }
+        n++;
+    }
+    atomic_fetch_add(&b->routes, n);
+    routing_workspace_free(&ws);
+    return NULL;
+}
+
+static void refresh_from_traffic(void* ctx, Graph* g, int slot) {
+    const TrafficTable* traffic = (const TrafficTable*)ctx;
+    int edge_id = g->out_edge_ids[slot];
+    graph_set_travel_time(g, edge_id, traffic_predict(traffic, edge_id));
+}
+
+static void* publisher_main(void* arg) {
+    Bench* b = (Bench*)arg;
+    struct timespec period = { 0, 5 * 1000000L };
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        nanosleep(&period, NULL);
+        weights_publish(&b->weights, b->g, refresh_from_traffic, &b->traffic);
+    }
+    return NULL;
+}
+
+/*
+ * Runs one configuration and prints a result line. 0 on success. The
+ * writers change g's weights and bounds, which the readers' A* cost
+ * depends on, so both are restored afterwards and every run starts from
+ * the loaded graph.
+ */
+static int run(Graph* g, UpdatePath path, int writers, int readers, double seconds) {
+    size_t weights_size = sizeof(double) * (size_t)g->num_edges;
+    double* saved_weights = (double*)malloc(weights_size ? weights_size : 1);
+    if (!saved_weights) return 1;
+    memcpy(saved_weights, g->out_weights, weights_size);
+    GraphStats saved_stats = g->stats;
+
+    Bench b;
+    memset(&b, 0, sizeof(b));
+    b.g = g;
+    b.path = path;
+    atomic_init(&b.stop, 0);
+    atomic_init(&b.updates, 0);
+    atomic_init(&b.routes, 0);
+
+    if (path == PATH_RWLOCK) {
+        pthread_rwlock_init(&b.lock, NULL);
+        b.ema = (double*)calloc((size_t)g->num_edges, sizeof(double));
+        b.count = (int*)calloc((size_t)g->num_edges, sizeof(int));
+        if (!b.ema || !b.count) return 1;
+    } else {
+        if (traffic_init(&b.traffic, g) != 0 || weights_init(&b.weights, g) != 0) return 1;
+    }
+
+    int total = writers + readers;
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * (size_t)(total + 1));
+    Worker* ctx = (Worker*)malloc(sizeof(Worker) * (size_t)(total > 0 ? total : 1));
+    if (!threads || !ctx) return 1;
+
+    double t0 = now_sec();
+    for (int i = 0; i < total; i++) {
+        ctx[i].b = &b;
+        ctx[i].seed = 1234u + (unsigned int)i * 7919u;
+        pthread_create(&threads[i], NULL, i < writers ? writer_main : reader_main, &ctx[i]);
+    }
+    if (path == PATH_ATOMIC) pthread_create(&threads[total], NULL, publisher_main, &b);
+
+    struct timespec run_for;
+    run_for.tv_sec = (time_t)seconds;
+    run_for.tv_nsec = (long)((seconds - (double)run_for.tv_sec) * 1e9);
+    nanosleep(&run_for, NULL);
+    atomic_store(&b.stop, 1);
+
+    for (int i = 0; i < total; i++) pthread_join(threads[i], NULL);
+    if (path == PATH_ATOMIC) pthread_join(threads[total], NULL);
+    double elapsed = now_sec() - t0;
+
+    printf("%-7s writers %2d readers %2d   %12.0f updates/s   %9.0f routes/s\n",
+           path == PATH_RWLOCK ? "rwlock" : "atomic", writers, readers,
+           (double)atomic_load(&b.updates) / elapsed,
+           (double)atomic_load(&b.routes) / elapsed);
+
+    if (path == PATH_RWLOCK) {
+        pthread_rwlock_destroy(&b.lock);
+        free(b.ema);
+        free(b.count);
+    } else {
+        weights_free(&b.weights);
+        traffic_free(&b.traffic);
+    }
+    free(threads);
+    free(ctx);
+
+    memcpy(g->out_weights, saved_weights, weights_size);
+    g->stats = saved_stats;
+    free(saved_weights);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* dir = argc > 1 ? argv[1] : "data";
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    int writers = argc > 3 ? atoi(argv[3]) : 2;
+    int readers = argc > 4 ? atoi(argv[4]) : 4;
+    if (seconds <= 0.0 || writers < 1 || readers < 0) {
+        fprintf(stderr, "Usage: %s [data_dir] [seconds] [writers] [readers]\n", argv[0]);
+        return 2;
+    }
+
+    char meta[512], nodes[512], edges[512];
+    snprintf(meta, sizeof(meta), "%s/graph.meta", dir);
+    snprintf(nodes, sizeof(nodes), "%s/nodes.csv", dir);
+    snprintf(edges, sizeof(edges), "%s/edges.csv", dir);
+
+    Graph g;
+    if (graph_load_from_files(&g, meta, nodes, edges) != 0) {
+        fprintf(stderr, "failed to load graph from %s\n", dir);
+        return 1;
+    }
+    printf("graph: %d nodes, %d edges, %.1f s per run\n", g.num_nodes, g.num_edges, seconds);
+
+    for (int p = PATH_RWLOCK; p <= PATH_ATOMIC; p++) {
+        if (run(&g, (UpdatePath)p, writers, 0, seconds) != 0 ||
+            run(&g, (UpdatePath)p, writers, readers, seconds) != 0) {
+            fprintf(stderr, "benchmark setup failed\n");
+            graph_free(&g);
+            return 1;
+        }
+    }
+
+    graph_free(&g);
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * JSON command parser: numbers read in the single pass match strtod bit
+ * for bit, and malformed, duplicate, out-of-range and deeply nested
+ * lines get the documented error with the field or byte offset the
+ * server reports.
+ *
+ *   make check
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "command.h"
+
+#define FUZZ_NUMBERS 2000000
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        if (!(cond)) {                                          \
+            failures++;                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);         \
+            printf(__VA_ARGS__);                                \
+            printf("\n");                                       \
+        }                                                       \
+    } while (0)
+
+/* Error position not checked (errors found after the walk carry none) */
+#define ANY_POS ((size_t)-1)
+
+typedef struct {
+    const char* line;
+    CommandError err;
+    const char* field;      /* expected error_field, or NULL */
+    size_t pos;             /* expected error_pos, or ANY_POS */
+} ErrorCase;
+
+static const ErrorCase ERROR_CASES[] = {
+    /* malformed */
+    { "", CMD_ERR_SYNTAX, NULL, 0 },
+    { "[1]", CMD_ERR_SYNTAX, NULL, 0 },
+    { "{\"user_id\":1,\"car_id\":1,\"start_node\":1,,}", CMD_ERR_SYNTAX, NULL, 39 },
+    { "{\"user_id\":1} trailing", CMD_ERR_SYNTAX, NULL, 14 },
+    { "{\"speed\":-}", CMD_ERR_SYNTAX, NULL, 10 },
+    { "{\"speed\":01}", CMD_ERR_SYNTAX, NULL, 10 },
+    { "{\"speed\":1.}", CMD_ERR_SYNTAX, NULL, 11 },
+    { "{\"s\":\"\\x\"}", CMD_ERR_SYNTAX, NULL, 7 },
+    { "{\"s\":\"abc", CMD_ERR_SYNTAX, NULL, 9 },
+    { "{\"s\":tru}", CMD_ERR_SYNTAX, NULL, 5 },
+    { "{\"user_id\" 1}", CMD_ERR_SYNTAX, NULL, 11 },
+
+    /* duplicate */
+    { "{\"user_id\":1,\"user_id\":2}", CMD_ERR_DUPLICATE, "user_id", 23 },
+    { "{\"speed\":1,\"x\":0,\"speed\":1}", CMD_ERR_DUPLICATE, "speed", 25 },
+
+    /* out of range */
+    { "{\"start_node\":99999999999}", CMD_ERR_RANGE, "start_node", 14 },
+    { "{\"edge_id\":2147483648}", CMD_ERR_RANGE, "edge_id", 11 },
+    { "{\"edge_id\":-2147483649}", CMD_ERR_RANGE, "edge_id", 11 },
+    { "{\"req_id\":9223372036854775808}", CMD_ERR_RANGE, "req_id", 10 },
+    { "{\"req_id\":12345678901234567890}", CMD_ERR_RANGE, "req_id", 10 },
+    { "{\"speed\":1e999}", CMD_ERR_RANGE, "speed", 9 },
+    { "{\"timestamp\":-1e309}", CMD_ERR_RANGE, "timestamp", 13 },
+
+    /* wrong type */
+    { "{\"start_node\":1.5}", CMD_ERR_BAD_VALUE, "start_node", 14 },
+    { "{\"start_node\":1e2}", CMD_ERR_BAD_VALUE, "start_node", 14 },
+    { "{\"start_node\":\"1\"}", CMD_ERR_BAD_VALUE, "start_node", 14 },
+    { "{\"speed\":[12]}", CMD_ERR_BAD_VALUE, "speed", 9 },
+    { "{\"speed\":null}", CMD_ERR_BAD_VALUE, "speed", 9 },
+
+    /* deeply nested: 16 levels under an unknown key are fine, 17 are not */
+    { "{\"a\":[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]}", CMD_ERR_UNKNOWN, NULL, ANY_POS },
+    { "{\"a\":[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]}", CMD_ERR_TOO_DEEP, NULL, 21 },
+    { "{\"a\":{\"b\":{\"c\":{\"d\":{\"e\":{\"f\":{\"g\":{\"h\":{\"i\":{\"j\":{\"k\":{\"l\":"
+      "{\"m\":{\"n\":{\"o\":{\"p\":{\"q\":1}}}}}}}}}}}}}}}}}",
+      CMD_ERR_TOO_DEEP, NULL, 85 },
+    { "{\"speed\":[[[[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]]]]}", CMD_ERR_TOO_DEEP, NULL, 25 },
+
+    /* incomplete or unrecognized */
+    { "{\"req_id\":3,\"user_id\":1,\"car_id\":1,\"start_node\":1,\"timestamp\":0.5}",
+      CMD_ERR_MISSING, "destination_node", ANY_POS },
+    { "{\"edge_id\":-2147483648}", CMD_ERR_MISSING, "user_id", ANY_POS },
+    { "{\"user_id\":1,\"car_id\":1,\"timestamp\":1,\"edge_id\":3,\"speed\":12}",
+      CMD_ERR_MISSING, "position_on_edge", ANY_POS },
+    { "{\"req_id\":-9223372036854775808}", CMD_ERR_UNKNOWN, NULL, ANY_POS },
+    { "{\"foo\":1}", CMD_ERR_UNKNOWN, NULL, ANY_POS },
+    { "{}", CMD_ERR_UNKNOWN, NULL, ANY_POS },
+};
+
+#define NUM_ERROR_CASES (sizeof(ERROR_CASES) / sizeof(ERROR_CASES[0]))
+
+static void check_errors(void) {
+    for (size_t i = 0; i < NUM_ERROR_CASES; i++) {
+        const ErrorCase* c = &ERROR_CASES[i];
+        JsonCommand cmd;
+        CommandError err = command_parse_json(c->line, strlen(c->line), &cmd);
+        int field_ok = c->field ? (cmd.error_field && strcmp(cmd.error_field, c->field) == 0)
+                                : cmd.error_field == NULL;
+        CHECK(err == c->err && field_ok && (c->pos == ANY_POS || cmd.error_pos == c->pos),
+              "%s: got %s field=%s at=%zu, want %s field=%s at=%ld", c->line,
+              command_error_code(err), cmd.error_field ? cmd.error_field : "-", cmd.error_pos,
+              command_error_code(c->err), c->field ? c->field : "-", (long)c->pos);
+    }
+}
+
+static void check_commands(void) {
+    JsonCommand cmd;
+    const char* route = "  {\"req_id\":9, \"user_id\":1,\"car_id\":2,\"start_node\":3,"
+                        "\"destination_node\":50,\"timestamp\":0.5,"
+                        "\"extra\":{\"a\":[1,2,{\"b\":null}],\"s\":\"x\\\"y\\u00e9\"}} ";
+    CHECK(command_parse_json(route, strlen(route), &cmd) == CMD_OK && cmd.kind == CMD_ROUTE &&
+          cmd.req_id == 9 && cmd.user_id == 1 && cmd.car_id == 2 && cmd.start_node == 3 &&
+          cmd.destination_node == 50 && cmd.timestamp == 0.5, "route not parsed");
+
+    const char* update = "{\"user_id\":1,\"car_id\":1,\"timestamp\":1,\"edge_id\":3,"
+                         "\"position_on_edge\":0.25,\"speed\":12.5}";
+    CHECK(command_parse_json(update, strlen(update), &cmd) == CMD_OK && cmd.kind == CMD_UPDATE &&
+          cmd.edge_id == 3 && cmd.position_on_edge == 0.25 && cmd.speed == 12.5,
+          "update not parsed");
+
+    /* A req_id read before the error is kept so the reply can echo it */
+    const char* bad = "{\"req_id\":7,\"start_node\":1.5}";
+    CHECK(command_parse_json(bad, strlen(bad), &cmd) == CMD_ERR_BAD_VALUE &&
+          (cmd.fields & CMD_F_REQ_ID) && cmd.req_id == 7, "req_id lost on error");
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t next_rand(void) {
+    /* splitmix64 */
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static char* put_digits(char* p, int n, int leading_nonzero) {
+    for (int i = 0; i < n; i++) {
+        int d = (int)(next_rand() % 10);
+        if (i == 0 && leading_nonzero && d == 0) d = 1;
+        *p++ = (char)('0' + d);
+    }
+    return p;
+}
+
+/* A random JSON number: short and long mantissas, fractions and exponents
+   inside and outside the fast path, and printf output of random doubles */
+static void random_number(char* buf, size_t size) {
+    uint64_t r = next_rand();
+    if (r % 4 == 0) {
+        double v;
+        uint64_t bits = next_rand();
+        memcpy(&v, &bits, sizeof(v));
+        if (!isfinite(v)) v = 0.0;
+        if (r & 16) snprintf(buf, size, "%.17g", v);
+        else snprintf(buf, size, "%.*f", (int)(next_rand() % 10), fmod(v, 1e12));
+        return;
+    }
+    char* p = buf;
+    if (r & 8) *p++ = '-';
+    int int_digits = 1 + (int)(next_rand() % 24);
+    if (next_rand() % 8 == 0) *p++ = '0';
+    else p = put_digits(p, int_digits, 1);
+    if (r & 16) {
+        *p++ = '.';
+        p = put_digits(p, 1 + (int)(next_rand() % 24), 0);
+    }
+    if (r & 32) {
+        *p++ = (r & 64) ? 'E' : 'e';
+        if (r & 128) *p++ = (r & 256) ? '-' : '+';
+        int e = (int)(next_rand() % ((r & 512) ? 400 : 30));
+        p += sprintf(p, "%d", e);
+    }
+    *p = '\0';
+}
+
+static void check_numbers(void) {
+    char num[96];
+    char line[128];
+    int mismatches = 0;
+    for (int i = 0; i < FUZZ_NUMBERS; i++) {
+        random_number(num, sizeof(num));
+        int n = snprintf(line, sizeof(line), "{\"timestamp\":%s}", num);
+
+        double want = strtod(num, NULL);
+        JsonCommand cmd;
+        CommandError err = command_parse_json(line, (size_t)n, &cmd);
+        int ok;
+        if (!isfinite(want)) {
+            ok = err == CMD_ERR_RANGE;
+        } else {
+            ok = err == CMD_ERR_UNKNOWN && (cmd.fields & CMD_F_TIMESTAMP) &&
+                 memcmp(&cmd.timestamp, &want, sizeof(want)) == 0;
+        }
+        if (!ok && mismatches++ < 10) {
+            CHECK(0, "%s: got %s %.17g, strtod %.17g", num, command_error_code(err),
+                  cmd.timestamp, want);
+        }
+    }
+    if (mismatches > 10) CHECK(0, "%d more number mismatches", mismatches - 10);
+}
+
+int main(void) {
+    check_commands();
+    check_errors();
+    check_numbers();
+
+    printf("command_check: %s (%d failure%s)\n", failures ? "FAIL" : "ok",
+           failures, failures == 1 ? "" : "s");
+    return failures != 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Reply number formatting: fmt_int and fmt_fixed write exactly what
+ * printf would, and fmt_fixed hands back to snprintf (returns NULL)
+ * for values it cannot settle, rather than guessing a rounding tie.
+ *
+ *   make check
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "numfmt.h"
+
+#define RANDOM_VALUES 20000000
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        if (!(cond)) {                                          \
+            failures++;                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);         \
+            printf(__VA_ARGS__);                                \
+            printf("\n");                                       \
+        }                                                       \
+    } while (0)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t next_rand(void) {
+    /* splitmix64 */
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static void check_ints(void) {
+    static const long long values[] = {
+        0, 1, -1, 9, 10, 99, 100, -1000, 123456789012LL,
+        INT_MAX, INT_MIN, LLONG_MAX, LLONG_MIN
+    };
+    char got[NUMFMT_INT_MAX + 1];
+    char want[32];
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        *fmt_int(got, values[i]) = '\0';
+        snprintf(want, sizeof(want), "%lld", values[i]);
+        CHECK(strcmp(got, want) == 0, "fmt_int %s, printf %s", got, want);
+    }
+    for (int i = 0; i < 1000000; i++) {
+        long long v = (long long)next_rand() >> (next_rand() % 64);
+        *fmt_int(got, v) = '\0';
+        snprintf(want, sizeof(want), "%lld", v);
+        if (strcmp(got, want) != 0) {
+            CHECK(0, "fmt_int %s, printf %s", got, want);
+            break;
+        }
+    }
+}
+
+/* Compares one value; returns 0 when fmt_fixed fell back */
+static int compare_fixed(double v, int decimals, long* mismatches) {
+    char got[NUMFMT_FIXED_MAX + 1];
+    char want[512];
+    char* end = fmt_fixed(got, v, decimals);
+    if (!end) return 0;
+    *end = '\0';
+    snprintf(want, sizeof(want), "%.*f", decimals, v);
+    if (strcmp(got, want) != 0 && (*mismatches)++ < 10) {
+        CHECK(0, "%.17g at %d decimals: fmt_fixed %s, printf %s", v, decimals, got, want);
+    }
+    return 1;
+}
+
+/* Coordinates, fractions near .5 and .0005, exact binary fractions (the
+   ties) and large magnitudes */
+static double random_value(void) {
+    uint64_t r = next_rand();
+    double u = (double)(next_rand() >> 11) * 0x1p-53;
+    switch (r % 5) {
+    case 0:  return (double)(r % 2000000) / 1000.0 + (double)((int)(r >> 32) % 3 - 1) * 0.0005;
+    case 1:  return ldexp((double)(r >> 33), -(int)((r >> 8) % 60));
+    case 2:  return (u - 0.5) * 1e9;
+    case 3:  return (double)((r >> 8) % 100000) * 0.0625;
+    default: return u * 1e15 * ((r & 256) ? -1.0 : 1.0);
+    }
+}
+
+static void check_fixed(void) {
+    long mismatches = 0;
+    long fallbacks = 0;
+    for (long i = 0; i < RANDOM_VALUES; i++) {
+        double v = random_value();
+        int decimals = (int)(next_rand() % (NUMFMT_DECIMALS_MAX + 1));
+        if (!compare_fixed(v, decimals, &mismatches)) fallbacks++;
+    }
+    /* The fast path has to stay the common case */
+    CHECK(fallbacks < RANDOM_VALUES / 10, "%ld of %d values fell back", fallbacks, RANDOM_VALUES);
+
+    static const double edges[] = { 0.0, -0.0, 0.9995, 0.0005, -0.0004, 999.9999, 1e15 - 1 };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        for (int d = 0; d <= NUMFMT_DECIMALS_MAX; d++) compare_fixed(edges[i], d, &mismatches);
+    }
+    if (mismatches > 10) CHECK(0, "%ld more fmt_fixed mismatches", mismatches - 10);
+
+    /* Outside the fast path nothing is written */
+    char buf[NUMFMT_FIXED_MAX];
+    CHECK(!fmt_fixed(buf, NAN, 3), "NaN formatted");
+    CHECK(!fmt_fixed(buf, INFINITY, 3), "inf formatted");
+    CHECK(!fmt_fixed(buf, 1e15, 0), "1e15 formatted");
+    CHECK(!fmt_fixed(buf, 1.5, NUMFMT_DECIMALS_MAX + 1), "too many decimals formatted");
+    CHECK(!fmt_fixed(buf, 1.5, -1), "negative decimals formatted");
+    CHECK(!fmt_fixed(buf, 0.125, 2), "tie 0.125 formatted");
+    CHECK(!fmt_fixed(buf, 2.5, 0), "tie 2.5 formatted");
+}
+
+int main(void) {
+    check_ints();
+    check_fixed();
+
+    printf("numfmt_check: %s (%d failure%s)\n", failures ? "FAIL" : "ok",
+           failures, failures == 1 ? "" : "s");
+    return failures != 0;
+}
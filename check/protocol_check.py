@@ -0,0 +1,512 @@
+"""
+End-to-end protocol check against a live server.
+
+Generates a graph, starts ./server on a free port and checks:
+- JSON routes against a Dijkstra search over edges.csv
+- binary routes against the JSON ones, plus binary updates, predictions
+  and error frames
+- coalesced updates against an EMA computed here
+- pipelining in ordered and unordered mode
+- many simultaneous connections, one SO_REUSEPORT listener per I/O thread,
+  and a second instance on the same port failing to bind
+- load shedding: with a tiny routing queue or a short deadline, every
+  request still gets its reply in order, and STATS counts the OVERLOADED
+  ones
+- STATS with the largest worker pools still returns one complete JSON line
+
+    make protocol-check
+    python3 check/protocol_check.py --server ./server --connections 2000
+"""
+import argparse
+import csv
+import heapq
+import json
+import os
+import random
+import resource
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from collections import Counter
+from typing import Dict, List, Optional, Tuple
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+failures = 0
+
+
+def check(cond: bool, msg: str) -> None:
+    global failures
+    if not cond:
+        failures += 1
+        print(f"FAIL: {msg}")
+
+
+# --------- graph ---------
+
+class Graph:
+    def __init__(self, data_dir: str):
+        self.adj: Dict[int, List[Tuple[int, float, int]]] = {}
+        self.edges: Dict[int, Tuple[int, int, float, float]] = {}
+        with open(os.path.join(data_dir, "edges.csv")) as f:
+            for r in csv.DictReader(f):
+                e, u, v = int(r["edge_id"]), int(r["from_node"]), int(r["to_node"])
+                length, limit = float(r["base_length"]), float(r["base_speed_limit"])
+                self.adj.setdefault(u, []).append((v, length / limit, e))
+                self.edges[e] = (u, v, length, limit)
+        with open(os.path.join(data_dir, "nodes.csv")) as f:
+            self.num_nodes = sum(1 for _ in f) - 1
+
+    def shortest(self, s: int, t: int) -> Optional[float]:
+        dist = {s: 0.0}
+        pq = [(0.0, s)]
+        while pq:
+            d, u = heapq.heappop(pq)
+            if u == t:
+                return d
+            if d > dist[u]:
+                continue
+            for v, w, _ in self.adj.get(u, []):
+                if d + w < dist.get(v, float("inf")):
+                    dist[v] = d + w
+                    heapq.heappush(pq, (d + w, v))
+        return None
+
+
+# --------- server ---------
+
+def free_port() -> int:
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def start_server(binary: str, data_dir: str, port: int, extra: List[str], log_path: str) -> subprocess.Popen:
+    log = open(log_path, "w")
+    proc = subprocess.Popen([binary, "--data-dir", data_dir, "--port", str(port)] + extra,
+                            stdout=log, stderr=subprocess.STDOUT)
+    for _ in range(100):
+        if proc.poll() is not None:
+            raise SystemExit(f"server exited with {proc.returncode}, see {log_path}")
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=1.0).close()
+            return proc
+        except OSError:
+            time.sleep(0.1)
+    proc.kill()
+    raise SystemExit(f"server did not start listening, see {log_path}")
+
+
+def stop_server(proc: subprocess.Popen) -> None:
+    proc.terminate()
+    try:
+        proc.wait(timeout=5)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        proc.wait()
+
+
+def connect(port: int):
+    s = socket.create_connection(("127.0.0.1", port), timeout=30.0)
+    return s, s.makefile("rb")
+
+
+def request(sock: socket.socket, f, line: str) -> str:
+    sock.sendall((line + "\n").encode())
+    return f.readline().decode()
+
+
+def route_json(req_id: int, user: int, a: int, b: int) -> str:
+    return json.dumps({"req_id": req_id, "user_id": user, "car_id": user, "start_node": a,
+                       "destination_node": b, "timestamp": 1.0}, separators=(",", ":"))
+
+
+def update_json(req_id: int, user: int, edge: int, speed: float) -> str:
+    return json.dumps({"req_id": req_id, "user_id": user, "car_id": user, "timestamp": 1.0,
+                       "edge_id": edge, "position_on_edge": 0.5, "speed": speed}, separators=(",", ":"))
+
+
+# --------- binary frames ---------
+
+def frame(kind: int, payload: bytes) -> bytes:
+    return struct.pack("<IB", len(payload) + 1, kind) + payload
+
+
+def read_frame(f) -> Tuple[int, bytes]:
+    n = struct.unpack("<I", f.read(4))[0]
+    body = f.read(n)
+    return body[0], body[1:]
+
+
+def varint_deltas(b: bytes, count: int) -> List[int]:
+    out, i, prev = [], 0, 0
+    for _ in range(count):
+        u, shift = 0, 0
+        while True:
+            x = b[i]
+            i += 1
+            u |= (x & 0x7F) << shift
+            shift += 7
+            if x < 0x80:
+                break
+        prev += (u >> 1) ^ -(u & 1)
+        out.append(prev)
+    if i != len(b):
+        raise ValueError("trailing bytes after route edges")
+    return out
+
+
+def decode(kind: int, p: bytes) -> tuple:
+    if kind == 0x81:
+        rid, user, car, eta, count = struct.unpack_from("<IiidI", p)
+        return ("ROUTE", rid, user, car, eta, varint_deltas(p[24:], count))
+    if kind == 0x82:
+        return ("ACK",) + struct.unpack("<Iii", p)
+    if kind == 0x83:
+        return ("PRED",) + struct.unpack("<Iid", p)
+    if kind == 0xFF:
+        return ("ERROR",) + struct.unpack("<IBii", p)
+    return ("?", kind, p)
+
+
+# --------- checks ---------
+
+def check_routes(port: int, g: Graph, queries: int, rnd: random.Random) -> None:
+    """Free-flow routes must be continuous, end at the target and cost what Dijkstra finds"""
+    sock, f = connect(port)
+    with sock:
+        for i in range(queries):
+            a, b = rnd.randrange(g.num_nodes), rnd.randrange(g.num_nodes)
+            r = json.loads(request(sock, f, route_json(i, i, a, b)))
+            ref = g.shortest(a, b)
+            if ref is None:
+                check(r.get("error") == "NO_ROUTE", f"route {a}->{b}: expected NO_ROUTE, got {r}")
+                continue
+            if "route_edges" not in r:
+                check(False, f"route {a}->{b}: no route in {r}")
+                continue
+            cost, cur = 0.0, a
+            for e in r["route_edges"]:
+                u, v, length, limit = g.edges[e]
+                if u != cur:
+                    break
+                cost += length / limit
+                cur = v
+            check(cur == b, f"route {a}->{b}: edges do not lead to the target")
+            check(abs(cost - ref) <= 1e-6 * max(1.0, ref), f"route {a}->{b}: cost {cost}, shortest {ref}")
+            check(abs(r["eta"] - ref) <= 1e-2, f"route {a}->{b}: eta {r['eta']}, shortest {ref}")
+            check(r.get("req_id") == i and r.get("user_id") == i, f"route {a}->{b}: ids not echoed in {r}")
+
+
+def check_binary(port: int, g: Graph, queries: int, rnd: random.Random) -> None:
+    """Binary replies carry the same routes as JSON; errors come back as ERROR frames"""
+    js, jf = connect(port)
+    bs, bf = connect(port)
+    with js, bs:
+        bs.sendall(b"MODE UNORDERED\nPROTO BINARY\n")
+        check(bf.readline() == b"MODE UNORDERED\n", "MODE UNORDERED not acknowledged")
+        check(bf.readline() == b"PROTO BINARY\n", "PROTO BINARY not acknowledged")
+
+        pairs = [(rnd.randrange(g.num_nodes), rnd.randrange(g.num_nodes)) for _ in range(queries)]
+        bs.sendall(b"".join(frame(0x01, struct.pack("<Iiidii", i, 7, 8, 1.5, a, b))
+                            for i, (a, b) in enumerate(pairs)))
+        got = {}
+        for _ in pairs:
+            r = decode(*read_frame(bf))
+            got[r[1]] = r
+        check(sorted(got) == list(range(queries)), "binary replies missing or duplicated")
+        for i, (a, b) in enumerate(pairs):
+            j = json.loads(request(js, jf, route_json(i, 7, a, b)))
+            r = got.get(i, ("?",))
+            if "error" in j:
+                check(r[0] == "ERROR" and r[2] == 6, f"binary {a}->{b}: {r}, JSON {j}")
+            else:
+                check(r[0] == "ROUTE" and r[5] == j["route_edges"] and abs(r[4] - j["eta"]) < 1e-3
+                      and r[2:4] == (7, 8), f"binary {a}->{b}: {r[:5]}, JSON {j}")
+
+        edge = rnd.randrange(2, len(g.edges))  # edge 1 is left for check_coalescing
+        bs.sendall(frame(0x02, struct.pack("<Iiididd", 1000, 7, 8, 2.0, edge, 0.5, 10.0)) +
+                   frame(0x03, struct.pack("<Ii", 1001, edge)))
+        replies = {r[1]: r for r in (decode(*read_frame(bf)) for _ in range(2))}
+        check(replies.get(1000) == ("ACK", 1000, 7, 8), f"binary update: {replies.get(1000)}")
+        pred = replies.get(1001, ("?",))
+        check(pred[0] == "PRED" and pred[2] == edge and pred[3] > 0, f"binary prediction: {pred}")
+
+        bs.sendall(frame(0x02, struct.pack("<Iiididd", 1002, 7, 8, 2.0, -1, 0.5, 10.0)) +
+                   frame(0x02, struct.pack("<Iiididd", 1003, 7, 8, 2.0, edge, 0.5, float("nan"))) +
+                   frame(0x09, struct.pack("<I", 1004)) +
+                   frame(0x01, b"\x01\x02"))
+        errors = sorted((decode(*read_frame(bf)) for _ in range(4)), key=lambda r: r[1])
+        check(errors == [("ERROR", 0, 3, -1, -1), ("ERROR", 1002, 8, 7, 8), ("ERROR", 1003, 9, 7, 8),
+                         ("ERROR", 1004, 4, -1, -1)], f"binary errors: {errors}")
+
+        # An oversized frame cannot be skipped: BAD_FRAME, then the server hangs up
+        bs.sendall(struct.pack("<I", 1 << 30))
+        check(decode(*read_frame(bf)) == ("ERROR", 0, 3, -1, -1), "oversized frame not refused")
+        check(bf.read(1) == b"", "connection left open after an oversized frame")
+
+
+def check_coalescing(port: int, g: Graph, rnd: random.Random) -> None:
+    """Updates pipelined on one edge are all ACKed in order and fold into the same EMA as one by one"""
+    edge = 1
+    _, _, length, limit = g.edges[edge]
+    speeds = [rnd.uniform(1.0, limit) for _ in range(50)]
+    sock, f = connect(port)
+    with sock:
+        lines = [update_json(i, 1, edge, v) for i, v in enumerate(speeds)]
+        lines.append(update_json(len(speeds), 1, -3, 3.0))
+        sock.sendall(("\n".join(lines) + "\n").encode())
+        acks = [json.loads(f.readline()) for _ in lines]
+        check(all(a.get("status") == "ACK" for a in acks[:-1]), "coalesced updates not all ACKed")
+        check([a.get("req_id") for a in acks] == list(range(len(lines))), "coalesced ACKs out of order")
+        check(acks[-1].get("error") == "BAD_EDGE", f"bad edge in a batch: {acks[-1]}")
+
+        ema = None
+        for v in speeds:
+            t = length / v
+            ema = t if ema is None else 0.2 * t + 0.8 * ema
+        pred = request(sock, f, f"PRED {edge}").split()
+        check(len(pred) == 3 and pred[:2] == ["PRED", str(edge)] and abs(float(pred[2]) - ema) < 1e-3,
+              f"PRED after coalescing: {pred}, expected {ema:.3f}")
+
+
+def check_pipelining(port: int, g: Graph, rnd: random.Random) -> None:
+    """Mixed commands sent in one write are answered in order; unordered mode answers them all"""
+    lines = []
+    for i in range(500):
+        k = rnd.random()
+        if k < 0.4:
+            lines.append((route_json(i, i, rnd.randrange(g.num_nodes), rnd.randrange(g.num_nodes)), "json", i))
+        elif k < 0.8:
+            lines.append((update_json(i, i, rnd.randrange(len(g.edges)), 10.0), "json", i))
+        elif k < 0.9:
+            lines.append((f"PRED {i}", "pred", i))
+        else:
+            lines.append((f"garbage {i}", "garbage", i))
+
+    sock, f = connect(port)
+    with sock:
+        sock.sendall(("\n".join(l for l, _, _ in lines) + "\n").encode())
+        bad = 0
+        for _, kind, i in lines:
+            r = f.readline().decode()
+            if kind == "pred":
+                bad += not r.startswith(f"PRED {i} ")
+            elif kind == "garbage":
+                bad += json.loads(r).get("error") != "UNKNOWN_CMD"
+            else:
+                bad += json.loads(r).get("req_id") != i
+        check(bad == 0, f"{bad} of {len(lines)} pipelined replies out of order or wrong")
+
+        check(request(sock, f, "MODE UNORDERED") == "MODE UNORDERED\n", "MODE UNORDERED not acknowledged")
+        want = [i for _, kind, i in lines if kind == "json"]
+        sock.sendall(("\n".join(l for l, kind, _ in lines if kind == "json") + "\n").encode())
+        got = sorted(json.loads(f.readline())["req_id"] for _ in want)
+        check(got == want, "unordered mode lost or duplicated replies")
+
+        check(json.loads(request(sock, f, "MODE bogus")).get("error") == "BAD_MODE", "bad mode accepted")
+        check(request(sock, f, "MODE ORDERED") == "MODE ORDERED\n", "MODE ORDERED not acknowledged")
+
+
+def check_connections(port: int, g: Graph, count: int) -> None:
+    """Many clients connected at once are all served"""
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft < count + 64:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (min(hard, count + 64), hard))
+    socks = [socket.create_connection(("127.0.0.1", port), timeout=30.0) for _ in range(count)]
+    for i, s in enumerate(socks):
+        s.sendall(f"REQ {i % g.num_nodes} {(i * 7) % g.num_nodes}\nUPD {i % len(g.edges)} 10.0 0.5\n".encode())
+    served = 0
+    for s in socks:
+        buf = b""
+        while buf.count(b"\n") < 2:
+            d = s.recv(65536)
+            if not d:
+                break
+            buf += d
+        lines = buf.split(b"\n")
+        served += len(lines) > 2 and (b"route_edges" in lines[0] or b"NO_ROUTE" in lines[0]) and b"ACK" in lines[1]
+        s.close()
+    check(served == count, f"{served} of {count} simultaneous connections served")
+
+
+def check_listeners(port: int, io_threads: int) -> None:
+    """Each I/O thread listens on the port itself"""
+    listening = 0
+    for path in ("/proc/net/tcp", "/proc/net/tcp6"):
+        if not os.path.exists(path):
+            continue
+        with open(path) as f:
+            for row in f.readlines()[1:]:
+                cols = row.split()
+                if int(cols[1].split(":")[1], 16) == port and cols[3] == "0A":
+                    listening += 1
+    check(listening == io_threads, f"{listening} listeners on port {port}, expected {io_threads}")
+
+
+def check_second_instance(binary: str, data_dir: str, port: int, log_path: str) -> None:
+    """A second server on the same port must not join the first one's listeners"""
+    with open(log_path, "w") as log:
+        proc = subprocess.Popen([binary, "--data-dir", data_dir, "--port", str(port)],
+                                stdout=log, stderr=subprocess.STDOUT)
+        try:
+            rc = proc.wait(timeout=30)
+        except subprocess.TimeoutExpired:
+            stop_server(proc)
+            rc = 0
+    with open(log_path) as log:
+        out = log.read()
+    check(rc != 0 and "Address already in use" in out, f"second instance on port {port}: exit {rc}")
+
+
+def run_overload_clients(port: int, g: Graph, clients: int, requests: int) -> Counter:
+    """Each client pipelines its requests in one go while reading replies"""
+    replies: Counter = Counter()
+    lock = threading.Lock()
+
+    def client(k: int) -> None:
+        sock, f = connect(port)
+        with sock:
+            lines = "".join(route_json(i, k, (i * 13) % g.num_nodes, (i * 977 + 5) % g.num_nodes) + "\n"
+                            for i in range(requests))
+            writer = threading.Thread(target=sock.sendall, args=(lines.encode(),))
+            writer.start()
+            seen: Counter = Counter()
+            for i in range(requests):
+                line = f.readline()
+                if not line:
+                    seen["lost"] += requests - i
+                    break
+                r = json.loads(line)
+                if r.get("req_id") != i:
+                    seen["out_of_order"] += 1
+                if "route_edges" in r or r.get("error") == "NO_ROUTE":
+                    seen["routed"] += 1
+                else:
+                    seen[r.get("error", "other")] += 1
+            writer.join()
+        with lock:
+            replies.update(seen)
+
+    threads = [threading.Thread(target=client, args=(k,)) for k in range(clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return replies
+
+
+def check_overload(binary: str, data_dir: str, g: Graph, tmp: str, clients: int, requests: int) -> None:
+    """Shed requests are answered OVERLOADED in their place and counted by STATS"""
+    for name, extra in (("queue limit", ["--routing-queue-limit", "4"]),
+                        ("deadline", ["--queue-deadline-ms", "2"])):
+        port = free_port()
+        proc = start_server(binary, data_dir, port, ["--routing-workers", "1"] + extra,
+                            os.path.join(tmp, "overload.log"))
+        try:
+            replies = run_overload_clients(port, g, clients, requests)
+            sock, f = connect(port)
+            with sock:
+                stats = json.loads(request(sock, f, "STATS"))
+        finally:
+            stop_server(proc)
+
+        total = clients * requests
+        shed = replies["OVERLOADED"]
+        print(f"{name}: {shed} of {total} requests shed, STATS rejected={stats.get('rejected')} "
+              f"expired={stats.get('expired')}")
+        check(replies["routed"] + shed == total, f"{name}: replies {dict(replies)}")
+        check(replies["out_of_order"] == 0, f"{name}: {replies['out_of_order']} replies out of order")
+        check(stats.get("rejected", 0) + stats.get("expired", 0) == shed,
+              f"{name}: STATS {stats} does not match {shed} OVERLOADED replies")
+        if name == "queue limit":
+            check(shed > 0, "queue limit of 4 shed nothing")
+            check(stats.get("expired") == 0, f"queue limit: requests expired without a deadline: {stats}")
+
+
+def check_stats_workers(binary: str, data_dir: str, tmp: str, workers: int) -> None:
+    """STATS lists every queue and its closing fields whatever the pool sizes"""
+    port = free_port()
+    proc = start_server(binary, data_dir, port,
+                        ["--routing-workers", str(workers), "--traffic-workers", str(workers)],
+                        os.path.join(tmp, "stats.log"))
+    try:
+        sock, f = connect(port)
+        with sock:
+            sock.settimeout(5.0)
+            try:
+                line = request(sock, f, "STATS")
+                after = request(sock, f, "MODE ORDERED")
+            except socket.timeout:
+                check(False, "stats: reply not terminated by a newline")
+                return
+    finally:
+        stop_server(proc)
+
+    print(f"stats: {workers} + {workers} workers, {len(line)} byte reply")
+    try:
+        stats = json.loads(line)
+    except ValueError:
+        check(False, f"stats: not one JSON line: {line[:80]!r}...{line[-80:]!r}")
+        return
+    check(len(stats.get("traffic_queues", [])) == workers and
+          len(stats.get("routing_queues", [])) == workers,
+          f"stats: {len(stats.get('traffic_queues', []))} traffic and "
+          f"{len(stats.get('routing_queues', []))} routing queues listed")
+    check("rejected" in stats and "expired" in stats, f"stats: counters missing: {list(stats)}")
+    check(after == "MODE ORDERED\n", f"stats: next reply {after!r}")
+
+
+# --------- main ---------
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="End-to-end protocol check against a freshly started server.")
+    ap.add_argument("--server", default=os.path.join(ROOT, "server"))
+    ap.add_argument("--nodes", type=int, default=2000)
+    ap.add_argument("--edges", type=int, default=8000)
+    ap.add_argument("--queries", type=int, default=300, help="Routes compared per check.")
+    ap.add_argument("--connections", type=int, default=1000, help="Simultaneous connections.")
+    ap.add_argument("--io-threads", type=int, default=4)
+    ap.add_argument("--overload-clients", type=int, default=8, help="Pipelining clients in the shedding check.")
+    ap.add_argument("--overload-requests", type=int, default=2000, help="Routes each of them sends.")
+    ap.add_argument("--stats-workers", type=int, default=1024,
+                    help="Routing and traffic workers in the STATS check (server max 1024).")
+    ap.add_argument("--seed", type=int, default=7)
+    args = ap.parse_args()
+
+    rnd = random.Random(args.seed)
+    with tempfile.TemporaryDirectory(prefix="protocol_check.") as tmp:
+        data_dir = os.path.join(tmp, "data")
+        subprocess.run([sys.executable, os.path.join(ROOT, "generate_graph.py"), "--nodes", str(args.nodes),
+                        "--edges", str(args.edges), "--out", data_dir], check=True, stdout=subprocess.DEVNULL)
+        g = Graph(data_dir)
+
+        port = free_port()
+        proc = start_server(args.server, data_dir, port, ["--io-threads", str(args.io_threads)],
+                            os.path.join(tmp, "server.log"))
+        try:
+            # Routes first, while every edge is still at free flow
+            check_routes(port, g, args.queries, rnd)
+            check_binary(port, g, args.queries, rnd)
+            check_coalescing(port, g, rnd)
+            check_pipelining(port, g, rnd)
+            check_connections(port, g, args.connections)
+            check_listeners(port, args.io_threads)
+            check_second_instance(args.server, data_dir, port, os.path.join(tmp, "second.log"))
+            check(proc.poll() is None, "server exited during the check")
+        finally:
+            stop_server(proc)
+
+        check_overload(args.server, data_dir, g, tmp, args.overload_clients, args.overload_requests)
+        check_stats_workers(args.server, data_dir, tmp, args.stats_workers)
+
+    print(f"protocol_check: {'FAIL' if failures else 'ok'} ({failures} failure{'' if failures == 1 else 's'})")
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
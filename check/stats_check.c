@@ -0,0 +1,109 @@
+/*
+ * Graph bounds under live traffic: reports are clamped before they are
+ * folded in, degenerate edges do not poison the bounds, and rebuilding
+ * the stats over the current weights lets them tighten again, for the
+ * Euclidean heuristic (max_speed) and for ALT (min_time_ratio).
+ *
+ *   make check
+ */
+#include <stdio.h>
+#include <math.h>
+
+#include "graph.h"
+#include "traffic.h"
+#include "alt.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        if (!(cond)) {                                          \
+            failures++;                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);         \
+            printf(__VA_ARGS__);                                \
+            printf("\n");                                       \
+        }                                                       \
+    } while (0)
+
+static int stats_finite(const GraphStats* st) {
+    return isfinite(st->max_speed) && isfinite(st->time_scale) &&
+           isfinite(st->min_time_ratio);
+}
+
+/*
+ * 0 -> 1 -> 2 -> 3 -> 0 on a line; edge 2 has zero length. Speed limits
+ * 10, 20, 10, 10, so free flow gives max_speed 20 and ratio 1.
+ */
+static void build(Graph* g) {
+    graph_init(g, 4, 4);
+    for (int v = 0; v < 4; v++) graph_set_node_coordinates(g, v, 100.0 * v, 0.0);
+    graph_add_edge(g, 0, 0, 1, 100.0, 10.0);
+    graph_add_edge(g, 1, 1, 2, 100.0, 20.0);
+    graph_add_edge(g, 2, 2, 3, 0.0, 10.0);
+    graph_add_edge(g, 3, 3, 0, 300.0, 10.0);
+    graph_build_csr(g);
+    graph_compute_stats(g);
+}
+
+int main(void) {
+    Graph g;
+    TrafficTable traffic;
+    Landmarks lm;
+    build(&g);
+    if (traffic_init(&traffic, &g) != 0) return 1;
+    if (alt_build(&lm, &g, 2, ALT_SELECT_FARTHEST) != 0) return 1;
+    double alt_free_flow = alt_lower_bound(&lm, &g.stats, 0, 3);
+    CHECK(alt_free_flow > 0.0, "no ALT bound 0 -> 3 at free flow");
+
+    CHECK(g.stats.max_speed == 20.0, "free-flow max_speed %g", g.stats.max_speed);
+    CHECK(g.stats.min_time_ratio == 1.0, "free-flow ratio %g", g.stats.min_time_ratio);
+    CHECK(stats_finite(&g.stats), "free-flow stats not finite");
+
+    /* Zero-length edge: no 0/0 in the bounds */
+    graph_set_travel_time(&g, 2, 0.0);
+    CHECK(stats_finite(&g.stats), "zero-length edge poisoned the stats");
+    CHECK(g.stats.max_speed == 20.0, "zero-length edge moved max_speed to %g", g.stats.max_speed);
+
+    /* A huge report is clamped to TRAFFIC_SPEED_FACTOR_MAX x the limit */
+    double t0 = traffic_observe(&traffic, &g, 0, 1e300);
+    graph_set_travel_time(&g, 0, t0);
+    double clamped = TRAFFIC_SPEED_FACTOR_MAX * 10.0;
+    CHECK(fabs(t0 - 100.0 / clamped) < 1e-9, "huge speed gave travel time %g", t0);
+    CHECK(g.stats.max_speed <= clamped * (1 + 1e-12), "max_speed %g above clamp", g.stats.max_speed);
+    CHECK(g.stats.min_time_ratio >= 1.0 / TRAFFIC_SPEED_FACTOR_MAX - 1e-12,
+          "ratio %g below 1/factor", g.stats.min_time_ratio);
+    double alt_poisoned = alt_lower_bound(&lm, &g.stats, 0, 3);
+    CHECK(alt_poisoned >= alt_free_flow / TRAFFIC_SPEED_FACTOR_MAX * (1 - 1e-9),
+          "ALT bound fell to %g (free flow %g)", alt_poisoned, alt_free_flow);
+
+    /* Non-finite and non-positive speeds never reach the EMA */
+    double t1 = traffic_observe(&traffic, &g, 1, NAN);
+    CHECK(isfinite(t1) && t1 > 0.0, "NaN speed gave travel time %g", t1);
+    double batch[3] = { INFINITY, NAN, -5.0 };
+    double t3 = traffic_observe_many(&traffic, &g, 3, batch, 3);
+    CHECK(isfinite(t3) && t3 > 0.0, "batched inf/NaN gave travel time %g", t3);
+    graph_set_travel_time(&g, 1, t1);
+    graph_set_travel_time(&g, 3, t3);
+    CHECK(stats_finite(&g.stats), "stats not finite after bad speeds");
+
+    /* Normal reports override the outlier; a rebuild tightens the bounds */
+    double t = t0;
+    for (int i = 0; i < 100; i++) t = traffic_observe(&traffic, &g, 0, 10.0);
+    graph_set_travel_time(&g, 0, t);
+    CHECK(g.stats.max_speed > 20.0, "bounds tightened without a rebuild");
+    graph_compute_stats(&g);
+    CHECK(fabs(g.stats.max_speed - 20.0) < 1e-6, "rebuilt max_speed %g", g.stats.max_speed);
+    CHECK(fabs(g.stats.time_scale - 1.0 / 20.0) < 1e-9, "rebuilt time_scale %g", g.stats.time_scale);
+    CHECK(stats_finite(&g.stats), "rebuilt stats not finite");
+    CHECK(g.stats.min_time_ratio > 0.999, "rebuilt ratio %g", g.stats.min_time_ratio);
+    double alt_rebuilt = alt_lower_bound(&lm, &g.stats, 0, 3);
+    CHECK(alt_rebuilt > 0.999 * alt_free_flow, "ALT bound %g did not recover to %g",
+          alt_rebuilt, alt_free_flow);
+
+    alt_free(&lm);
+    traffic_free(&traffic);
+    graph_free(&g);
+
+    printf("stats_check: %s (%d failure%s)\n", failures ? "FAIL" : "ok",
+           failures, failures == 1 ? "" : "s");
+    return failures != 0;
+}
@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "alt.h"
+#include "min_heap.h"
+
+#define ALT_FILE_MAGIC   0x4D4C5A57u  /* "WZLM" */
+#define ALT_FILE_VERSION 2u
+
+/* ---------------- preprocessing ---------------- */
+
+typedef struct {
+    const Graph* g;
+    int num_nodes;
+    double* free_flow;      /* per forward CSR slot */
+    MinHeap* heap;
+    double* dist;           /* scratch Dijkstra distances */
+    int* parent;            /* scratch shortest-path tree (forward only) */
+    int* order;             /* settle order of the last search */
+    int settled;
+} AltBuilder;
+
+/*
+ * Free-flow Dijkstra from source over out-edges (forward) or in-edges
+ * (backward, giving distances to source). Unreached nodes get INFINITY.
+ */
+static void alt_dijkstra(AltBuilder* b, int source, int forward)
+{
+    const Graph* g = b->g;
+    for (int v = 0; v < b->num_nodes; v++) {
+        b->dist[v] = INFINITY;
+        b->parent[v] = -1;
+    }
+    clearMinHeap(b->heap);
+    b->settled = 0;
+
+    b->dist[source] = 0.0;
+    insertMinHeap(b->heap, source, 0.0);
+
+    while (!isEmpty(b->heap)) {
+        double d_u;
+        int u = extractMin(b->heap, &d_u);
+        b->order[b->settled++] = u;
+
+        int begin = forward ? g->out_offsets[u] : g->in_offsets[u];
+        int end = forward ? g->out_offsets[u + 1] : g->in_offsets[u + 1];
+        for (int i = begin; i < end; i++) {
+            int v = forward ? g->out_targets[i] : g->in_sources[i];
+            int slot = forward ? i : g->in_slots[i];
+            double nd = d_u + b->free_flow[slot];
+            if (nd < b->dist[v]) {
+                int queued = isInMinHeap(b->heap, v);
+                b->dist[v] = nd;
+                b->parent[v] = u;
+                if (queued) decreaseKey(b->heap, v, nd);
+                else insertMinHeap(b->heap, v, nd);
+            }
+        }
+    }
+}
+
+/* Floats are rounded down so a stored distance never exceeds the real one */
+static float round_down(double d)
+{
+    float f = (float)d;
+    if ((double)f > d) f = nextafterf(f, 0.0f);
+    return f;
+}
+
+/* Fill landmark k's two columns; returns the largest finite distance seen */
+static double store_landmark(AltBuilder* b, Landmarks* lm, int k)
+{
+    const size_t stride = 2 * (size_t)lm->count;
+    double max_d = 0.0;
+
+    for (int dir = 0; dir < 2; dir++) {
+        alt_dijkstra(b, lm->nodes[k], dir == 0);
+        for (int v = 0; v < lm->num_nodes; v++) {
+            double d = b->dist[v];
+            lm->dist[(size_t)v * stride + 2 * (size_t)k + (size_t)dir] =
+                isinf(d) ? INFINITY : round_down(d);
+            if (!isinf(d) && d > max_d) max_d = d;
+        }
+    }
+    return max_d;
+}
+
+/* Free-flow lower bound from -> to using the first k landmarks */
+static double free_flow_bound(const Landmarks* lm, int k, int from, int to)
+{
+    const size_t stride = 2 * (size_t)lm->count;
+    const float* rf = lm->dist + (size_t)from * stride;
+    const float* rt = lm->dist + (size_t)to * stride;
+    double best = 0.0;
+
+    for (int i = 0; i < k; i++) {
+        float from_l = rf[2 * i], from_r = rf[2 * i + 1];
+        float to_l = rt[2 * i], to_r = rt[2 * i + 1];
+        /* d(from, to) >= d(from, L) - d(to, L) */
+        if (!isinf(from_r) && !isinf(to_r) && from_r - to_r > best) best = from_r - to_r;
+        /* d(from, to) >= d(L, to) - d(L, from) */
+        if (!isinf(to_l) && !isinf(from_l) && to_l - from_l > best) best = to_l - from_l;
+    }
+    return best;
+}
+
+/* Node maximizing the smallest round-trip distance to the chosen landmarks */
+static int select_farthest(const Landmarks* lm, int k, int root)
+{
+    const size_t stride = 2 * (size_t)lm->count;
+    int best_v = -1;
+    double best_score = -1.0;
+
+    for (int v = 0; v < lm->num_nodes; v++) {
+        const float* row = lm->dist + (size_t)v * stride;
+        double score;
+        if (k == 0) {
+            /* No landmark yet: measure from the root in the spare column */
+            score = (double)row[2 * lm->count - 2] + (double)row[2 * lm->count - 1];
+            if (v == root) score = 0.0;
+        } else {
+            score = INFINITY;
+            for (int i = 0; i < k; i++) {
+                double rt = (double)row[2 * i] + (double)row[2 * i + 1];
+                if (isinf(rt)) rt = 0.0; /* unreachable nodes make poor landmarks */
+                if (rt < score) score = rt;
+            }
+        }
+        if (isinf(score)) score = 0.0;
+        if (score > best_score) {
+            best_score = score;
+            best_v = v;
+        }
+    }
+    return best_v;
+}
+
+/*
+ * Avoid heuristic (Goldberg & Werneck): grow a shortest-path tree from
+ * root, weigh every node by how badly the current landmarks bound its
+ * distance from root, sum the weights per subtree (zero for subtrees that
+ * contain a landmark) and walk from the heaviest node down to a leaf.
+ */
+static int select_avoid(AltBuilder* b, const Landmarks* lm, int k, int root, double* size,
+                        int* child_offsets, int* children)
+{
+    const int V = lm->num_nodes;
+    alt_dijkstra(b, root, 1);
+
+    for (int v = 0; v < V; v++) size[v] = 0.0;
+    for (int i = 0; i < b->settled; i++) {
+        int v = b->order[i];
+        size[v] = b->dist[v] - free_flow_bound(lm, k, root, v);
+        if (size[v] < 0.0) size[v] = 0.0;
+    }
+    for (int i = 0; i < k; i++) size[lm->nodes[i]] = -1.0; /* marks a landmark */
+
+    /* Children are settled after their parent; accumulate bottom-up */
+    for (int i = b->settled - 1; i > 0; i--) {
+        int v = b->order[i];
+        int p = b->parent[v];
+        if (size[v] < 0.0) {
+            size[p] = -1.0;
+        } else if (size[p] >= 0.0) {
+            size[p] += size[v];
+        }
+    }
+
+    int heaviest = -1;
+    for (int i = 0; i < b->settled; i++) {
+        int v = b->order[i];
+        if (size[v] > 0.0 && (heaviest < 0 || size[v] > size[heaviest])) heaviest = v;
+    }
+    if (heaviest < 0) return -1;
+
+    /* Children lists of the tree, then descend along the heaviest child */
+    memset(child_offsets, 0, sizeof(int) * ((size_t)V + 1));
+    for (int i = 1; i < b->settled; i++) child_offsets[b->parent[b->order[i]] + 1]++;
+    for (int v = 0; v < V; v++) child_offsets[v + 1] += child_offsets[v];
+    for (int i = 1; i < b->settled; i++) {
+        int v = b->order[i];
+        children[child_offsets[b->parent[v]]++] = v;
+    }
+    for (int v = V; v > 0; v--) child_offsets[v] = child_offsets[v - 1];
+    child_offsets[0] = 0;
+
+    int v = heaviest;
+    while (1) {
+        int next = -1;
+        for (int i = child_offsets[v]; i < child_offsets[v + 1]; i++) {
+            int c = children[i];
+            if (size[c] >= 0.0 && (next < 0 || size[c] > size[next])) next = c;
+        }
+        if (next < 0) break;
+        v = next;
+    }
+    return v;
+}
+
+/* FNV-1a over the edge list (endpoints, length, speed limit): landmark
+   distances depend on all of it, not just on the node and edge counts */
+static uint64_t edge_list_checksum(const Graph* g)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < g->num_edges; i++) {
+        const Edge* e = &g->edges[i];
+        unsigned char buf[2 * sizeof(int32_t) + 2 * sizeof(double)];
+        int32_t from = e->from_node, to = e->to_node;
+        memcpy(buf, &from, sizeof(from));
+        memcpy(buf + 4, &to, sizeof(to));
+        memcpy(buf + 8, &e->base_length, sizeof(double));
+        memcpy(buf + 16, &e->base_speed_limit, sizeof(double));
+        for (size_t k = 0; k < sizeof(buf); k++) {
+            h = (h ^ buf[k]) * 0x100000001b3ull;
+        }
+    }
+    return h;
+}
+
+static void builder_free(AltBuilder* b)
+{
+    free(b->free_flow);
+    free(b->dist);
+    free(b->parent);
+    free(b->order);
+    if (b->heap) freeMinHeap(b->heap);
+}
+
+int alt_build(Landmarks* lm, const Graph* g, int count, AltSelection selection)
+{
+    if (!lm || !g || count <= 0) return 10;
+
+    memset(lm, 0, sizeof(*lm));
+    const int V = g->num_nodes;
+    const int E = g->num_edges;
+    if (V == 0) return 10;
+    if (count > V) count = V;
+
+    /* While building, one spare column pair after the landmarks holds the
+       first root's distances, so the stride is count + 1 pairs */
+    lm->num_nodes = V;
+    lm->num_edges = E;
+    lm->checksum = edge_list_checksum(g);
+    lm->count = count + 1;
+    lm->nodes = (int*)malloc(sizeof(int) * ((size_t)count + 1));
+    lm->dist = (float*)malloc(sizeof(float) * (size_t)V * 2 * ((size_t)count + 1));
+
+    AltBuilder b;
+    memset(&b, 0, sizeof(b));
+    b.g = g;
+    b.num_nodes = V;
+    b.free_flow = (double*)malloc(sizeof(double) * (size_t)(E > 0 ? E : 1));
+    b.dist = (double*)malloc(sizeof(double) * (size_t)V);
+    b.parent = (int*)malloc(sizeof(int) * (size_t)V);
+    b.order = (int*)malloc(sizeof(int) * (size_t)V);
+    b.heap = createMinHeap(V, MIN_HEAP_DEFAULT_ARITY);
+
+    double* size = NULL;
+    int* child_offsets = NULL;
+    int* children = NULL;
+    if (selection == ALT_SELECT_AVOID) {
+        size = (double*)malloc(sizeof(double) * (size_t)V);
+        child_offsets = (int*)malloc(sizeof(int) * ((size_t)V + 1));
+        children = (int*)malloc(sizeof(int) * (size_t)V);
+    }
+
+    if (!lm->nodes || !lm->dist || !b.free_flow || !b.dist || !b.parent || !b.order || !b.heap ||
+        (selection == ALT_SELECT_AVOID && (!size || !child_offsets || !children))) {
+        builder_free(&b);
+        free(size);
+        free(child_offsets);
+        free(children);
+        alt_free(lm);
+        return 12;
+    }
+
+    for (int eid = 0; eid < E; eid++) {
+        const Edge* e = &g->edges[eid];
+        b.free_flow[g->edge_slot[eid]] = e->base_length / e->base_speed_limit;
+    }
+
+    /* Deterministic pseudo-random roots so rebuilding gives the same file */
+    uint32_t seed = 2463534242u;
+    double max_d = 0.0;
+
+    for (int k = 0; k < count; k++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        int root = (int)(seed % (uint32_t)V);
+
+        int pick;
+        if (k == 0) {
+            lm->nodes[count] = root;
+            store_landmark(&b, lm, count);
+            pick = select_farthest(lm, 0, root);
+        } else if (selection == ALT_SELECT_FARTHEST) {
+            pick = select_farthest(lm, k, root);
+        } else {
+            pick = select_avoid(&b, lm, k, root, size, child_offsets, children);
+        }
+
+        /* Fall back to the root when nothing useful is left (tiny graphs) */
+        if (pick < 0) pick = root;
+        for (int i = 0; i < k; i++) {
+            if (lm->nodes[i] == pick) {
+                pick = -1;
+                break;
+            }
+        }
+        if (pick < 0) {
+            for (int v = 0; v < V && pick < 0; v++) {
+                int used = 0;
+                for (int i = 0; i < k; i++) used |= lm->nodes[i] == v;
+                if (!used) pick = v;
+            }
+        }
+
+        lm->nodes[k] = pick;
+        double d = store_landmark(&b, lm, k);
+        if (d > max_d) max_d = d;
+    }
+
+    /* Drop the spare column pair */
+    lm->count = count;
+    const size_t wide = 2 * ((size_t)count + 1), narrow = 2 * (size_t)count;
+    for (size_t v = 1; v < (size_t)V; v++) {
+        memmove(lm->dist + v * narrow, lm->dist + v * wide, sizeof(float) * narrow);
+    }
+    float* packed = (float*)realloc(lm->dist, sizeof(float) * (size_t)V * narrow);
+    if (packed) lm->dist = packed;
+
+    /* Two stored values per bound, each off by at most half an ulp */
+    lm->slack = max_d * ldexp(1.0, -22);
+
+    builder_free(&b);
+    free(size);
+    free(child_offsets);
+    free(children);
+    return 0;
+}
+
+/* ---------------- file I/O ---------------- */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t num_nodes;
+    int32_t num_edges;
+    int32_t count;
+    int32_t reserved;
+    double slack;
+    uint64_t checksum;      /* edge_list_checksum of the graph */
+} AltFileHeader;
+
+int alt_save(const Landmarks* lm, const char* path)
+{
+    if (!lm || !path) return 10;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "ERROR: failed to open landmark file for writing: %s\n", path);
+        return 20;
+    }
+
+    AltFileHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = ALT_FILE_MAGIC;
+    h.version = ALT_FILE_VERSION;
+    h.num_nodes = lm->num_nodes;
+    h.num_edges = lm->num_edges;
+    h.count = lm->count;
+    h.slack = lm->slack;
+    h.checksum = lm->checksum;
+
+    size_t n = (size_t)lm->num_nodes * 2 * (size_t)lm->count;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(lm->nodes, sizeof(int), (size_t)lm->count, f) == (size_t)lm->count &&
+             fwrite(lm->dist, sizeof(float), n, f) == n;
+
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "ERROR: failed to write landmark file: %s\n", path);
+        return 21;
+    }
+    return 0;
+}
+
+int alt_load(Landmarks* lm, const Graph* g, const char* path)
+{
+    if (!lm || !g || !path) return 10;
+    memset(lm, 0, sizeof(*lm));
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        /* A missing file is the normal first start: the caller builds one */
+        if (errno != ENOENT) {
+            fprintf(stderr, "ERROR: failed to open landmark file: %s\n", path);
+        }
+        return 20;
+    }
+
+    AltFileHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        h.magic != ALT_FILE_MAGIC || h.version != ALT_FILE_VERSION) {
+        fprintf(stderr, "ERROR: not a landmark file (or wrong version): %s\n", path);
+        fclose(f);
+        return 22;
+    }
+
+    if (h.num_nodes != g->num_nodes || h.num_edges != g->num_edges ||
+        h.checksum != edge_list_checksum(g) ||
+        h.count <= 0 || h.count > h.num_nodes || !(h.slack >= 0.0)) {
+        fprintf(stderr, "ERROR: landmark file does not match the loaded graph: %s\n", path);
+        fclose(f);
+        return 23;
+    }
+
+    lm->num_nodes = h.num_nodes;
+    lm->num_edges = h.num_edges;
+    lm->count = h.count;
+    lm->slack = h.slack;
+    lm->checksum = h.checksum;
+    size_t n = (size_t)h.num_nodes * 2 * (size_t)h.count;
+    lm->nodes = (int*)malloc(sizeof(int) * (size_t)h.count);
+    lm->dist = (float*)malloc(sizeof(float) * n);
+    if (!lm->nodes || !lm->dist) {
+        fclose(f);
+        alt_free(lm);
+        return 12;
+    }
+
+    int ok = fread(lm->nodes, sizeof(int), (size_t)h.count, f) == (size_t)h.count &&
+             fread(lm->dist, sizeof(float), n, f) == n;
+    fclose(f);
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: truncated landmark file: %s\n", path);
+        alt_free(lm);
+        return 24;
+    }
+
+    for (int i = 0; i < h.count && ok; i++) {
+        ok = lm->nodes[i] >= 0 && lm->nodes[i] < h.num_nodes;
+    }
+    for (size_t i = 0; i < n && ok; i++) {
+        ok = lm->dist[i] >= 0.0f; /* also rejects NaN */
+    }
+    if (!ok) {
+        fprintf(stderr, "ERROR: corrupt landmark file: %s\n", path);
+        alt_free(lm);
+        return 25;
+    }
+    return 0;
+}
+
+void alt_free(Landmarks* lm)
+{
+    if (!lm) return;
+    free(lm->nodes);
+    free(lm->dist);
+    memset(lm, 0, sizeof(*lm));
+}
+
+/* ---------------- query ---------------- */
+
+double alt_lower_bound(const Landmarks* lm, const GraphStats* stats, int from, int to)
+{
+    double bound = free_flow_bound(lm, lm->count, from, to) - lm->slack;
+    if (bound <= 0.0) return 0.0;
+    return bound * stats->min_time_ratio;
+}
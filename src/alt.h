@@ -0,0 +1,65 @@
+#ifndef ALT_H
+#define ALT_H
+
+#include <stdint.h>
+
+#include "graph.h"
+
+/* Landmarks used when the server has to pick them itself */
+#ifndef ALT_DEFAULT_LANDMARKS
+#define ALT_DEFAULT_LANDMARKS 8
+#endif
+
+/* How alt_build picks landmarks */
+typedef enum {
+    ALT_SELECT_FARTHEST = 0,    /* each one farthest from those already chosen */
+    ALT_SELECT_AVOID    = 1     /* leaf of the shortest-path tree region the
+                                   current landmarks cover worst */
+} AltSelection;
+
+/*
+ * Landmark distances for ALT (A*, landmarks, triangle inequality) lower
+ * bounds. Distances are free-flow travel times (base_length /
+ * base_speed_limit), so they stay valid whatever traffic does and can be
+ * persisted with the graph.
+ *
+ * Storage is node-major so one lookup touches one cache line:
+ *   dist[v * 2 * count + 2 * k]     = d(landmark k -> v)
+ *   dist[v * 2 * count + 2 * k + 1] = d(v -> landmark k)
+ * Unreachable pairs hold INFINITY.
+ */
+typedef struct Landmarks {
+    int num_nodes;
+    int num_edges;          /* edge count of the graph it was built for */
+    uint64_t checksum;      /* and a checksum of its edge list */
+    int count;
+    int* nodes;             /* landmark node ids */
+    float* dist;
+    double slack;           /* float rounding allowance subtracted from bounds */
+} Landmarks;
+
+/**
+ * Selects count landmarks and runs a forward and a backward Dijkstra from
+ * each. Returns 0 on success, non-zero on error.
+ */
+int alt_build(Landmarks* lm, const Graph* g, int count, AltSelection selection);
+
+/* Binary file I/O. Load checks the file matches g (sizes and an edge list
+   checksum) and returns 20 quietly if the file does not exist. 0 on
+   success. */
+int alt_save(const Landmarks* lm, const char* path);
+int alt_load(Landmarks* lm, const Graph* g, const char* path);
+
+void alt_free(Landmarks* lm);
+
+/**
+ * Lower bound on the current travel time from -> to. The free-flow bound
+ * is scaled by stats->min_time_ratio (the graph's, or a weight snapshot's),
+ * which keeps it consistent even when traffic reports edges faster than
+ * their speed limit. Reports are clamped (TRAFFIC_SPEED_FACTOR_MAX), so
+ * the ratio never drops below 1 / that factor. Once the stats are rebuilt
+ * over the current weights (graph_compute_stats), the ratio climbs back.
+ */
+double alt_lower_bound(const Landmarks* lm, const GraphStats* stats, int from, int to);
+
+#endif
@@ -0,0 +1,759 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+
+#include "cch.h"
+
+/* Parts at or below this size are not dissected further */
+#define CCH_ND_LEAF_SIZE 4
+
+/* ---------------- ordering ---------------- */
+
+typedef struct {
+    double key;
+    int node;
+} NodeKey;
+
+static int cmp_node_key(const void* a, const void* b)
+{
+    const NodeKey* x = (const NodeKey*)a;
+    const NodeKey* y = (const NodeKey*)b;
+    if (x->key < y->key) return -1;
+    if (x->key > y->key) return 1;
+    return x->node - y->node;
+}
+
+typedef struct {
+    const Graph* g;
+    int* side;              /* part stamp per node, see nd_order */
+    int next_stamp;
+    NodeKey* keys;          /* scratch for sorting, num_nodes long */
+    int* node_of;           /* output order */
+    int next_rank;
+} NDState;
+
+static int nd_has_neighbor_with(const NDState* st, int v, int stamp)
+{
+    const Graph* g = st->g;
+    for (int i = g->out_offsets[v]; i < g->out_offsets[v + 1]; i++) {
+        if (st->side[g->out_targets[i]] == stamp) return 1;
+    }
+    for (int i = g->in_offsets[v]; i < g->in_offsets[v + 1]; i++) {
+        if (st->side[g->in_sources[i]] == stamp) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Nested dissection by recursive coordinate bisection. The part is split
+ * at the median of its wider axis; the boundary nodes of the smaller
+ * boundary become the separator and are ranked after both halves, so
+ * contraction never creates fill between the halves. nodes[] is permuted
+ * in place.
+ */
+static void nd_order(NDState* st, int* nodes, int n)
+{
+    if (n <= CCH_ND_LEAF_SIZE) {
+        for (int i = 0; i < n; i++) st->node_of[st->next_rank++] = nodes[i];
+        return;
+    }
+
+    const Node* pts = st->g->nodes;
+    double min_x = pts[nodes[0]].x, max_x = min_x;
+    double min_y = pts[nodes[0]].y, max_y = min_y;
+    for (int i = 1; i < n; i++) {
+        const Node* p = &pts[nodes[i]];
+        if (p->x < min_x) min_x = p->x;
+        if (p->x > max_x) max_x = p->x;
+        if (p->y < min_y) min_y = p->y;
+        if (p->y > max_y) max_y = p->y;
+    }
+    int use_x = (max_x - min_x) >= (max_y - min_y);
+
+    NodeKey* keys = st->keys;
+    for (int i = 0; i < n; i++) {
+        keys[i].key = use_x ? pts[nodes[i]].x : pts[nodes[i]].y;
+        keys[i].node = nodes[i];
+    }
+    qsort(keys, (size_t)n, sizeof(NodeKey), cmp_node_key);
+
+    int half = n / 2;
+    int stamp_a = st->next_stamp++;
+    int stamp_b = st->next_stamp++;
+    for (int i = 0; i < n; i++) {
+        nodes[i] = keys[i].node;
+        st->side[nodes[i]] = i < half ? stamp_a : stamp_b;
+    }
+
+    /* Count both boundaries and keep the smaller one as separator */
+    int bound_a = 0, bound_b = 0;
+    for (int i = 0; i < n; i++) {
+        int v = nodes[i];
+        if (i < half) bound_a += nd_has_neighbor_with(st, v, stamp_b);
+        else          bound_b += nd_has_neighbor_with(st, v, stamp_a);
+    }
+    int sep_in_a = bound_a <= bound_b;
+    int sep_stamp = st->next_stamp++;
+    int lo = sep_in_a ? 0 : half;
+    int hi = sep_in_a ? half : n;
+    int other = sep_in_a ? stamp_b : stamp_a;
+    for (int i = lo; i < hi; i++) {
+        if (nd_has_neighbor_with(st, nodes[i], other)) st->side[nodes[i]] = sep_stamp;
+    }
+
+    /* Stable partition into [rest of A][rest of B][separator] */
+    int w = 0, s = 0;
+    int* sep = (int*)keys;  /* keys are consumed; reuse as int scratch */
+    for (int i = 0; i < n; i++) {
+        if (st->side[nodes[i]] == sep_stamp) sep[s++] = nodes[i];
+        else nodes[w++] = nodes[i];
+    }
+    memcpy(nodes + w, sep, sizeof(int) * (size_t)s);
+
+    int n_a = 0;
+    while (n_a < w && st->side[nodes[n_a]] == stamp_a) n_a++;
+
+    nd_order(st, nodes, n_a);
+    nd_order(st, nodes + n_a, w - n_a);
+    for (int i = 0; i < s; i++) st->node_of[st->next_rank++] = nodes[w + i];
+}
+
+struct CCHPool;
+static struct CCHPool* pool_start(CustomizableCH* cch, int threads);
+static void pool_stop(struct CCHPool* pool);
+
+/* ---------------- chordal completion ---------------- */
+
+typedef struct {
+    int* data;
+    int len;
+    int cap;
+} IntVec;
+
+static int vec_push(IntVec* v, int x)
+{
+    if (v->len == v->cap) {
+        int cap = v->cap ? v->cap * 2 : 4;
+        int* grown = (int*)realloc(v->data, sizeof(int) * (size_t)cap);
+        if (!grown) return 1;
+        v->data = grown;
+        v->cap = cap;
+    }
+    v->data[v->len++] = x;
+    return 0;
+}
+
+static int cmp_int(const void* a, const void* b)
+{
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static void vec_sort_unique(IntVec* v)
+{
+    if (v->len < 2) return;
+    qsort(v->data, (size_t)v->len, sizeof(int), cmp_int);
+    int w = 1;
+    for (int i = 1; i < v->len; i++) {
+        if (v->data[i] != v->data[w - 1]) v->data[w++] = v->data[i];
+    }
+    v->len = w;
+}
+
+static void free_vecs(IntVec* vecs, int n)
+{
+    if (!vecs) return;
+    for (int i = 0; i < n; i++) free(vecs[i].data);
+    free(vecs);
+}
+
+/* Arc id of (lo, hi) with lo < hi, or -1 if absent */
+static int find_arc(const CustomizableCH* cch, int lo, int hi)
+{
+    int a = cch->up_offsets[lo];
+    int b = cch->up_offsets[lo + 1] - 1;
+    while (a <= b) {
+        int m = a + (b - a) / 2;
+        int h = cch->up_heads[m];
+        if (h == hi) return m;
+        if (h < hi) a = m + 1;
+        else b = m - 1;
+    }
+    return -1;
+}
+
+static int alloc_metric(CCHMetric* m, int num_arcs)
+{
+    size_t n = num_arcs > 0 ? (size_t)num_arcs : 1;
+    m->fwd = (double*)malloc(sizeof(double) * n);
+    m->bwd = (double*)malloc(sizeof(double) * n);
+    m->fwd_mid = (int*)malloc(sizeof(int) * n);
+    m->bwd_mid = (int*)malloc(sizeof(int) * n);
+    return !m->fwd || !m->bwd || !m->fwd_mid || !m->bwd_mid;
+}
+
+static void free_metric(CCHMetric* m)
+{
+    free(m->fwd);
+    free(m->bwd);
+    free(m->fwd_mid);
+    free(m->bwd_mid);
+}
+
+int cch_build(CustomizableCH* cch, const Graph* g, int customize_threads)
+{
+    if (!cch || !g) return 10;
+
+    memset(cch, 0, sizeof(*cch));
+    int V = g->num_nodes;
+    cch->num_nodes = V;
+    cch->num_edges = g->num_edges;
+    cch->customize_threads = customize_threads > 0 ? customize_threads : CCH_CUSTOMIZE_THREADS;
+    pthread_mutex_init(&cch->customize_mu, NULL);
+
+    cch->rank = (int*)malloc(sizeof(int) * (size_t)V);
+    cch->node_of = (int*)malloc(sizeof(int) * (size_t)V);
+    cch->etree_parent = (int*)malloc(sizeof(int) * (size_t)V);
+    cch->up_offsets = (int*)calloc((size_t)V + 1, sizeof(int));
+    cch->down_offsets = (int*)calloc((size_t)V + 1, sizeof(int));
+    cch->edge_arc = (int*)malloc(sizeof(int) * (size_t)(g->num_edges > 0 ? g->num_edges : 1));
+
+    NDState nd;
+    memset(&nd, 0, sizeof(nd));
+    nd.g = g;
+    nd.side = (int*)calloc((size_t)V, sizeof(int));
+    nd.keys = (NodeKey*)malloc(sizeof(NodeKey) * (size_t)(V > 0 ? V : 1));
+    nd.node_of = cch->node_of;
+    nd.next_stamp = 1;
+    int* nodes = (int*)malloc(sizeof(int) * (size_t)(V > 0 ? V : 1));
+    IntVec* up = (IntVec*)calloc((size_t)V, sizeof(IntVec));
+
+    if (!cch->rank || !cch->node_of || !cch->etree_parent || !cch->up_offsets ||
+        !cch->down_offsets || !cch->edge_arc || !nd.side || !nd.keys || !nodes || !up) {
+        free(nd.side);
+        free(nd.keys);
+        free(nodes);
+        free_vecs(up, V);
+        cch_free(cch);
+        return 12;
+    }
+
+    for (int v = 0; v < V; v++) nodes[v] = v;
+    nd_order(&nd, nodes, V);
+    free(nd.side);
+    free(nd.keys);
+    free(nodes);
+    for (int r = 0; r < V; r++) cch->rank[cch->node_of[r]] = r;
+
+    /* Undirected upward neighbors in rank space */
+    int oom = 0;
+    for (int u = 0; u < V && !oom; u++) {
+        int ru = cch->rank[u];
+        for (int i = g->out_offsets[u]; i < g->out_offsets[u + 1]; i++) {
+            int rv = cch->rank[g->out_targets[i]];
+            if (rv == ru) continue;
+            if (rv > ru) oom |= vec_push(&up[ru], rv);
+            else         oom |= vec_push(&up[rv], ru);
+        }
+    }
+
+    /* Eliminate in rank order: a node's upper neighbors become a clique,
+       which it suffices to record at the lowest of them (the parent in
+       the elimination tree) */
+    for (int r = 0; r < V && !oom; r++) {
+        vec_sort_unique(&up[r]);
+        if (up[r].len == 0) {
+            cch->etree_parent[r] = -1;
+            continue;
+        }
+        int p = up[r].data[0];
+        cch->etree_parent[r] = p;
+        for (int i = 1; i < up[r].len && !oom; i++) oom |= vec_push(&up[p], up[r].data[i]);
+    }
+
+    long long total = 0;
+    for (int r = 0; r < V && !oom; r++) {
+        total += up[r].len;
+        if (total > GRAPH_MAX_COUNT) oom = 1;
+    }
+    if (oom) {
+        free_vecs(up, V);
+        cch_free(cch);
+        return 12;
+    }
+
+    int A = (int)total;
+    cch->num_arcs = A;
+    size_t na = A > 0 ? (size_t)A : 1;
+    cch->up_heads = (int*)malloc(sizeof(int) * na);
+    cch->arc_tail = (int*)malloc(sizeof(int) * na);
+    cch->down_tails = (int*)malloc(sizeof(int) * na);
+    cch->down_arcs = (int*)malloc(sizeof(int) * na);
+    int* level = (int*)calloc((size_t)V, sizeof(int));
+    int* cursor = (int*)malloc(sizeof(int) * (size_t)(V > 0 ? V : 1));
+    if (!cch->up_heads || !cch->arc_tail || !cch->down_tails || !cch->down_arcs ||
+        !level || !cursor || alloc_metric(&cch->metrics[0], A) ||
+        alloc_metric(&cch->metrics[1], A)) {
+        free(level);
+        free(cursor);
+        free_vecs(up, V);
+        cch_free(cch);
+        return 12;
+    }
+
+    for (int r = 0; r < V; r++) {
+        cch->up_offsets[r + 1] = cch->up_offsets[r] + up[r].len;
+        memcpy(cch->up_heads + cch->up_offsets[r], up[r].data, sizeof(int) * (size_t)up[r].len);
+        for (int i = cch->up_offsets[r]; i < cch->up_offsets[r + 1]; i++) {
+            cch->arc_tail[i] = r;
+            cch->down_offsets[cch->up_heads[i] + 1]++;
+        }
+    }
+    free_vecs(up, V);
+
+    /* Down lists come out sorted by tail since tails are visited in order */
+    for (int r = 0; r < V; r++) cch->down_offsets[r + 1] += cch->down_offsets[r];
+    memcpy(cursor, cch->down_offsets, sizeof(int) * (size_t)V);
+    for (int i = 0; i < A; i++) {
+        int pos = cursor[cch->up_heads[i]]++;
+        cch->down_tails[pos] = cch->arc_tail[i];
+        cch->down_arcs[pos] = i;
+    }
+
+    /* A rank only reads arcs of lower neighbors, so ranks one level above
+       everything below them can be customized in parallel */
+    int num_levels = 0;
+    for (int r = 0; r < V; r++) {
+        for (int i = cch->down_offsets[r]; i < cch->down_offsets[r + 1]; i++) {
+            int l = level[cch->down_tails[i]] + 1;
+            if (l > level[r]) level[r] = l;
+        }
+        if (level[r] + 1 > num_levels) num_levels = level[r] + 1;
+    }
+    cch->num_levels = num_levels;
+    cch->level_offsets = (int*)calloc((size_t)num_levels + 1, sizeof(int));
+    cch->level_ranks = (int*)malloc(sizeof(int) * (size_t)(V > 0 ? V : 1));
+    if (!cch->level_offsets || !cch->level_ranks) {
+        free(level);
+        free(cursor);
+        cch_free(cch);
+        return 12;
+    }
+    for (int r = 0; r < V; r++) cch->level_offsets[level[r] + 1]++;
+    for (int l = 0; l < num_levels; l++) cch->level_offsets[l + 1] += cch->level_offsets[l];
+    memcpy(cursor, cch->level_offsets, sizeof(int) * (size_t)num_levels);
+    for (int r = 0; r < V; r++) cch->level_ranks[cursor[level[r]]++] = r;
+    free(level);
+    free(cursor);
+
+    for (int eid = 0; eid < g->num_edges; eid++) {
+        int ru = cch->rank[g->edges[eid].from_node];
+        int rv = cch->rank[g->edges[eid].to_node];
+        if (ru == rv) {
+            cch->edge_arc[eid] = -1;
+            continue;
+        }
+        int a = ru < rv ? find_arc(cch, ru, rv) : find_arc(cch, rv, ru);
+        cch->edge_arc[eid] = a * 2 + (ru < rv ? 0 : 1);
+    }
+
+    atomic_init(&cch->current, 1);
+    atomic_init(&cch->readers[0], 0);
+    atomic_init(&cch->readers[1], 0);
+    atomic_init(&cch->epoch, 0);
+
+    cch->pool = pool_start(cch, cch->customize_threads);
+
+    cch_customize_begin(cch, g, g->out_weights);
+    cch_customize_finish(cch);
+    return 0;
+}
+
+void cch_free(CustomizableCH* cch)
+{
+    if (!cch) return;
+    pool_stop(cch->pool);
+    free(cch->rank);
+    free(cch->node_of);
+    free(cch->etree_parent);
+    free(cch->up_offsets);
+    free(cch->up_heads);
+    free(cch->arc_tail);
+    free(cch->down_offsets);
+    free(cch->down_tails);
+    free(cch->down_arcs);
+    free(cch->level_offsets);
+    free(cch->level_ranks);
+    free(cch->edge_arc);
+    free_metric(&cch->metrics[0]);
+    free_metric(&cch->metrics[1]);
+    pthread_mutex_destroy(&cch->customize_mu);
+    memset(cch, 0, sizeof(*cch));
+}
+
+/* ---------------- customization ---------------- */
+
+static CCHMetric* back_metric(CustomizableCH* cch)
+{
+    return &cch->metrics[1 - atomic_load(&cch->current)];
+}
+
+void cch_customize_begin(CustomizableCH* cch, const Graph* g, const double* weights)
+{
+    pthread_mutex_lock(&cch->customize_mu);
+
+    int back = 1 - atomic_load(&cch->current);
+    while (atomic_load(&cch->readers[back]) != 0) sched_yield();
+
+    CCHMetric* m = &cch->metrics[back];
+    for (int i = 0; i < cch->num_arcs; i++) {
+        m->fwd[i] = INFINITY;
+        m->bwd[i] = INFINITY;
+        m->fwd_mid[i] = -1;
+        m->bwd_mid[i] = -1;
+    }
+
+    /* Parallel edges keep the cheapest */
+    for (int eid = 0; eid < cch->num_edges; eid++) {
+        int ea = cch->edge_arc[eid];
+        if (ea < 0) continue;
+        int a = ea >> 1;
+        double w = weights[g->edge_slot[eid]];
+        if ((ea & 1) == 0) {
+            if (w < m->fwd[a]) { m->fwd[a] = w; m->fwd_mid[a] = -2 - eid; }
+        } else {
+            if (w < m->bwd[a]) { m->bwd[a] = w; m->bwd_mid[a] = -2 - eid; }
+        }
+    }
+}
+
+/* Relax every lower triangle of the arcs leaving rank u */
+static void customize_rank(const CustomizableCH* cch, CCHMetric* m, int u)
+{
+    const int u_begin = cch->down_offsets[u];
+    const int u_end = cch->down_offsets[u + 1];
+
+    for (int a = cch->up_offsets[u]; a < cch->up_offsets[u + 1]; a++) {
+        int v = cch->up_heads[a];
+        double fwd = m->fwd[a], bwd = m->bwd[a];
+        int fwd_mid = m->fwd_mid[a], bwd_mid = m->bwd_mid[a];
+
+        /* Lower common neighbors x: merge the sorted down lists */
+        int i = u_begin, j = cch->down_offsets[v];
+        const int j_end = cch->down_offsets[v + 1];
+        while (i < u_end && j < j_end) {
+            int xu = cch->down_tails[i], xv = cch->down_tails[j];
+            if (xu < xv) { i++; continue; }
+            if (xv < xu) { j++; continue; }
+
+            int a_xu = cch->down_arcs[i], a_xv = cch->down_arcs[j];
+            double c = m->bwd[a_xu] + m->fwd[a_xv];    /* u -> x -> v */
+            if (c < fwd) { fwd = c; fwd_mid = xu; }
+            c = m->bwd[a_xv] + m->fwd[a_xu];           /* v -> x -> u */
+            if (c < bwd) { bwd = c; bwd_mid = xu; }
+            i++;
+            j++;
+        }
+
+        m->fwd[a] = fwd;
+        m->bwd[a] = bwd;
+        m->fwd_mid[a] = fwd_mid;
+        m->bwd_mid[a] = bwd_mid;
+    }
+}
+
+/*
+ * Helper threads for customization live as long as the hierarchy. Each
+ * job runs every level; a barrier separates the levels.
+ */
+struct CCHPool {
+    CustomizableCH* cch;
+    pthread_t* threads;
+    int size;               /* helpers, the customizing thread comes on top */
+    pthread_mutex_t mu;
+    pthread_cond_t job_cv;
+    pthread_cond_t done_cv;
+    unsigned job;
+    int done;
+    int stop;
+    CCHMetric* metric;
+    pthread_barrier_t barrier;
+};
+
+typedef struct {
+    struct CCHPool* pool;
+    int index;
+} PoolSlot;
+
+static void run_levels(struct CCHPool* pool, int index)
+{
+    const CustomizableCH* cch = pool->cch;
+    int count = pool->size + 1;
+
+    for (int l = 0; l < cch->num_levels; l++) {
+        int begin = cch->level_offsets[l];
+        int n = cch->level_offsets[l + 1] - begin;
+        int lo = begin + (int)((long long)n * index / count);
+        int hi = begin + (int)((long long)n * (index + 1) / count);
+        for (int k = lo; k < hi; k++) customize_rank(cch, pool->metric, cch->level_ranks[k]);
+        pthread_barrier_wait(&pool->barrier);
+    }
+}
+
+static void* pool_main(void* arg)
+{
+    PoolSlot* slot = (PoolSlot*)arg;
+    struct CCHPool* pool = slot->pool;
+    int index = slot->index;
+    free(slot);
+
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->mu);
+    while (1) {
+        while (pool->job == seen && !pool->stop) pthread_cond_wait(&pool->job_cv, &pool->mu);
+        if (pool->stop) break;
+        seen = pool->job;
+        pthread_mutex_unlock(&pool->mu);
+
+        run_levels(pool, index);
+
+        pthread_mutex_lock(&pool->mu);
+        pool->done++;
+        pthread_cond_signal(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->mu);
+    return NULL;
+}
+
+/* Starts up to threads - 1 helpers; fewer is fine, the barrier is sized
+   to whatever started. Returns NULL only if no pool could be set up. */
+static struct CCHPool* pool_start(CustomizableCH* cch, int threads)
+{
+    if (threads < 2) return NULL;
+
+    struct CCHPool* pool = (struct CCHPool*)calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+    pool->cch = cch;
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * (size_t)(threads - 1));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mu, NULL);
+    pthread_cond_init(&pool->job_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    for (int t = 1; t < threads; t++) {
+        PoolSlot* slot = (PoolSlot*)malloc(sizeof(PoolSlot));
+        if (!slot) break;
+        slot->pool = pool;
+        slot->index = t;
+        if (pthread_create(&pool->threads[pool->size], NULL, pool_main, slot) != 0) {
+            free(slot);
+            break;
+        }
+        pool->size++;
+    }
+    if (pool->size + 1 < threads) {
+        fprintf(stderr, "cch: started %d of %d customization threads\n", pool->size + 1, threads);
+    }
+    pthread_barrier_init(&pool->barrier, NULL, (unsigned)(pool->size + 1));
+    return pool;
+}
+
+static void pool_stop(struct CCHPool* pool)
+{
+    if (!pool) return;
+    pthread_mutex_lock(&pool->mu);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->job_cv);
+    pthread_mutex_unlock(&pool->mu);
+    for (int t = 0; t < pool->size; t++) pthread_join(pool->threads[t], NULL);
+
+    pthread_barrier_destroy(&pool->barrier);
+    pthread_cond_destroy(&pool->done_cv);
+    pthread_cond_destroy(&pool->job_cv);
+    pthread_mutex_destroy(&pool->mu);
+    free(pool->threads);
+    free(pool);
+}
+
+void cch_customize_finish(CustomizableCH* cch)
+{
+    CCHMetric* m = back_metric(cch);
+    struct CCHPool* pool = cch->pool;
+
+    if (pool && pool->size > 0) {
+        pthread_mutex_lock(&pool->mu);
+        pool->metric = m;
+        pool->done = 0;
+        pool->job++;
+        pthread_cond_broadcast(&pool->job_cv);
+        pthread_mutex_unlock(&pool->mu);
+
+        run_levels(pool, 0);
+
+        pthread_mutex_lock(&pool->mu);
+        while (pool->done < pool->size) pthread_cond_wait(&pool->done_cv, &pool->mu);
+        pthread_mutex_unlock(&pool->mu);
+    } else {
+        for (int l = 0; l < cch->num_levels; l++) {
+            for (int k = cch->level_offsets[l]; k < cch->level_offsets[l + 1]; k++) {
+                customize_rank(cch, m, cch->level_ranks[k]);
+            }
+        }
+    }
+
+    atomic_store(&cch->current, 1 - atomic_load(&cch->current));
+    atomic_fetch_add(&cch->epoch, 1);
+    pthread_mutex_unlock(&cch->customize_mu);
+}
+
+/* ---------------- query ---------------- */
+
+/* Append the original edges behind arc a traversed upward (dir 0) or
+   downward (dir 1), recursing through lower triangles */
+static int unpack_arc(const CustomizableCH* cch, const CCHMetric* m,
+                      RouteWorkspace* ws, int a, int dir)
+{
+    int mid = dir == 0 ? m->fwd_mid[a] : m->bwd_mid[a];
+    if (mid <= -2) {
+        int rc = routing_workspace_reserve_path(ws, ws->path_len + 1);
+        if (rc != 0) return rc;
+        ws->path_edges[ws->path_len++] = -2 - mid;
+        return 0;
+    }
+    if (mid < 0) return 1; /* infinite arc, cannot be on a found path */
+
+    int lo = cch->arc_tail[a], hi = cch->up_heads[a];
+    int from = dir == 0 ? lo : hi;
+    int to = dir == 0 ? hi : lo;
+
+    /* from -> mid goes down arc (mid, from), mid -> to goes up arc (mid, to) */
+    int rc = unpack_arc(cch, m, ws, find_arc(cch, mid, from), 1);
+    if (rc != 0) return rc;
+    return unpack_arc(cch, m, ws, find_arc(cch, mid, to), 0);
+}
+
+/* Unpack the forward up-path from rank rs to rank r in order */
+static int unpack_forward(const CustomizableCH* cch, const CCHMetric* m,
+                          RouteWorkspace* ws, int rs, int r)
+{
+    if (r == rs) return 0;
+    int a = ws->fwd.parent_slot[r];
+    int rc = unpack_forward(cch, m, ws, rs, cch->arc_tail[a]);
+    if (rc != 0) return rc;
+    return unpack_arc(cch, m, ws, a, 0);
+}
+
+/* Relax the arcs above rank r for one side of the query, unless r is
+   unreached or already no better than the best meeting cost */
+static void scan_rank(const CustomizableCH* cch, const double* w, SearchSpace* sp,
+                      unsigned int gen, int r, double best)
+{
+    if (sp->seen[r] != gen) return;
+    double d = sp->g_score[r];
+    if (d >= best) return;
+    for (int a = cch->up_offsets[r]; a < cch->up_offsets[r + 1]; a++) {
+        int h = cch->up_heads[a];
+        double nd = d + w[a];
+        if (sp->seen[h] != gen || nd < sp->g_score[h]) {
+            sp->seen[h] = gen;
+            sp->g_score[h] = nd;
+            sp->parent_slot[h] = a;
+        }
+    }
+}
+
+int cch_query(CustomizableCH* cch,
+              const Graph* g,
+              RouteWorkspace* ws,
+              int start_id,
+              int target_id)
+{
+    if (!cch || !g || !ws) return 10;
+
+    if (start_id < 0 || start_id >= cch->num_nodes ||
+        target_id < 0 || target_id >= cch->num_nodes ||
+        ws->num_nodes != cch->num_nodes) {
+        return 11;
+    }
+
+    int rc = routing_workspace_ensure_backward(ws);
+    if (rc != 0) return rc;
+
+    routing_workspace_begin(ws);
+
+    /* Pin the published metric; a customization swapping buffers in the
+       meantime will not overwrite this one until it is released */
+    int idx;
+    while (1) {
+        idx = atomic_load(&cch->current);
+        atomic_fetch_add(&cch->readers[idx], 1);
+        if (atomic_load(&cch->current) == idx) break;
+        atomic_fetch_sub(&cch->readers[idx], 1);
+    }
+    const CCHMetric* m = &cch->metrics[idx];
+
+    const unsigned int gen = ws->generation;
+    int rs = cch->rank[start_id], rt = cch->rank[target_id];
+    ws->fwd.seen[rs] = gen;
+    ws->fwd.g_score[rs] = 0.0;
+    ws->bwd.seen[rt] = gen;
+    ws->bwd.g_score[rt] = 0.0;
+
+    /* Every search-space node is an elimination-tree ancestor of its root,
+       so both sides just walk up their ancestor chains in rank order; the
+       chains share everything from the lowest common ancestor upward */
+    double best = INFINITY;
+    int meet = -1;
+    int x = rs, y = rt;
+    while (x >= 0 || y >= 0) {
+        if (y < 0 || (x >= 0 && x < y)) {
+            scan_rank(cch, m->fwd, &ws->fwd, gen, x, best);
+            x = cch->etree_parent[x];
+        } else if (x < 0 || y < x) {
+            scan_rank(cch, m->bwd, &ws->bwd, gen, y, best);
+            y = cch->etree_parent[y];
+        } else {
+            if (ws->fwd.seen[x] == gen && ws->bwd.seen[x] == gen &&
+                ws->fwd.g_score[x] + ws->bwd.g_score[x] < best) {
+                best = ws->fwd.g_score[x] + ws->bwd.g_score[x];
+                meet = x;
+            }
+            scan_rank(cch, m->fwd, &ws->fwd, gen, x, best);
+            scan_rank(cch, m->bwd, &ws->bwd, gen, x, best);
+            x = y = cch->etree_parent[x];
+            ws->settled++;
+        }
+        ws->settled++;
+    }
+
+    if (meet < 0 || best == INFINITY) {
+        atomic_fetch_sub(&cch->readers[idx], 1);
+        return 1; /* no path */
+    }
+
+    /* start -> meet over forward parents, then meet -> target */
+    rc = unpack_forward(cch, m, ws, rs, meet);
+    for (int r = meet; rc == 0 && r != rt; ) {
+        int a = ws->bwd.parent_slot[r];
+        rc = unpack_arc(cch, m, ws, a, 1);
+        r = cch->arc_tail[a];
+    }
+    atomic_fetch_sub(&cch->readers[idx], 1);
+    if (rc != 0) return rc;
+
+    /* Report the ETA under the workspace's weights; the metric may be up
+       to one customization interval old */
+    const double* weights = routing_weights(g, ws);
+    double cost = 0.0;
+    for (int i = 0; i < ws->path_len; i++) {
+        cost += weights[g->edge_slot[ws->path_edges[i]]];
+    }
+    ws->path_cost = cost;
+    return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef CCH_H
+#define CCH_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "graph.h"
+#include "routing.h"
+
+/* Threads used by the customization phase unless overridden */
+#ifndef CCH_CUSTOMIZE_THREADS
+#define CCH_CUSTOMIZE_THREADS 4
+#endif
+
+/*
+ * Weights of every CCH arc in both directions. For arc i between ranks
+ * lo < hi: fwd[i] is lo -> hi, bwd[i] is hi -> lo. The *_mid arrays say
+ * how that weight is realized:
+ *   >= 0  shortcut over the lower triangle through that middle rank
+ *   -1    no path (weight is infinite)
+ *   <= -2 original edge with edge_id = -2 - mid
+ */
+typedef struct {
+    double* fwd;
+    double* bwd;
+    int* fwd_mid;
+    int* bwd_mid;
+} CCHMetric;
+
+/*
+ * Customizable contraction hierarchy. The node order and the chordal
+ * arc set depend only on topology and are computed once by cch_build.
+ * Edge weights are applied later by customization, which fills the back
+ * metric and publishes it; queries always use the latest published one.
+ * All node-indexed arrays below are in rank space.
+ */
+typedef struct {
+    int num_nodes;
+    int num_edges;
+    int num_arcs;
+
+    int* rank;              /* node_id -> rank */
+    int* node_of;           /* rank -> node_id */
+    int* etree_parent;      /* lowest upper neighbor, -1 at a root */
+
+    /* Upward arcs: arc i goes from arc_tail[i] to up_heads[i], sorted by head */
+    int* up_offsets;
+    int* up_heads;
+    int* arc_tail;
+
+    /* Downward view: lower neighbors of each rank, sorted, with arc ids */
+    int* down_offsets;
+    int* down_tails;
+    int* down_arcs;
+
+    /* Customization schedule: ranks grouped by elimination level */
+    int num_levels;
+    int* level_offsets;
+    int* level_ranks;
+
+    int* edge_arc;          /* edge_id -> arc*2 + (0 = lo->hi, 1 = hi->lo), -1 for loops */
+
+    CCHMetric metrics[2];
+    atomic_int current;     /* index of the published metric */
+    atomic_int readers[2];  /* queries currently using each metric */
+    atomic_ulong epoch;     /* number of customizations published */
+    pthread_mutex_t customize_mu;
+    int customize_threads;  /* includes the customizing thread itself */
+    struct CCHPool* pool;   /* helper threads, NULL when single-threaded */
+} CustomizableCH;
+
+/**
+ * Computes a nested-dissection order from node coordinates, the chordal
+ * completion and the customization schedule, starts the customization
+ * threads (customize_threads <= 0 selects CCH_CUSTOMIZE_THREADS), then
+ * customizes once with g's current weights. 0 on success.
+ */
+int cch_build(CustomizableCH* cch, const Graph* g, int customize_threads);
+void cch_free(CustomizableCH* cch);
+
+/**
+ * Customization in two phases so callers can hold a lock on the weights
+ * only while they are read:
+ *  - begin: waits until no query uses the back metric, then seeds it with
+ *           weights (travel time per CSR slot of g, e.g. g->out_weights or
+ *           a published snapshot)
+ *  - finish: relaxes lower triangles level by level in parallel and
+ *            publishes the back metric
+ * Only one customization runs at a time (begin locks, finish unlocks).
+ */
+void cch_customize_begin(CustomizableCH* cch, const Graph* g, const double* weights);
+void cch_customize_finish(CustomizableCH* cch);
+
+/**
+ * Elimination-tree query on the latest metric. Same result contract as
+ * ch_query(): original edge_ids in ws->path_edges, ws->path_cost under the
+ * graph's current weights. Returns 0 on success, 1 if no path.
+ */
+int cch_query(CustomizableCH* cch,
+              const Graph* g,
+              RouteWorkspace* ws,
+              int start_id,
+              int target_id);
+
+#endif
@@ -0,0 +1,711 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <stdint.h>
+
+#include "ch.h"
+#include "min_heap.h"
+
+/* ---------------- build-time helpers ---------------- */
+
+typedef struct {
+    int* data;
+    int len;
+    int cap;
+} IntVec;
+
+static int vec_push(IntVec* v, int x)
+{
+    if (v->len == v->cap) {
+        int cap = v->cap ? v->cap * 2 : 4;
+        int* grown = (int*)realloc(v->data, sizeof(int) * (size_t)cap);
+        if (!grown) return 1;
+        v->data = grown;
+        v->cap = cap;
+    }
+    v->data[v->len++] = x;
+    return 0;
+}
+
+static void vec_remove(IntVec* v, int x)
+{
+    for (int i = 0; i < v->len; i++) {
+        if (v->data[i] == x) {
+            v->data[i] = v->data[--v->len];
+            return;
+        }
+    }
+}
+
+/* Contraction state: the remaining (uncontracted) graph as arc-id lists */
+typedef struct {
+    int num_nodes;
+
+    CHArc* arcs;
+    int num_arcs;
+    int cap_arcs;
+
+    IntVec* out;            /* active arcs leaving each node */
+    IntVec* in;             /* active arcs entering each node */
+    int* deleted_neighbors;
+    int* level;
+
+    IntVec* up;             /* per node: arcs recorded at contraction */
+    IntVec* down;
+
+    /* witness search */
+    unsigned int* seen;
+    unsigned int generation;
+    double* dist;
+    MinHeap* heap;
+
+    int oom;                /* set when an allocation failed */
+} CHBuilder;
+
+static int builder_new_arc(CHBuilder* b, int from, int to, double w,
+                           int edge_id, int child1, int child2)
+{
+    if (b->num_arcs == b->cap_arcs) {
+        int cap = b->cap_arcs ? b->cap_arcs * 2 : 1024;
+        CHArc* grown = (CHArc*)realloc(b->arcs, sizeof(CHArc) * (size_t)cap);
+        if (!grown) {
+            b->oom = 1;
+            return -1;
+        }
+        b->arcs = grown;
+        b->cap_arcs = cap;
+    }
+
+    CHArc* a = &b->arcs[b->num_arcs];
+    a->from = from;
+    a->to = to;
+    a->weight = w;
+    a->edge_id = edge_id;
+    a->child1 = child1;
+    a->child2 = child2;
+    return b->num_arcs++;
+}
+
+/* Adds from -> to unless an equal or cheaper active arc already exists;
+   a more expensive one is replaced (it stays in arcs[] for unpacking) */
+static void builder_add_arc(CHBuilder* b, int from, int to, double w,
+                            int edge_id, int child1, int child2)
+{
+    IntVec* out = &b->out[from];
+    for (int i = 0; i < out->len; i++) {
+        int a = out->data[i];
+        if (b->arcs[a].to == to) {
+            if (b->arcs[a].weight <= w) return;
+            out->data[i] = out->data[--out->len];
+            vec_remove(&b->in[to], a);
+            break;
+        }
+    }
+
+    int id = builder_new_arc(b, from, to, w, edge_id, child1, child2);
+    if (id < 0) return;
+    if (vec_push(&b->out[from], id) != 0 || vec_push(&b->in[to], id) != 0) {
+        b->oom = 1;
+    }
+}
+
+/* Bounded Dijkstra from source over the remaining graph, avoiding skip */
+static void witness_search(CHBuilder* b, int source, int skip, double bound, int settle_limit)
+{
+    b->generation++;
+    if (b->generation == 0) {
+        memset(b->seen, 0, sizeof(unsigned int) * (size_t)b->num_nodes);
+        b->generation = 1;
+    }
+    const unsigned int gen = b->generation;
+    clearMinHeap(b->heap);
+
+    b->seen[source] = gen;
+    b->dist[source] = 0.0;
+    insertMinHeap(b->heap, source, 0.0);
+
+    int settled = 0;
+    while (!isEmpty(b->heap) && settled < settle_limit) {
+        double d;
+        int x = extractMin(b->heap, &d);
+        if (d > bound) break;
+        settled++;
+
+        const IntVec* out = &b->out[x];
+        for (int i = 0; i < out->len; i++) {
+            const CHArc* a = &b->arcs[out->data[i]];
+            int y = a->to;
+            if (y == skip) continue;
+
+            double nd = d + a->weight;
+            if (b->seen[y] != gen) {
+                b->seen[y] = gen;
+                b->dist[y] = nd;
+                insertMinHeap(b->heap, y, nd);
+            } else if (nd < b->dist[y]) {
+                b->dist[y] = nd;
+                if (isInMinHeap(b->heap, y)) decreaseKey(b->heap, y, nd);
+            }
+        }
+    }
+}
+
+/* Counts (simulate) or adds the shortcuts needed to remove v */
+static int contract_node(CHBuilder* b, int v, int simulate)
+{
+    int shortcuts = 0;
+    const IntVec* in = &b->in[v];
+    const IntVec* out = &b->out[v];
+
+    for (int i = 0; i < in->len; i++) {
+        int a1 = in->data[i];
+        int u = b->arcs[a1].from;
+        double w1 = b->arcs[a1].weight;
+
+        double bound = 0.0;
+        int targets = 0;
+        for (int j = 0; j < out->len; j++) {
+            const CHArc* a2 = &b->arcs[out->data[j]];
+            if (a2->to == u) continue;
+            if (w1 + a2->weight > bound) bound = w1 + a2->weight;
+            targets++;
+        }
+        if (targets == 0) continue;
+
+        witness_search(b, u, v, bound,
+                       simulate ? CH_SIMULATE_SETTLE_LIMIT : CH_WITNESS_SETTLE_LIMIT);
+
+        for (int j = 0; j < out->len; j++) {
+            int a2 = out->data[j];
+            int w = b->arcs[a2].to;
+            if (w == u) continue;
+
+            double via = w1 + b->arcs[a2].weight;
+            if (b->seen[w] == b->generation && b->dist[w] <= via) continue;
+
+            shortcuts++;
+            if (!simulate) {
+                builder_add_arc(b, u, w, via, -1, a1, a2);
+            }
+        }
+    }
+    return shortcuts;
+}
+
+static double node_priority(CHBuilder* b, int v)
+{
+    int shortcuts = contract_node(b, v, 1);
+    int removed = b->in[v].len + b->out[v].len;
+    return 2.0 * (shortcuts - removed) + 4.0 * b->deleted_neighbors[v] + b->level[v];
+}
+
+static void builder_free(CHBuilder* b)
+{
+    for (int i = 0; b->out && i < b->num_nodes; i++) free(b->out[i].data);
+    for (int i = 0; b->in && i < b->num_nodes; i++) free(b->in[i].data);
+    for (int i = 0; b->up && i < b->num_nodes; i++) free(b->up[i].data);
+    for (int i = 0; b->down && i < b->num_nodes; i++) free(b->down[i].data);
+    free(b->out);
+    free(b->in);
+    free(b->up);
+    free(b->down);
+    free(b->deleted_neighbors);
+    free(b->level);
+    free(b->seen);
+    free(b->dist);
+    freeMinHeap(b->heap);
+    free(b->arcs);
+}
+
+/* ---------------- search graph ---------------- */
+
+/* Fill heads/weights of one direction from the arc ids; head is the
+   endpoint that is not the owning node */
+static void fill_search_side(ContractionHierarchy* ch, const int* offsets, const int* arc_ids,
+                             int* heads, double* weights, int use_to)
+{
+    for (int u = 0; u < ch->num_nodes; u++) {
+        for (int i = offsets[u]; i < offsets[u + 1]; i++) {
+            const CHArc* a = &ch->arcs[arc_ids[i]];
+            heads[i] = use_to ? a->to : a->from;
+            weights[i] = a->weight;
+        }
+    }
+}
+
+static int alloc_search_graph(ContractionHierarchy* ch, int num_up, int num_down)
+{
+    size_t V1 = (size_t)ch->num_nodes + 1;
+    size_t nu = (size_t)(num_up > 0 ? num_up : 1);
+    size_t nd = (size_t)(num_down > 0 ? num_down : 1);
+
+    ch->up_offsets   = (int*)calloc(V1, sizeof(int));
+    ch->up_heads     = (int*)malloc(sizeof(int) * nu);
+    ch->up_weights   = (double*)malloc(sizeof(double) * nu);
+    ch->up_arcs      = (int*)malloc(sizeof(int) * nu);
+    ch->down_offsets = (int*)calloc(V1, sizeof(int));
+    ch->down_heads   = (int*)malloc(sizeof(int) * nd);
+    ch->down_weights = (double*)malloc(sizeof(double) * nd);
+    ch->down_arcs    = (int*)malloc(sizeof(int) * nd);
+
+    if (!ch->up_offsets || !ch->up_heads || !ch->up_weights || !ch->up_arcs ||
+        !ch->down_offsets || !ch->down_heads || !ch->down_weights || !ch->down_arcs) {
+        return 1;
+    }
+    return 0;
+}
+
+/* ---------------- public API ---------------- */
+
+int ch_build(ContractionHierarchy* ch, const Graph* g)
+{
+    if (!ch || !g) return 10;
+
+    memset(ch, 0, sizeof(*ch));
+    int V = g->num_nodes;
+
+    CHBuilder b;
+    memset(&b, 0, sizeof(b));
+    b.num_nodes = V;
+    b.out  = (IntVec*)calloc((size_t)V, sizeof(IntVec));
+    b.in   = (IntVec*)calloc((size_t)V, sizeof(IntVec));
+    b.up   = (IntVec*)calloc((size_t)V, sizeof(IntVec));
+    b.down = (IntVec*)calloc((size_t)V, sizeof(IntVec));
+    b.deleted_neighbors = (int*)calloc((size_t)V, sizeof(int));
+    b.level = (int*)calloc((size_t)V, sizeof(int));
+    b.seen  = (unsigned int*)calloc((size_t)V, sizeof(unsigned int));
+    b.dist  = (double*)malloc(sizeof(double) * (size_t)V);
+    b.heap  = createMinHeap(V, MIN_HEAP_DEFAULT_ARITY);
+    ch->rank = (int*)malloc(sizeof(int) * (size_t)V);
+
+    if (!b.out || !b.in || !b.up || !b.down || !b.deleted_neighbors ||
+        !b.level || !b.seen || !b.dist || !b.heap || !ch->rank) {
+        builder_free(&b);
+        ch_free(ch);
+        return 12;
+    }
+
+    /* Original edges; parallel edges collapse to the cheapest, loops drop */
+    for (int u = 0; u < V; u++) {
+        for (int slot = g->out_offsets[u]; slot < g->out_offsets[u + 1]; slot++) {
+            int v = g->out_targets[slot];
+            if (v == u) continue;
+            builder_add_arc(&b, u, v, g->out_weights[slot], g->out_edge_ids[slot], -1, -1);
+        }
+    }
+    if (b.oom) {
+        builder_free(&b);
+        ch_free(ch);
+        return 12;
+    }
+
+    /* Node order: lazily updated priority queue (a separate heap, since
+       b.heap is used by the witness searches) */
+    MinHeap* order = createMinHeap(V, MIN_HEAP_DEFAULT_ARITY);
+    if (!order) {
+        builder_free(&b);
+        ch_free(ch);
+        return 12;
+    }
+    for (int v = 0; v < V; v++) {
+        insertMinHeap(order, v, node_priority(&b, v));
+    }
+
+    int next_rank = 0;
+    int report_every = V / 10 > 0 ? V / 10 : 1;
+    while (!isEmpty(order) && !b.oom) {
+        int v = extractMin(order, NULL);
+
+        /* Lazy update: priorities may have gone stale since insertion */
+        double prio = node_priority(&b, v);
+        if (!isEmpty(order) && prio > order->array[0].dist) {
+            insertMinHeap(order, v, prio);
+            continue;
+        }
+
+        ch->rank[v] = next_rank++;
+
+        /* Remaining arcs of v all lead to higher-ranked nodes */
+        for (int i = 0; i < b.out[v].len; i++) {
+            if (vec_push(&b.up[v], b.out[v].data[i]) != 0) b.oom = 1;
+        }
+        for (int i = 0; i < b.in[v].len; i++) {
+            if (vec_push(&b.down[v], b.in[v].data[i]) != 0) b.oom = 1;
+        }
+
+        contract_node(&b, v, 0);
+
+        /* Detach v and refresh its neighbors' priorities */
+        for (int pass = 0; pass < 2; pass++) {
+            IntVec* list = pass == 0 ? &b.out[v] : &b.in[v];
+            for (int i = 0; i < list->len; i++) {
+                const CHArc* a = &b.arcs[list->data[i]];
+                int x = pass == 0 ? a->to : a->from;
+                vec_remove(pass == 0 ? &b.in[x] : &b.out[x], list->data[i]);
+
+                b.deleted_neighbors[x]++;
+                if (b.level[x] < b.level[v] + 1) b.level[x] = b.level[v] + 1;
+            }
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            IntVec* list = pass == 0 ? &b.out[v] : &b.in[v];
+            for (int i = 0; i < list->len; i++) {
+                const CHArc* a = &b.arcs[list->data[i]];
+                int x = pass == 0 ? a->to : a->from;
+                if (isInMinHeap(order, x)) {
+                    updateKey(order, x, node_priority(&b, x));
+                }
+            }
+        }
+        b.out[v].len = 0;
+        b.in[v].len = 0;
+
+        if (next_rank % report_every == 0) {
+            fprintf(stderr, "CH: contracted %d/%d nodes (%d arcs)\n", next_rank, V, b.num_arcs);
+        }
+    }
+    freeMinHeap(order);
+
+    if (b.oom) {
+        builder_free(&b);
+        ch_free(ch);
+        return 12;
+    }
+
+    /* Hand the arcs over and pack the search graph */
+    ch->num_nodes = V;
+    ch->num_edges = g->num_edges;
+    ch->num_arcs = b.num_arcs;
+    ch->arcs = b.arcs;
+    b.arcs = NULL;
+
+    int num_up = 0, num_down = 0;
+    for (int v = 0; v < V; v++) {
+        num_up += b.up[v].len;
+        num_down += b.down[v].len;
+    }
+    if (alloc_search_graph(ch, num_up, num_down) != 0) {
+        builder_free(&b);
+        ch_free(ch);
+        return 12;
+    }
+
+    for (int v = 0; v < V; v++) {
+        ch->up_offsets[v + 1] = ch->up_offsets[v] + b.up[v].len;
+        ch->down_offsets[v + 1] = ch->down_offsets[v] + b.down[v].len;
+        memcpy(ch->up_arcs + ch->up_offsets[v], b.up[v].data, sizeof(int) * (size_t)b.up[v].len);
+        memcpy(ch->down_arcs + ch->down_offsets[v], b.down[v].data, sizeof(int) * (size_t)b.down[v].len);
+    }
+    fill_search_side(ch, ch->up_offsets, ch->up_arcs, ch->up_heads, ch->up_weights, 1);
+    fill_search_side(ch, ch->down_offsets, ch->down_arcs, ch->down_heads, ch->down_weights, 0);
+
+    builder_free(&b);
+
+    fprintf(stderr, "CH: built %d arcs (%d shortcuts), %d up / %d down\n",
+            ch->num_arcs, ch->num_arcs - g->num_edges, num_up, num_down);
+    return 0;
+}
+
+/* ---------------- file I/O ---------------- */
+
+#define CH_FILE_MAGIC   0x48435a57u   /* "WZCH" */
+#define CH_FILE_VERSION 1u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t num_nodes;
+    int32_t num_edges;
+    int32_t num_arcs;
+    int32_t num_up;
+    int32_t num_down;
+} CHFileHeader;
+
+int ch_save(const ContractionHierarchy* ch, const char* path)
+{
+    if (!ch || !path) return 10;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "ERROR: failed to open CH file for writing: %s\n", path);
+        return 20;
+    }
+
+    CHFileHeader h;
+    h.magic = CH_FILE_MAGIC;
+    h.version = CH_FILE_VERSION;
+    h.num_nodes = ch->num_nodes;
+    h.num_edges = ch->num_edges;
+    h.num_arcs = ch->num_arcs;
+    h.num_up = ch->up_offsets[ch->num_nodes];
+    h.num_down = ch->down_offsets[ch->num_nodes];
+
+    size_t V = (size_t)ch->num_nodes;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(ch->rank, sizeof(int), V, f) == V &&
+             fwrite(ch->arcs, sizeof(CHArc), (size_t)h.num_arcs, f) == (size_t)h.num_arcs &&
+             fwrite(ch->up_offsets, sizeof(int), V + 1, f) == V + 1 &&
+             fwrite(ch->up_arcs, sizeof(int), (size_t)h.num_up, f) == (size_t)h.num_up &&
+             fwrite(ch->down_offsets, sizeof(int), V + 1, f) == V + 1 &&
+             fwrite(ch->down_arcs, sizeof(int), (size_t)h.num_down, f) == (size_t)h.num_down;
+
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "ERROR: failed to write CH file: %s\n", path);
+        return 21;
+    }
+    return 0;
+}
+
+int ch_load(ContractionHierarchy* ch, const Graph* g, const char* path)
+{
+    if (!ch || !g || !path) return 10;
+    memset(ch, 0, sizeof(*ch));
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "ERROR: failed to open CH file: %s\n", path);
+        return 20;
+    }
+
+    CHFileHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        h.magic != CH_FILE_MAGIC || h.version != CH_FILE_VERSION) {
+        fprintf(stderr, "ERROR: not a CH file (or wrong version): %s\n", path);
+        fclose(f);
+        return 22;
+    }
+
+    if (h.num_nodes != g->num_nodes || h.num_edges != g->num_edges ||
+        h.num_arcs < 0 || h.num_up < 0 || h.num_down < 0) {
+        fprintf(stderr, "ERROR: CH file does not match the loaded graph: %s\n", path);
+        fclose(f);
+        return 23;
+    }
+
+    ch->num_nodes = h.num_nodes;
+    ch->num_edges = h.num_edges;
+    ch->num_arcs = h.num_arcs;
+    ch->rank = (int*)malloc(sizeof(int) * (size_t)(h.num_nodes > 0 ? h.num_nodes : 1));
+    ch->arcs = (CHArc*)malloc(sizeof(CHArc) * (size_t)(h.num_arcs > 0 ? h.num_arcs : 1));
+    if (!ch->rank || !ch->arcs || alloc_search_graph(ch, h.num_up, h.num_down) != 0) {
+        fclose(f);
+        ch_free(ch);
+        return 12;
+    }
+
+    size_t V = (size_t)h.num_nodes;
+    int ok = fread(ch->rank, sizeof(int), V, f) == V &&
+             fread(ch->arcs, sizeof(CHArc), (size_t)h.num_arcs, f) == (size_t)h.num_arcs &&
+             fread(ch->up_offsets, sizeof(int), V + 1, f) == V + 1 &&
+             fread(ch->up_arcs, sizeof(int), (size_t)h.num_up, f) == (size_t)h.num_up &&
+             fread(ch->down_offsets, sizeof(int), V + 1, f) == V + 1 &&
+             fread(ch->down_arcs, sizeof(int), (size_t)h.num_down, f) == (size_t)h.num_down;
+    fclose(f);
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: truncated CH file: %s\n", path);
+        ch_free(ch);
+        return 24;
+    }
+
+    /* Validate everything a query or unpacking will index with */
+    for (int i = 0; i < h.num_arcs && ok; i++) {
+        const CHArc* a = &ch->arcs[i];
+        if (a->from < 0 || a->from >= h.num_nodes || a->to < 0 || a->to >= h.num_nodes) {
+            ok = 0;
+        } else if (a->edge_id >= 0) {
+            ok = a->edge_id < g->num_edges &&
+                 g->edges[a->edge_id].from_node == a->from &&
+                 g->edges[a->edge_id].to_node == a->to;
+        } else {
+            ok = a->child1 >= 0 && a->child1 < i && a->child2 >= 0 && a->child2 < i;
+        }
+    }
+    for (int v = 0; v < h.num_nodes && ok; v++) {
+        ok = ch->up_offsets[v] <= ch->up_offsets[v + 1] &&
+             ch->down_offsets[v] <= ch->down_offsets[v + 1];
+    }
+    ok = ok && ch->up_offsets[0] == 0 && ch->up_offsets[V] == h.num_up &&
+         ch->down_offsets[0] == 0 && ch->down_offsets[V] == h.num_down;
+    for (int i = 0; i < h.num_up && ok; i++) {
+        ok = ch->up_arcs[i] >= 0 && ch->up_arcs[i] < h.num_arcs;
+    }
+    for (int i = 0; i < h.num_down && ok; i++) {
+        ok = ch->down_arcs[i] >= 0 && ch->down_arcs[i] < h.num_arcs;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: corrupt CH file: %s\n", path);
+        ch_free(ch);
+        return 25;
+    }
+
+    fill_search_side(ch, ch->up_offsets, ch->up_arcs, ch->up_heads, ch->up_weights, 1);
+    fill_search_side(ch, ch->down_offsets, ch->down_arcs, ch->down_heads, ch->down_weights, 0);
+    return 0;
+}
+
+void ch_free(ContractionHierarchy* ch)
+{
+    if (!ch) return;
+    free(ch->arcs);
+    free(ch->rank);
+    free(ch->up_offsets);
+    free(ch->up_heads);
+    free(ch->up_weights);
+    free(ch->up_arcs);
+    free(ch->down_offsets);
+    free(ch->down_heads);
+    free(ch->down_weights);
+    free(ch->down_arcs);
+    memset(ch, 0, sizeof(*ch));
+}
+
+/* ---------------- query ---------------- */
+
+/* Append the original edges behind arc a (recursing into shortcuts) */
+static int unpack_arc(const ContractionHierarchy* ch, RouteWorkspace* ws, int a)
+{
+    const CHArc* arc = &ch->arcs[a];
+    if (arc->edge_id >= 0) {
+        int rc = routing_workspace_reserve_path(ws, ws->path_len + 1);
+        if (rc != 0) return rc;
+        ws->path_edges[ws->path_len++] = arc->edge_id;
+        return 0;
+    }
+    int rc = unpack_arc(ch, ws, arc->child1);
+    if (rc != 0) return rc;
+    return unpack_arc(ch, ws, arc->child2);
+}
+
+/* Unpack the forward up-path start -> v in order */
+static int unpack_forward(const ContractionHierarchy* ch, RouteWorkspace* ws, int start_id, int v)
+{
+    if (v == start_id) return 0;
+    int a = ws->fwd.parent_slot[v];
+    int rc = unpack_forward(ch, ws, start_id, ch->arcs[a].from);
+    if (rc != 0) return rc;
+    return unpack_arc(ch, ws, a);
+}
+
+int ch_query(const ContractionHierarchy* ch,
+             const Graph* g,
+             RouteWorkspace* ws,
+             int start_id,
+             int target_id)
+{
+    if (!ch || !g || !ws) return 10;
+
+    if (start_id < 0 || start_id >= ch->num_nodes ||
+        target_id < 0 || target_id >= ch->num_nodes ||
+        ws->num_nodes != ch->num_nodes) {
+        return 11;
+    }
+
+    int rc = routing_workspace_ensure_backward(ws);
+    if (rc != 0) return rc;
+
+    routing_workspace_begin(ws);
+
+    const unsigned int gen = ws->generation;
+    SearchSpace* sides[2] = { &ws->fwd, &ws->bwd };
+
+    /* parent_slot holds the arc id used to reach a node */
+    for (int s = 0; s < 2; s++) {
+        int root = s == 0 ? start_id : target_id;
+        sides[s]->seen[root] = gen;
+        sides[s]->g_score[root] = 0.0;
+        sides[s]->parent_slot[root] = -1;
+        insertMinHeap(sides[s]->heap, root, 0.0);
+    }
+
+    double best = DBL_MAX;
+    int meet = -1;
+
+    while (1) {
+        double top_f = isEmpty(ws->fwd.heap) ? DBL_MAX : ws->fwd.heap->array[0].dist;
+        double top_b = isEmpty(ws->bwd.heap) ? DBL_MAX : ws->bwd.heap->array[0].dist;
+
+        /* A side is finished once its smallest key cannot beat best */
+        if (top_f >= best && top_b >= best) break;
+
+        int s = (top_f <= top_b) ? 0 : 1;
+        SearchSpace* me = sides[s];
+        SearchSpace* other = sides[1 - s];
+
+        int u = extractMin(me->heap, NULL);
+        double d_u = me->g_score[u];
+        ws->settled++;
+
+        if (other->seen[u] == gen && d_u + other->g_score[u] < best) {
+            best = d_u + other->g_score[u];
+            meet = u;
+        }
+
+        /* Forward relaxes up arcs and is stalled through down arcs, and
+           the backward search the other way round */
+        const int* relax_off    = s == 0 ? ch->up_offsets   : ch->down_offsets;
+        const int* relax_head   = s == 0 ? ch->up_heads     : ch->down_heads;
+        const double* relax_w   = s == 0 ? ch->up_weights   : ch->down_weights;
+        const int* relax_arc    = s == 0 ? ch->up_arcs      : ch->down_arcs;
+        const int* stall_off    = s == 0 ? ch->down_offsets : ch->up_offsets;
+        const int* stall_head   = s == 0 ? ch->down_heads   : ch->up_heads;
+        const double* stall_w   = s == 0 ? ch->down_weights : ch->up_weights;
+
+        /* Stall-on-demand: a higher node already reaches u more cheaply */
+        int stalled = 0;
+        for (int i = stall_off[u]; i < stall_off[u + 1]; i++) {
+            int x = stall_head[i];
+            if (me->seen[x] == gen && me->g_score[x] + stall_w[i] < d_u) {
+                stalled = 1;
+                break;
+            }
+        }
+        if (stalled) continue;
+
+        for (int i = relax_off[u]; i < relax_off[u + 1]; i++) {
+            int x = relax_head[i];
+            double nd = d_u + relax_w[i];
+
+            if (me->seen[x] != gen) {
+                me->seen[x] = gen;
+                me->g_score[x] = nd;
+                me->parent_slot[x] = relax_arc[i];
+                insertMinHeap(me->heap, x, nd);
+            } else if (nd < me->g_score[x]) {
+                me->g_score[x] = nd;
+                me->parent_slot[x] = relax_arc[i];
+                if (isInMinHeap(me->heap, x)) {
+                    decreaseKey(me->heap, x, nd);
+                } else {
+                    insertMinHeap(me->heap, x, nd);
+                }
+            }
+        }
+    }
+
+    if (meet < 0) {
+        return 1; /* no path */
+    }
+
+    /* start -> meet over forward parents, then meet -> target */
+    rc = unpack_forward(ch, ws, start_id, meet);
+    for (int v = meet; rc == 0 && v != target_id; ) {
+        int a = ws->bwd.parent_slot[v];
+        rc = unpack_arc(ch, ws, a);
+        v = ch->arcs[a].to;
+    }
+    if (rc != 0) return rc;
+
+    /* Report the ETA under the workspace's weights; the hierarchy's own
+       weights are a snapshot from build time */
+    const double* weights = routing_weights(g, ws);
+    double cost = 0.0;
+    for (int i = 0; i < ws->path_len; i++) {
+        cost += weights[g->edge_slot[ws->path_edges[i]]];
+    }
+    ws->path_cost = cost;
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef CH_H
+#define CH_H
+
+#include "graph.h"
+#include "routing.h"
+
+/* Witness searches give up after settling this many nodes (a missed
+   witness only costs an extra shortcut, never correctness) */
+#ifndef CH_WITNESS_SETTLE_LIMIT
+#define CH_WITNESS_SETTLE_LIMIT 200
+#endif
+
+/* Cheaper limit used when only estimating a node's priority */
+#ifndef CH_SIMULATE_SETTLE_LIMIT
+#define CH_SIMULATE_SETTLE_LIMIT 40
+#endif
+
+/* Arc of the hierarchy: an original edge or a shortcut over two arcs */
+typedef struct {
+    int from;
+    int to;
+    double weight;
+    int edge_id;    /* original edge_id, -1 for a shortcut */
+    int child1;     /* shortcut: arc from -> middle */
+    int child2;     /* shortcut: arc middle -> to */
+} CHArc;
+
+/*
+ * Contraction hierarchy over a Graph. Built offline (ch_build) or loaded
+ * from a file written by ch_save. The search graph is stored as CSR by
+ * node id:
+ *  - up:   arcs u -> x with rank[x] > rank[u] (forward search from start)
+ *  - down: arcs x -> u with rank[x] > rank[u], stored at u with head x
+ *          (backward search from target)
+ * Weights are the graph's travel times at build time.
+ */
+typedef struct ContractionHierarchy {
+    int num_nodes;
+    int num_edges;          /* edge count of the graph it was built for */
+    int num_arcs;
+    CHArc* arcs;            /* original edges and shortcuts, for unpacking */
+    int* rank;              /* contraction order position per node */
+
+    int* up_offsets;
+    int* up_heads;
+    double* up_weights;
+    int* up_arcs;
+
+    int* down_offsets;
+    int* down_heads;
+    double* down_weights;
+    int* down_arcs;
+} ContractionHierarchy;
+
+/**
+ * Orders and contracts every node of g using its current travel times.
+ * Returns 0 on success, non-zero on error.
+ */
+int ch_build(ContractionHierarchy* ch, const Graph* g);
+
+/* Binary file I/O. Load checks the file matches g. 0 on success. */
+int ch_save(const ContractionHierarchy* ch, const char* path);
+int ch_load(ContractionHierarchy* ch, const Graph* g, const char* path);
+
+void ch_free(ContractionHierarchy* ch);
+
+/**
+ * Bidirectional upward query with stall-on-demand. Shortcuts are unpacked
+ * so ws->path_edges lists original edge_ids; ws->path_cost is the route's
+ * travel time under the graph's current weights.
+ * Returns 0 on success, 1 if no path, non-zero on error.
+ */
+int ch_query(const ContractionHierarchy* ch,
+             const Graph* g,
+             RouteWorkspace* ws,
+             int start_id,
+             int target_id);
+
+#endif
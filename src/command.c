@@ -0,0 +1,415 @@
+#include "command.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+typedef enum { FIELD_INT, FIELD_LONG, FIELD_DOUBLE } FieldType;
+
+typedef struct {
+    const char* name;
+    size_t len;
+    unsigned int flag;
+    FieldType type;
+} FieldSpec;
+
+#define FIELD(name, flag, type) { name, sizeof(name) - 1, flag, type }
+
+static const FieldSpec FIELDS[] = {
+    FIELD("req_id", CMD_F_REQ_ID, FIELD_LONG),
+    FIELD("user_id", CMD_F_USER_ID, FIELD_INT),
+    FIELD("car_id", CMD_F_CAR_ID, FIELD_INT),
+    FIELD("timestamp", CMD_F_TIMESTAMP, FIELD_DOUBLE),
+    FIELD("start_node", CMD_F_START_NODE, FIELD_INT),
+    FIELD("destination_node", CMD_F_DESTINATION_NODE, FIELD_INT),
+    FIELD("edge_id", CMD_F_EDGE_ID, FIELD_INT),
+    FIELD("position_on_edge", CMD_F_POSITION, FIELD_DOUBLE),
+    FIELD("speed", CMD_F_SPEED, FIELD_DOUBLE),
+};
+
+#define NUM_FIELDS (sizeof(FIELDS) / sizeof(FIELDS[0]))
+
+typedef struct {
+    const char* p;
+    const char* end;
+    JsonCommand* cmd;
+} Parser;
+
+/* A scanned JSON number: its text plus what the scan already computed */
+typedef struct {
+    const char* start;
+    const char* end;
+    int negative;
+    int integer;            /* no fraction or exponent */
+    uint64_t mantissa;      /* all digits, integer and fraction */
+    int digits;             /* significant digits in mantissa */
+    int overflow;           /* more digits than mantissa holds */
+    int exp10;              /* value = mantissa * 10^exp10 */
+} NumberToken;
+
+/* Records the field an error is about; the position is taken from ps->p
+   once parsing unwinds */
+static CommandError fail(Parser* ps, CommandError err, const char* field) {
+    ps->cmd->error_field = field;
+    return err;
+}
+
+static void skip_ws(Parser* ps) {
+    while (ps->p < ps->end &&
+           (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\r' || *ps->p == '\n')) {
+        ps->p++;
+    }
+}
+
+static int is_hex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+/* String at ps->p (on the opening quote). Sets the raw contents and whether
+   they contain escapes. 0 on success. */
+static int scan_string(Parser* ps, const char** out, size_t* out_len, int* escaped) {
+    const char* p = ps->p + 1;
+    *escaped = 0;
+    while (p < ps->end && *p != '"') {
+        unsigned char c = (unsigned char)*p;
+        if (c < 0x20) {
+            ps->p = p;
+            return 1;
+        }
+        if (c == '\\') {
+            *escaped = 1;
+            if (++p >= ps->end) break;
+            if (*p == 'u') {
+                if (ps->end - p < 5 || !is_hex(p[1]) || !is_hex(p[2]) ||
+                    !is_hex(p[3]) || !is_hex(p[4])) {
+                    ps->p = p;
+                    return 1;
+                }
+                p += 4;
+            } else if (!strchr("\"\\/bfnrt", *p)) {
+                ps->p = p;
+                return 1;
+            }
+        }
+        p++;
+    }
+    if (p >= ps->end) {
+        ps->p = p;
+        return 1;
+    }
+    *out = ps->p + 1;
+    *out_len = (size_t)(p - (ps->p + 1));
+    ps->p = p + 1;
+    return 0;
+}
+
+/* JSON number grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? */
+static int scan_number(Parser* ps, NumberToken* nt) {
+    const char* p = ps->p;
+    memset(nt, 0, sizeof(*nt));
+    nt->start = p;
+    nt->integer = 1;
+
+    if (p < ps->end && *p == '-') {
+        nt->negative = 1;
+        p++;
+    }
+    if (p >= ps->end || *p < '0' || *p > '9') goto bad;
+
+    if (*p == '0') {
+        p++;
+    } else {
+        for (; p < ps->end && *p >= '0' && *p <= '9'; p++) {
+            if (nt->digits < 19) {
+                nt->mantissa = nt->mantissa * 10 + (uint64_t)(*p - '0');
+                if (nt->mantissa) nt->digits++;
+            } else {
+                nt->overflow = 1;
+                nt->exp10++;
+            }
+        }
+    }
+
+    if (p < ps->end && *p == '.') {
+        nt->integer = 0;
+        p++;
+        if (p >= ps->end || *p < '0' || *p > '9') goto bad;
+        for (; p < ps->end && *p >= '0' && *p <= '9'; p++) {
+            if (nt->digits < 19) {
+                nt->mantissa = nt->mantissa * 10 + (uint64_t)(*p - '0');
+                if (nt->mantissa) nt->digits++;
+                nt->exp10--;
+            } else {
+                nt->overflow = 1;
+            }
+        }
+    }
+
+    if (p < ps->end && (*p == 'e' || *p == 'E')) {
+        nt->integer = 0;
+        p++;
+        int eneg = 0;
+        if (p < ps->end && (*p == '+' || *p == '-')) eneg = (*p++ == '-');
+        if (p >= ps->end || *p < '0' || *p > '9') goto bad;
+        int e = 0;
+        for (; p < ps->end && *p >= '0' && *p <= '9'; p++) {
+            if (e < 100000) e = e * 10 + (*p - '0');
+        }
+        nt->exp10 += eneg ? -e : e;
+    }
+
+    nt->end = p;
+    ps->p = p;
+    return 0;
+
+bad:
+    ps->p = p;
+    return 1;
+}
+
+static double number_value(const NumberToken* nt) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    /* Exact operands give a correctly rounded result (Clinger's fast
+       path), which covers what clients send; anything else goes to
+       strtod, which stops at the end of the already validated token */
+    if (!nt->overflow && nt->mantissa <= (UINT64_C(1) << 53) &&
+        nt->exp10 >= -22 && nt->exp10 <= 22) {
+        double v = (double)nt->mantissa;
+        v = nt->exp10 < 0 ? v / pow10[-nt->exp10] : v * pow10[nt->exp10];
+        return nt->negative ? -v : v;
+    }
+    return strtod(nt->start, NULL);
+}
+
+/* Skips any value (used for unknown fields) */
+static CommandError skip_value(Parser* ps, int depth) {
+    if (depth > CMD_JSON_MAX_DEPTH) return fail(ps, CMD_ERR_TOO_DEEP, NULL);
+    if (ps->p >= ps->end) return fail(ps, CMD_ERR_SYNTAX, NULL);
+
+    char c = *ps->p;
+    if (c == '"') {
+        const char* s;
+        size_t n;
+        int esc;
+        return scan_string(ps, &s, &n, &esc) == 0 ? CMD_OK : fail(ps, CMD_ERR_SYNTAX, NULL);
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        NumberToken nt;
+        return scan_number(ps, &nt) == 0 ? CMD_OK : fail(ps, CMD_ERR_SYNTAX, NULL);
+    }
+    if (c == '{' || c == '[') {
+        char close = (c == '{') ? '}' : ']';
+        ps->p++;
+        skip_ws(ps);
+        if (ps->p < ps->end && *ps->p == close) {
+            ps->p++;
+            return CMD_OK;
+        }
+        for (;;) {
+            if (c == '{') {
+                const char* s;
+                size_t n;
+                int esc;
+                if (ps->p >= ps->end || *ps->p != '"' || scan_string(ps, &s, &n, &esc) != 0) {
+                    return fail(ps, CMD_ERR_SYNTAX, NULL);
+                }
+                skip_ws(ps);
+                if (ps->p >= ps->end || *ps->p != ':') return fail(ps, CMD_ERR_SYNTAX, NULL);
+                ps->p++;
+                skip_ws(ps);
+            }
+            CommandError err = skip_value(ps, depth + 1);
+            if (err != CMD_OK) return err;
+            skip_ws(ps);
+            if (ps->p < ps->end && *ps->p == ',') {
+                ps->p++;
+                skip_ws(ps);
+                continue;
+            }
+            if (ps->p < ps->end && *ps->p == close) {
+                ps->p++;
+                return CMD_OK;
+            }
+            return fail(ps, CMD_ERR_SYNTAX, NULL);
+        }
+    }
+
+    static const char* const literals[] = { "true", "false", "null" };
+    for (int i = 0; i < 3; i++) {
+        size_t n = strlen(literals[i]);
+        if ((size_t)(ps->end - ps->p) >= n && memcmp(ps->p, literals[i], n) == 0) {
+            ps->p += n;
+            return CMD_OK;
+        }
+    }
+    return fail(ps, CMD_ERR_SYNTAX, NULL);
+}
+
+/* Value of a known field, converted and stored in cmd */
+static CommandError read_field(Parser* ps, const FieldSpec* f) {
+    JsonCommand* cmd = ps->cmd;
+    if (cmd->fields & f->flag) return fail(ps, CMD_ERR_DUPLICATE, f->name);
+
+    const char* at = ps->p;
+    if (at >= ps->end || !(*at == '-' || (*at >= '0' && *at <= '9'))) {
+        /* Well-formed but not a number gets BAD_VALUE; anything else is
+           a syntax error */
+        CommandError err = skip_value(ps, 1);
+        if (err != CMD_OK) return err;
+        ps->p = at;
+        return fail(ps, CMD_ERR_BAD_VALUE, f->name);
+    }
+
+    NumberToken nt;
+    if (scan_number(ps, &nt) != 0) return fail(ps, CMD_ERR_SYNTAX, NULL);
+
+    if (f->type == FIELD_DOUBLE) {
+        double v = number_value(&nt);
+        if (!isfinite(v)) {
+            ps->p = at;
+            return fail(ps, CMD_ERR_RANGE, f->name);
+        }
+        if (f->flag == CMD_F_TIMESTAMP) cmd->timestamp = v;
+        else if (f->flag == CMD_F_POSITION) cmd->position_on_edge = v;
+        else cmd->speed = v;
+    } else {
+        if (!nt.integer) {
+            ps->p = at;
+            return fail(ps, CMD_ERR_BAD_VALUE, f->name);
+        }
+        /* The mantissa is exact for up to 19 digits; more cannot fit */
+        uint64_t limit = (f->type == FIELD_INT)
+                       ? (nt.negative ? (uint64_t)INT_MAX + 1 : (uint64_t)INT_MAX)
+                       : (nt.negative ? (uint64_t)LLONG_MAX + 1 : (uint64_t)LLONG_MAX);
+        if (nt.overflow || nt.mantissa > limit) {
+            ps->p = at;
+            return fail(ps, CMD_ERR_RANGE, f->name);
+        }
+        long long v = nt.negative ? (long long)(0 - nt.mantissa) : (long long)nt.mantissa;
+        switch (f->flag) {
+        case CMD_F_REQ_ID:           cmd->req_id = v; break;
+        case CMD_F_USER_ID:          cmd->user_id = (int)v; break;
+        case CMD_F_CAR_ID:           cmd->car_id = (int)v; break;
+        case CMD_F_START_NODE:       cmd->start_node = (int)v; break;
+        case CMD_F_DESTINATION_NODE: cmd->destination_node = (int)v; break;
+        default:                     cmd->edge_id = (int)v; break;
+        }
+    }
+    cmd->fields |= f->flag;
+    return CMD_OK;
+}
+
+static const FieldSpec* find_field(const char* key, size_t len) {
+    for (size_t i = 0; i < NUM_FIELDS; i++) {
+        if (FIELDS[i].len == len && memcmp(FIELDS[i].name, key, len) == 0) return &FIELDS[i];
+    }
+    return NULL;
+}
+
+/* First field of the wanted set that is not in have */
+static const char* first_missing(unsigned int have, unsigned int want) {
+    for (size_t i = 0; i < NUM_FIELDS; i++) {
+        if ((want & FIELDS[i].flag) && !(have & FIELDS[i].flag)) return FIELDS[i].name;
+    }
+    return NULL;
+}
+
+static CommandError parse_object(Parser* ps) {
+    skip_ws(ps);
+    if (ps->p >= ps->end || *ps->p != '{') return fail(ps, CMD_ERR_SYNTAX, NULL);
+    ps->p++;
+    skip_ws(ps);
+
+    if (ps->p < ps->end && *ps->p == '}') {
+        ps->p++;
+    } else {
+        for (;;) {
+            const char* key;
+            size_t key_len;
+            int escaped;
+            if (ps->p >= ps->end || *ps->p != '"' || scan_string(ps, &key, &key_len, &escaped) != 0) {
+                return fail(ps, CMD_ERR_SYNTAX, NULL);
+            }
+            skip_ws(ps);
+            if (ps->p >= ps->end || *ps->p != ':') return fail(ps, CMD_ERR_SYNTAX, NULL);
+            ps->p++;
+            skip_ws(ps);
+
+            /* Known names contain no escapes, so an escaped key is never one */
+            const FieldSpec* f = escaped ? NULL : find_field(key, key_len);
+            CommandError err = f ? read_field(ps, f) : skip_value(ps, 1);
+            if (err != CMD_OK) return err;
+
+            skip_ws(ps);
+            if (ps->p < ps->end && *ps->p == ',') {
+                ps->p++;
+                skip_ws(ps);
+                continue;
+            }
+            if (ps->p < ps->end && *ps->p == '}') {
+                ps->p++;
+                break;
+            }
+            return fail(ps, CMD_ERR_SYNTAX, NULL);
+        }
+    }
+
+    skip_ws(ps);
+    if (ps->p != ps->end) return fail(ps, CMD_ERR_SYNTAX, NULL);
+    return CMD_OK;
+}
+
+CommandError command_parse_json(const char* line, size_t len, JsonCommand* cmd) {
+    Parser ps;
+    ps.p = line;
+    ps.end = line + len;
+    ps.cmd = cmd;
+
+    cmd->kind = CMD_NONE;
+    cmd->fields = 0;
+    cmd->error_field = NULL;
+    cmd->error_pos = 0;
+
+    CommandError err = parse_object(&ps);
+    if (err != CMD_OK) {
+        cmd->error_pos = (size_t)(ps.p - line);
+        return err;
+    }
+
+    /* A route takes precedence, as the line-oriented protocol always did */
+    unsigned int have = cmd->fields;
+    if ((have & CMD_ROUTE_FIELDS) == CMD_ROUTE_FIELDS) {
+        cmd->kind = CMD_ROUTE;
+    } else if ((have & CMD_UPDATE_FIELDS) == CMD_UPDATE_FIELDS) {
+        cmd->kind = CMD_UPDATE;
+    } else if (have & (CMD_F_START_NODE | CMD_F_DESTINATION_NODE)) {
+        cmd->error_field = first_missing(have, CMD_ROUTE_FIELDS);
+        return CMD_ERR_MISSING;
+    } else if (have & (CMD_F_EDGE_ID | CMD_F_POSITION | CMD_F_SPEED)) {
+        cmd->error_field = first_missing(have, CMD_UPDATE_FIELDS);
+        return CMD_ERR_MISSING;
+    } else {
+        return CMD_ERR_UNKNOWN;
+    }
+    return CMD_OK;
+}
+
+const char* command_error_code(CommandError err) {
+    switch (err) {
+    case CMD_OK:            return "OK";
+    case CMD_ERR_SYNTAX:    return "BAD_JSON";
+    case CMD_ERR_TOO_DEEP:  return "TOO_DEEP";
+    case CMD_ERR_BAD_VALUE: return "BAD_VALUE";
+    case CMD_ERR_RANGE:     return "OUT_OF_RANGE";
+    case CMD_ERR_DUPLICATE: return "DUPLICATE_FIELD";
+    case CMD_ERR_MISSING:   return "MISSING_FIELD";
+    case CMD_ERR_UNKNOWN:   return "UNKNOWN_CMD";
+    }
+    return "UNKNOWN_CMD";
+}
@@ -0,0 +1,82 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+
+/* Fields a JSON command can carry; bits of JsonCommand.fields */
+#define CMD_F_REQ_ID            (1u << 0)
+#define CMD_F_USER_ID           (1u << 1)
+#define CMD_F_CAR_ID            (1u << 2)
+#define CMD_F_TIMESTAMP         (1u << 3)
+#define CMD_F_START_NODE        (1u << 4)
+#define CMD_F_DESTINATION_NODE  (1u << 5)
+#define CMD_F_EDGE_ID           (1u << 6)
+#define CMD_F_POSITION          (1u << 7)
+#define CMD_F_SPEED             (1u << 8)
+
+/* Fields that make a routing request and a traffic update */
+#define CMD_ROUTE_FIELDS  (CMD_F_USER_ID | CMD_F_CAR_ID | CMD_F_TIMESTAMP | \
+                           CMD_F_START_NODE | CMD_F_DESTINATION_NODE)
+#define CMD_UPDATE_FIELDS (CMD_F_USER_ID | CMD_F_CAR_ID | CMD_F_TIMESTAMP | \
+                           CMD_F_EDGE_ID | CMD_F_POSITION | CMD_F_SPEED)
+
+/* Nesting accepted inside values of unknown fields */
+#define CMD_JSON_MAX_DEPTH 16
+
+typedef enum {
+    CMD_NONE = 0,
+    CMD_ROUTE,
+    CMD_UPDATE
+} CommandKind;
+
+typedef enum {
+    CMD_OK = 0,
+    CMD_ERR_SYNTAX,         /* not a well-formed JSON object */
+    CMD_ERR_TOO_DEEP,       /* nesting beyond CMD_JSON_MAX_DEPTH */
+    CMD_ERR_BAD_VALUE,      /* known field of the wrong type (e.g. 1.5 for an id) */
+    CMD_ERR_RANGE,          /* integer field out of range */
+    CMD_ERR_DUPLICATE,      /* known field given twice */
+    CMD_ERR_MISSING,        /* looks like a route / update but lacks a field */
+    CMD_ERR_UNKNOWN         /* neither a route nor an update */
+} CommandError;
+
+/*
+ * A JSON command line, filled by one pass over the text. Fields that
+ * were not present keep unspecified values; check fields first. Unknown
+ * keys are skipped, whatever their value.
+ */
+typedef struct {
+    CommandKind kind;
+    unsigned int fields;        /* CMD_F_* seen so far */
+
+    long long req_id;
+    int user_id;
+    int car_id;
+    double timestamp;
+
+    int start_node;
+    int destination_node;
+
+    int edge_id;
+    double position_on_edge;
+    double speed;
+
+    /* set when parsing fails */
+    const char* error_field;    /* field the error is about, or NULL */
+    size_t error_pos;           /* byte offset where parsing stopped */
+} JsonCommand;
+
+/*
+ * Parses one command object from line[0, len). Walks the text once and
+ * does not allocate. line[len] must be readable and must not continue a
+ * number (the line's NUL or newline is fine). On success cmd->kind says
+ * which command it is. On failure cmd still holds the fields read before
+ * the error (so a req_id can be echoed) and error_field/error_pos locate
+ * the problem.
+ */
+CommandError command_parse_json(const char* line, size_t len, JsonCommand* cmd);
+
+/* Wire name of an error, e.g. "BAD_VALUE" */
+const char* command_error_code(CommandError err);
+
+#endif
@@ -10,17 +10,32 @@ void graph_init(Graph* g, int num_nodes, int num_edges)
         exit(1);
     }
 
-    if (num_nodes > MAX_NODES) {
-        fprintf(stderr, "graph_init: num_nodes exceeds MAX_NODES\n");
+    if (num_nodes < 0 || num_nodes > GRAPH_MAX_COUNT ||
+        num_edges < 0 || num_edges > GRAPH_MAX_COUNT) {
+        fprintf(stderr, "graph_init: invalid graph size (%d nodes, %d edges)\n",
+                num_nodes, num_edges);
         exit(1);
     }
 
     g->num_nodes = num_nodes;
     g->num_edges = num_edges;
 
+    /* Neutral until graph_compute_stats() runs */
+    g->stats.max_speed = 0.0;
+    g->stats.time_scale = 1.0;
+    g->stats.min_x = g->stats.min_y = g->stats.max_x = g->stats.max_y = 0.0;
+    g->stats.min_time_ratio = 1.0;
+
+    /* Allocate node table sized to the actual graph */
+    g->nodes = (Node*)malloc(sizeof(Node) * (size_t)(num_nodes > 0 ? num_nodes : 1));
+    if (!g->nodes) {
+        fprintf(stderr, "graph_init: failed to allocate nodes array\n");
+        exit(1);
+    }
+
     /* Allocate global edge table */
     if (num_edges > 0) {
-    g->edges = (Edge*)malloc(sizeof(Edge) * num_edges);
+    g->edges = (Edge*)malloc(sizeof(Edge) * (size_t)num_edges);
     if (!g->edges) {
         fprintf(stderr, "graph_init: failed to allocate edges array\n");
         exit(1);
@@ -29,12 +44,25 @@ void graph_init(Graph* g, int num_nodes, int num_edges)
         g->edges = NULL;
     }
 
+    /* Mark every edge as not loaded yet (checked by graph_build_csr) */
+    for (int i = 0; i < num_edges; i++) {
+        g->edges[i].from_node = -1;
+    }
+
+    /* Adjacency is built once all edges are known */
+    g->out_offsets = NULL;
+    g->out_targets = NULL;
+    g->out_weights = NULL;
+    g->out_edge_ids = NULL;
+    g->edge_slot = NULL;
+    g->in_offsets = NULL;
+    g->in_sources = NULL;
+    g->in_slots = NULL;
+
     /* Initialize nodes */
     for (int i = 0; i < num_nodes; i++) {
-        g->nodes[i].node_id = i;
         g->nodes[i].x = 0.0;
         g->nodes[i].y = 0.0;
-        g->nodes[i].out_edges = NULL;
     }
 }
 
@@ -83,30 +111,92 @@ void graph_add_edge(Graph* g,
     /* Initialize global edge */
     Edge* e = &g->edges[edge_id];
 
-    e->edge_id = edge_id;
     e->from_node = from;
     e->to_node = to;
 
     e->base_length = length;
     e->base_speed_limit = speed_limit;
+}
 
-    /* Initial travel time */
-    e->current_travel_time = length / speed_limit;
 
-    /* Initialize historical stats */
-    e->ema_travel_time = e->current_travel_time;
-    e->observation_count = 0;
+void graph_build_csr(Graph* g)
+{
+    if (!g) {
+        fprintf(stderr, "graph_build_csr: graph is NULL\n");
+        exit(1);
+    }
 
-    /* Add edge_id to adjacency list of 'from' node */
-    EdgeNode* node = (EdgeNode*)malloc(sizeof(EdgeNode));
-    if (!node) {
-        fprintf(stderr, "graph_add_edge: malloc failed\n");
+    int V = g->num_nodes;
+    int E = g->num_edges;
+
+    g->out_offsets  = (int*)calloc((size_t)V + 1, sizeof(int));
+    g->out_targets  = (int*)malloc(sizeof(int) * (size_t)(E > 0 ? E : 1));
+    g->out_weights  = (double*)malloc(sizeof(double) * (size_t)(E > 0 ? E : 1));
+    g->out_edge_ids = (int*)malloc(sizeof(int) * (size_t)(E > 0 ? E : 1));
+    g->edge_slot    = (int*)malloc(sizeof(int) * (size_t)(E > 0 ? E : 1));
+    g->in_offsets   = (int*)calloc((size_t)V + 1, sizeof(int));
+    g->in_sources   = (int*)malloc(sizeof(int) * (size_t)(E > 0 ? E : 1));
+    g->in_slots     = (int*)malloc(sizeof(int) * (size_t)(E > 0 ? E : 1));
+
+    if (!g->out_offsets || !g->out_targets || !g->out_weights ||
+        !g->out_edge_ids || !g->edge_slot ||
+        !g->in_offsets || !g->in_sources || !g->in_slots) {
+        fprintf(stderr, "graph_build_csr: failed to allocate adjacency\n");
         exit(1);
     }
 
-    node->edge_id = edge_id;
-    node->next = g->nodes[from].out_edges;
-    g->nodes[from].out_edges = node;
+    /* Count out-degree of every node (shifted by one for the prefix sum) */
+    for (int i = 0; i < E; i++) {
+        int from = g->edges[i].from_node;
+        if (from < 0 || from >= V) {
+            fprintf(stderr, "graph_build_csr: edge %d was never added\n", i);
+            exit(1);
+        }
+        g->out_offsets[from + 1]++;
+    }
+
+    for (int u = 0; u < V; u++) {
+        g->out_offsets[u + 1] += g->out_offsets[u];
+    }
+
+    /* Scatter edges into their slots; out_offsets[u] is used as the
+       insertion cursor and shifted back afterwards */
+    for (int i = 0; i < E; i++) {
+        const Edge* e = &g->edges[i];
+        int slot = g->out_offsets[e->from_node]++;
+
+        g->out_targets[slot]  = e->to_node;
+        g->out_weights[slot]  = e->base_length / e->base_speed_limit; /* initial travel time */
+        g->out_edge_ids[slot] = i;
+        g->edge_slot[i] = slot;
+    }
+
+    for (int u = V; u > 0; u--) {
+        g->out_offsets[u] = g->out_offsets[u - 1];
+    }
+    g->out_offsets[0] = 0;
+
+    /* Same counting sort keyed by to_node for the incoming index */
+    for (int i = 0; i < E; i++) {
+        g->in_offsets[g->edges[i].to_node + 1]++;
+    }
+
+    for (int v = 0; v < V; v++) {
+        g->in_offsets[v + 1] += g->in_offsets[v];
+    }
+
+    for (int u = 0; u < V; u++) {
+        for (int slot = g->out_offsets[u]; slot < g->out_offsets[u + 1]; slot++) {
+            int pos = g->in_offsets[g->out_targets[slot]]++;
+            g->in_sources[pos] = u;
+            g->in_slots[pos] = slot;
+        }
+    }
+
+    for (int v = V; v > 0; v--) {
+        g->in_offsets[v] = g->in_offsets[v - 1];
+    }
+    g->in_offsets[0] = 0;
 }
 
 
@@ -117,7 +207,84 @@ double get_edge_weight(Graph* g, int edge_id)
         exit(1);
     }
 
-    return g->edges[edge_id].current_travel_time;
+    return g->out_weights[g->edge_slot[edge_id]];
+}
+
+
+/*
+ * Loosens st so that it also bounds edge e at travel time t. Edges
+ * without a positive length, speed limit and time carry no speed
+ * information (a zero-length edge would give 0/0) and are skipped.
+ */
+static void stats_fold_weight(GraphStats* st, const Edge* e, double t)
+{
+    if (!(e->base_length > 0.0 && t > 0.0)) return;
+
+    double speed = e->base_length / t;
+    if (speed > st->max_speed) {
+        st->max_speed = speed;
+        st->time_scale = 1.0 / speed;
+    }
+    if (e->base_speed_limit > 0.0) {
+        double ratio = t * e->base_speed_limit / e->base_length;
+        if (ratio < st->min_time_ratio) st->min_time_ratio = ratio;
+    }
+}
+
+void graph_set_travel_time(Graph* g, int edge_id, double travel_time)
+{
+    if (!g || edge_id < 0 || edge_id >= g->num_edges) {
+        fprintf(stderr, "graph_set_travel_time: invalid edge_id\n");
+        exit(1);
+    }
+
+    g->out_weights[g->edge_slot[edge_id]] = travel_time;
+
+    /* Bounds only loosen here, so they stay valid for every weight set
+       so far; graph_compute_stats tightens them again */
+    stats_fold_weight(&g->stats, &g->edges[edge_id], travel_time);
+}
+
+void graph_compute_stats(Graph* g)
+{
+    if (!g) {
+        fprintf(stderr, "graph_compute_stats: graph is NULL\n");
+        exit(1);
+    }
+
+    GraphStats* st = &g->stats;
+    st->max_speed = 0.0;
+    st->min_time_ratio = 1.0;
+    st->min_x = st->min_y = st->max_x = st->max_y = 0.0;
+
+    for (int i = 0; i < g->num_edges; i++) {
+        const Edge* e = &g->edges[i];
+        if (e->base_speed_limit > st->max_speed) {
+            st->max_speed = e->base_speed_limit;
+        }
+    }
+    st->time_scale = st->max_speed > 0.0 ? 1.0 / st->max_speed : 1.0;
+
+    /* Weights may already differ from free flow (live traffic); the
+       bounds are those of the current weights, so a report that was
+       later overridden no longer loosens them */
+    if (g->out_weights) {
+        for (int i = 0; i < g->num_edges; i++) {
+            stats_fold_weight(st, &g->edges[i], g->out_weights[g->edge_slot[i]]);
+        }
+    }
+
+    if (g->num_nodes > 0) {
+        st->min_x = st->max_x = g->nodes[0].x;
+        st->min_y = st->max_y = g->nodes[0].y;
+    }
+    for (int v = 1; v < g->num_nodes; v++) {
+        const Node* n = &g->nodes[v];
+        if (n->x < st->min_x) st->min_x = n->x;
+        if (n->x > st->max_x) st->max_x = n->x;
+        if (n->y < st->min_y) st->min_y = n->y;
+        if (n->y > st->max_y) st->max_y = n->y;
+    }
 }
 
 
@@ -132,22 +299,10 @@ double heuristic(Graph* g, int from_node, int to_node)
 
     double dx = g->nodes[from_node].x - g->nodes[to_node].x;
     double dy = g->nodes[from_node].y - g->nodes[to_node].y;
-    double straight_dist = sqrt(dx * dx + dy * dy);
 
-    /* Use a time-based admissible heuristic: straight-line distance / max speed */
-    double max_speed = 0.0;
-    for (int i = 0; i < g->num_edges; i++) {
-        if (g->edges && g->edges[i].base_speed_limit > max_speed) {
-            max_speed = g->edges[i].base_speed_limit;
-        }
-    }
-
-    if (max_speed > 0.0) {
-        return straight_dist / max_speed;
-    }
-
-    /* No speed info; fall back to distance */
-    return straight_dist;
+    /* Time-based admissible heuristic: straight-line distance / max speed
+       (plain distance when no speed is known, see GraphStats) */
+    return sqrt(dx * dx + dy * dy) * g->stats.time_scale;
 }
 
 
@@ -155,16 +310,26 @@ void graph_free(Graph* g)
 {
     if (!g) return;
 
-    for (int i = 0; i < g->num_nodes; i++) {
-        EdgeNode* curr = g->nodes[i].out_edges;
-        while (curr) {
-            EdgeNode* tmp = curr;
-            curr = curr->next;
-            free(tmp);
-        }
-        g->nodes[i].out_edges = NULL;
-    }
+    free(g->out_offsets);
+    free(g->out_targets);
+    free(g->out_weights);
+    free(g->out_edge_ids);
+    free(g->edge_slot);
+    free(g->in_offsets);
+    free(g->in_sources);
+    free(g->in_slots);
+    g->in_offsets = NULL;
+    g->in_sources = NULL;
+    g->in_slots = NULL;
+    g->out_offsets = NULL;
+    g->out_targets = NULL;
+    g->out_weights = NULL;
+    g->out_edge_ids = NULL;
+    g->edge_slot = NULL;
 
     free(g->edges);
     g->edges = NULL;
+
+    free(g->nodes);
+    g->nodes = NULL;
 }
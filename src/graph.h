@@ -2,39 +2,76 @@
 #define GRAPH_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
-#define MAX_NODES 100000
+/* Node and edge ids are 32-bit end to end; counts from graph.meta must fit */
+#define GRAPH_MAX_COUNT (INT32_MAX - 1)
 
+/*
+ * Static description of an edge, indexed by edge_id. This is the cold side
+ * of the edge data: the routing loop only touches the packed CSR arrays
+ * below, and traffic statistics live in the TrafficTable (traffic.h).
+ */
 typedef struct {
-    int edge_id;
     int from_node;
     int to_node;
 
     double base_length;
     double base_speed_limit;
-
-    double current_travel_time;
-
-    // Historical statistics (for traffic updates / prediction)
-    double ema_travel_time;
-    int observation_count;
 } Edge;
 
-typedef struct EdgeNode {
-    int edge_id;
-    struct EdgeNode* next;
-} EdgeNode;
-
 typedef struct {
-    int node_id;
     double x;
     double y;
-    EdgeNode* out_edges;
 } Node;
 
+/*
+ * Graph-wide values derived from the node and edge tables, computed by
+ * graph_compute_stats() and kept valid by graph_set_travel_time(), so a
+ * heuristic evaluation is a few flops instead of a scan. Updates only
+ * loosen the bounds; rerunning graph_compute_stats over the current
+ * weights tightens them again.
+ */
+typedef struct {
+    double max_speed;       /* fastest speed limit or observed speed, 0 if none */
+    double time_scale;      /* 1 / max_speed: lower-bound time per unit of
+                               straight-line distance (1 when max_speed is 0) */
+    double min_x, min_y;    /* bounding box of the node coordinates */
+    double max_x, max_y;
+    double min_time_ratio;  /* smallest current / free-flow travel time ratio
+                               over all edges (1.0 until traffic reports an
+                               edge faster than its speed limit); bounds from
+                               free-flow times are scaled by it */
+} GraphStats;
+
 typedef struct {
-    Node nodes[MAX_NODES];
-    Edge* edges;
+    Node* nodes;        /* num_nodes entries, indexed by node_id */
+    Edge* edges;        /* num_edges entries, indexed by edge_id */
+
+    /* Compressed sparse row (CSR) adjacency, built by graph_build_csr().
+     * These parallel arrays are the routing-hot data.
+     * Out-edges of node u occupy slots [out_offsets[u], out_offsets[u+1]):
+     *   out_targets[slot]  - to_node of the edge
+     *   out_weights[slot]  - current travel time of the edge (the only
+     *                        copy; read it by edge_id via get_edge_weight)
+     *   out_edge_ids[slot] - global edge_id
+     * edge_slot[edge_id] maps an edge back to its CSR slot. */
+    int* out_offsets;
+    int* out_targets;
+    double* out_weights;
+    int* out_edge_ids;
+    int* edge_slot;
+
+    /* Incoming-edge index (reverse CSR) for backward searches.
+     * In-edges of node v occupy [in_offsets[v], in_offsets[v+1]):
+     *   in_sources[i] - from_node of the edge
+     *   in_slots[i]   - the edge's forward CSR slot (weight is
+     *                   out_weights[in_slots[i]], so there is one copy) */
+    int* in_offsets;
+    int* in_sources;
+    int* in_slots;
+
+    GraphStats stats;
 
     int num_nodes;
     int num_edges;
@@ -45,7 +82,13 @@ void graph_init(Graph* g, int num_nodes, int num_edges);
 void graph_add_edge(Graph* g, int edge_id, int from, int to,
                     double length, double speed_limit);
 
+void graph_build_csr(Graph* g);
+/* Recomputes g->stats from scratch over the current weights (the loader
+   calls it; the server reruns it periodically) */
+void graph_compute_stats(Graph* g);
+
 double get_edge_weight(Graph* g, int edge_id);
+void graph_set_travel_time(Graph* g, int edge_id, double travel_time);
 double heuristic(Graph* g, int from_node, int to_node);
 void graph_set_node_coordinates(Graph* g, int node_id, double x, double y);
 void graph_free(Graph* g);
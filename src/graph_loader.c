@@ -18,11 +18,11 @@ static int read_meta_counts(const char* meta_path, int* out_nodes, int* out_edge
         return 1;
     }
 
-    int num_nodes = -1, num_edges = -1;
+    long long num_nodes = -1, num_edges = -1;
     char key[64];
-    int val;
+    long long val;
 
-    while (fscanf(f, "%63s %d", key, &val) == 2) {
+    while (fscanf(f, "%63s %lld", key, &val) == 2) {
         if (strcmp(key, "num_nodes") == 0) num_nodes = val;
         else if (strcmp(key, "num_edges") == 0) num_edges = val;
         /* ignore unknown keys */
@@ -31,13 +31,19 @@ static int read_meta_counts(const char* meta_path, int* out_nodes, int* out_edge
     fclose(f);
 
     if (num_nodes <= 0 || num_edges < 0) {
-        fprintf(stderr, "ERROR: meta file missing/invalid counts (num_nodes=%d, num_edges=%d)\n",
+        fprintf(stderr, "ERROR: meta file missing/invalid counts (num_nodes=%lld, num_edges=%lld)\n",
                 num_nodes, num_edges);
         return 2;
     }
 
-    *out_nodes = num_nodes;
-    *out_edges = num_edges;
+    if (num_nodes > GRAPH_MAX_COUNT || num_edges > GRAPH_MAX_COUNT) {
+        fprintf(stderr, "ERROR: meta counts exceed 32-bit id range (num_nodes=%lld, num_edges=%lld)\n",
+                num_nodes, num_edges);
+        return 3;
+    }
+
+    *out_nodes = (int)num_nodes;
+    *out_edges = (int)num_edges;
     return 0;
 }
 
@@ -169,6 +175,10 @@ int graph_load_from_files(Graph* g,
         return 34;
     }
 
+    /* Pack adjacency into CSR form (outgoing + incoming) for routing */
+    graph_build_csr(g);
+    graph_compute_stats(g);
+
     return 0;
 }
 
@@ -1,10 +1,251 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
 #include "graph.h"
 #include "graph_loader.h"
+#include "ch.h"
+#include "cch.h"
+#include "alt.h"
 #include "server.h"
 
-int main(void) {
+/* Longest line accepted in a config file */
+#define CONFIG_LINE_MAX 1024
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [--config <file>] [options]\n"
+            "       %s --ch-build <file> [options]\n"
+            "Every option may also be set in the config file as 'name = value'\n"
+            "(name without the dashes); the command line takes precedence.\n"
+            "\n"
+            "Routing:\n"
+            "  --routing astar|bidir|ch|cch\n"
+            "  --heuristic euclid|alt guide A* with landmarks instead of straight-line distance\n"
+            "  --landmarks <file>     landmark distances (default <data-dir>/landmarks.bin,\n"
+            "                         computed and written there if missing or stale)\n"
+            "  --ch <file>            load a prebuilt contraction hierarchy\n"
+            "  --ch-build <file>      contract the graph, write the hierarchy and exit\n"
+            "  --cch-interval <ms>    re-customize the CCH with live weights this often\n"
+            "Graph:\n"
+            "  --data-dir <dir>       directory of graph.meta, nodes.csv, edges.csv (default data)\n"
+            "  --meta <file>  --nodes <file>  --edges <file>\n"
+            "                         override a single graph file\n"
+            "Server:\n"
+            "  --port <n>             TCP port (default 8080)\n"
+            "  --backlog <n>          pending connections per I/O thread's listener\n"
+            "                         (default 1024, capped by net.core.somaxconn)\n"
+            "  --io-threads <n>       event-loop threads (default 4)\n"
+            "  --routing-workers <n>  routing pool size (default 8)\n"
+            "  --traffic-workers <n>  traffic pool size, one edge shard each (default 2)\n"
+            "  --io-cpus <list>  --routing-cpus <list>  --traffic-cpus <list>\n"
+            "                         pin a pool to CPUs, e.g. 0-3,8 (default: unpinned)\n"
+            "Traffic:\n"
+            "  --publish-interval <ms>\n"
+            "                         publish traffic changes to routing this often (default 5)\n"
+            "  --traffic-batch <n>    apply up to n traffic updates together (default 64)\n"
+            "  --traffic-flush-us <us>\n"
+            "                         wait this long for a batch to fill (default 0: take\n"
+            "                         only what is already queued)\n"
+            "Load shedding:\n"
+            "  --routing-queue-limit <n>  --traffic-queue-limit <n>\n"
+            "                         commands queued per worker before new ones are\n"
+            "                         answered OVERLOADED (default 4096)\n"
+            "  --queue-deadline-ms <ms>\n"
+            "                         answer route requests that waited longer OVERLOADED\n"
+            "                         instead of routing them (default 0: never)\n",
+            prog, prog);
+}
+
+/* Everything main() takes from the command line or a config file */
+typedef struct {
+    ServerConfig cfg;
+    const char* ch_path;
+    const char* landmarks_path;     /* NULL: <data_dir>/landmarks.bin */
+    const char* data_dir;
+    const char* meta_path;          /* NULL: under data_dir */
+    const char* nodes_path;
+    const char* edges_path;
+} Options;
+
+/* Whole-string integer in [min, max]. 0 on success. */
+static int parse_int(const char* s, int min, int max, int* out) {
+    char* end = NULL;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || v < min || v > max) return 1;
+    *out = (int)v;
+    return 0;
+}
+
+/*
+ * Applies one option, name given without the leading dashes. value must
+ * outlive the Options. Returns 0 on success, 1 for an unknown name and 2
+ * for an invalid value.
+ */
+static int set_option(Options* o, const char* name, const char* value) {
+    ServerConfig* cfg = &o->cfg;
+
+    if (strcmp(name, "routing") == 0) {
+        return routing_mode_parse(value, &cfg->route_mode) == 0 ? 0 : 2;
+    } else if (strcmp(name, "heuristic") == 0) {
+        return routing_heuristic_parse(value, &cfg->heuristic) == 0 ? 0 : 2;
+    } else if (strcmp(name, "landmarks") == 0) {
+        o->landmarks_path = value;
+    } else if (strcmp(name, "ch") == 0) {
+        o->ch_path = value;
+    } else if (strcmp(name, "cch-interval") == 0) {
+        return parse_int(value, 1, INT_MAX, &cfg->cch_interval_ms) == 0 ? 0 : 2;
+    } else if (strcmp(name, "publish-interval") == 0) {
+        return parse_int(value, 1, INT_MAX, &cfg->publish_interval_ms) == 0 ? 0 : 2;
+    } else if (strcmp(name, "traffic-batch") == 0) {
+        return parse_int(value, 1, INT_MAX, &cfg->traffic_batch) == 0 ? 0 : 2;
+    } else if (strcmp(name, "traffic-flush-us") == 0) {
+        return parse_int(value, 0, INT_MAX, &cfg->traffic_flush_us) == 0 ? 0 : 2;
+    } else if (strcmp(name, "routing-queue-limit") == 0) {
+        return parse_int(value, 1, SERVER_QUEUE_LIMIT_MAX, &cfg->routing_queue_limit) == 0 ? 0 : 2;
+    } else if (strcmp(name, "traffic-queue-limit") == 0) {
+        return parse_int(value, 1, SERVER_QUEUE_LIMIT_MAX, &cfg->traffic_queue_limit) == 0 ? 0 : 2;
+    } else if (strcmp(name, "queue-deadline-ms") == 0) {
+        return parse_int(value, 0, INT_MAX / 1000, &cfg->queue_deadline_ms) == 0 ? 0 : 2;
+    } else if (strcmp(name, "data-dir") == 0) {
+        o->data_dir = value;
+    } else if (strcmp(name, "meta") == 0) {
+        o->meta_path = value;
+    } else if (strcmp(name, "nodes") == 0) {
+        o->nodes_path = value;
+    } else if (strcmp(name, "edges") == 0) {
+        o->edges_path = value;
+    } else if (strcmp(name, "port") == 0) {
+        return parse_int(value, 1, 65535, &cfg->port) == 0 ? 0 : 2;
+    } else if (strcmp(name, "backlog") == 0) {
+        return parse_int(value, 1, SERVER_BACKLOG_MAX, &cfg->backlog) == 0 ? 0 : 2;
+    } else if (strcmp(name, "io-threads") == 0) {
+        return parse_int(value, 1, SERVER_THREADS_MAX, &cfg->io_threads) == 0 ? 0 : 2;
+    } else if (strcmp(name, "routing-workers") == 0) {
+        return parse_int(value, 1, SERVER_THREADS_MAX, &cfg->routing_workers) == 0 ? 0 : 2;
+    } else if (strcmp(name, "traffic-workers") == 0) {
+        return parse_int(value, 1, SERVER_THREADS_MAX, &cfg->traffic_workers) == 0 ? 0 : 2;
+    } else if (strcmp(name, "io-cpus") == 0) {
+        cfg->io_cpus = value;
+    } else if (strcmp(name, "routing-cpus") == 0) {
+        cfg->routing_cpus = value;
+    } else if (strcmp(name, "traffic-cpus") == 0) {
+        cfg->traffic_cpus = value;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+static char* trim(char* s) {
+    while (isspace((unsigned char)*s)) s++;
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n - 1])) s[--n] = '\0';
+    return s;
+}
+
+/*
+ * Reads 'name = value' lines ('#' starts a comment) into o. Values are
+ * copied and kept for the life of the process. 0 on success; errors are
+ * reported with the file and line.
+ */
+static int load_config(Options* o, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+
+    char line[CONFIG_LINE_MAX];
+    int lineno = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char* text = trim(line);
+        if (*text == '\0') continue;
+
+        char* eq = strchr(text, '=');
+        if (!eq) {
+            fprintf(stderr, "%s:%d: expected 'name = value'\n", path, lineno);
+            rc = 1;
+            break;
+        }
+        *eq = '\0';
+        char* name = trim(text);
+        char* value = strdup(trim(eq + 1));
+        if (!value) {
+            fprintf(stderr, "%s:%d: out of memory\n", path, lineno);
+            rc = 1;
+            break;
+        }
+
+        int r = set_option(o, name, value);
+        if (r == 1) fprintf(stderr, "%s:%d: unknown option '%s'\n", path, lineno, name);
+        if (r == 2) fprintf(stderr, "%s:%d: invalid value '%s' for %s\n", path, lineno, value, name);
+        if (r != 0) rc = 1;
+    }
+    fclose(f);
+    return rc;
+}
+
+/* Path under the data directory unless one was given explicitly */
+static const char* data_path(char* buf, size_t cap, const char* given,
+                             const char* dir, const char* file) {
+    if (given) return given;
+    snprintf(buf, cap, "%s/%s", dir, file);
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    memset(&opt, 0, sizeof(opt));
+    server_config_defaults(&opt.cfg);
+    opt.data_dir = "data";
+
+    const char* ch_build_path = NULL;
+
+    /* The config file first, so command-line options override it */
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--config") == 0) {
+            if (load_config(&opt, argv[i + 1]) != 0) return 2;
+            break;
+        }
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0 || i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        const char* name = argv[i] + 2;
+        const char* value = argv[++i];
+
+        if (strcmp(name, "config") == 0) continue;
+        if (strcmp(name, "ch-build") == 0) {
+            ch_build_path = value;
+            continue;
+        }
+
+        int r = set_option(&opt, name, value);
+        if (r != 0) {
+            if (r == 2) fprintf(stderr, "Invalid value '%s' for --%s\n", value, name);
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    char meta_buf[PATH_MAX], nodes_buf[PATH_MAX], edges_buf[PATH_MAX], landmarks_buf[PATH_MAX];
+    const char* meta_path = data_path(meta_buf, sizeof(meta_buf), opt.meta_path, opt.data_dir, "graph.meta");
+    const char* nodes_path = data_path(nodes_buf, sizeof(nodes_buf), opt.nodes_path, opt.data_dir, "nodes.csv");
+    const char* edges_path = data_path(edges_buf, sizeof(edges_buf), opt.edges_path, opt.data_dir, "edges.csv");
+    const char* landmarks_path = data_path(landmarks_buf, sizeof(landmarks_buf), opt.landmarks_path,
+                                           opt.data_dir, "landmarks.bin");
+    ServerConfig cfg = opt.cfg;
+
     Graph* g = (Graph*)malloc(sizeof(Graph));
     if (!g) {
         fprintf(stderr, "Failed to allocate graph\n");
@@ -12,16 +253,86 @@ int main(void) {
     }
 
     printf("MAIN: loading graph...\n");
-    int rc = graph_load_from_files(g, "data/graph.meta", "data/nodes.csv", "data/edges.csv");
+    int rc = graph_load_from_files(g, meta_path, nodes_path, edges_path);
     if (rc != 0) {
         fprintf(stderr, "Failed to load graph (rc=%d)\n", rc);
         free(g);
         return 1;
     }
 
-    /* starts server on port 8080 */
-    rc = server_run(g, 8080);
+    ContractionHierarchy ch;
+    memset(&ch, 0, sizeof(ch));
+    CustomizableCH cch;
+    memset(&cch, 0, sizeof(cch));
+    Landmarks landmarks;
+    memset(&landmarks, 0, sizeof(landmarks));
+
+    if (ch_build_path) {
+        /* Offline preprocessing: contract, persist, exit */
+        printf("MAIN: building contraction hierarchy...\n");
+        rc = ch_build(&ch, g);
+        if (rc == 0) rc = ch_save(&ch, ch_build_path);
+        if (rc != 0) fprintf(stderr, "Failed to build hierarchy (rc=%d)\n", rc);
+        ch_free(&ch);
+        graph_free(g);
+        free(g);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (cfg.route_mode == ROUTE_MODE_CH) {
+        if (opt.ch_path) {
+            printf("MAIN: loading contraction hierarchy...\n");
+            rc = ch_load(&ch, g, opt.ch_path);
+        } else {
+            printf("MAIN: no --ch file given, building contraction hierarchy...\n");
+            rc = ch_build(&ch, g);
+        }
+        if (rc != 0) {
+            fprintf(stderr, "Failed to prepare hierarchy (rc=%d)\n", rc);
+            graph_free(g);
+            free(g);
+            return 1;
+        }
+        cfg.ch = &ch;
+    }
+
+    if (cfg.heuristic == ROUTE_HEURISTIC_ALT) {
+        printf("MAIN: loading landmarks...\n");
+        rc = alt_load(&landmarks, g, landmarks_path);
+        if (rc != 0) {
+            printf("MAIN: selecting %d landmarks...\n", ALT_DEFAULT_LANDMARKS);
+            rc = alt_build(&landmarks, g, ALT_DEFAULT_LANDMARKS, ALT_SELECT_AVOID);
+            if (rc == 0 && alt_save(&landmarks, landmarks_path) != 0) {
+                fprintf(stderr, "Warning: landmarks not persisted to %s\n", landmarks_path);
+            }
+        }
+        if (rc != 0) {
+            fprintf(stderr, "Failed to prepare landmarks (rc=%d)\n", rc);
+            graph_free(g);
+            free(g);
+            return 1;
+        }
+        cfg.landmarks = &landmarks;
+    }
+
+    if (cfg.route_mode == ROUTE_MODE_CCH) {
+        /* Topology-only preprocessing; weights are customized at runtime */
+        printf("MAIN: building customizable contraction hierarchy...\n");
+        rc = cch_build(&cch, g, 0);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to prepare customizable hierarchy (rc=%d)\n", rc);
+            graph_free(g);
+            free(g);
+            return 1;
+        }
+        cfg.cch = &cch;
+    }
+
+    rc = server_run(g, &cfg);
 
+    ch_free(&ch);
+    if (cfg.cch) cch_free(&cch);
+    alt_free(&landmarks);
     graph_free(g);
     free(g);
     return rc;
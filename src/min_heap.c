@@ -2,100 +2,130 @@
 #include <stdlib.h>
 #include "min_heap.h"
 
-MinHeap* createMinHeap(int capacity) {
+MinHeap* createMinHeap(int capacity, int arity) {
+    if (capacity < 0 || arity < 2) return NULL;
+
     MinHeap* minHeap = (MinHeap*) malloc(sizeof(MinHeap));
-    minHeap->pos = (int *)malloc(capacity * sizeof(int));
+    if (!minHeap) return NULL;
     minHeap->size = 0;
     minHeap->capacity = capacity;
-    minHeap->array = (MinHeapNode**) malloc(capacity * sizeof(MinHeapNode*));
-    return minHeap;
-}
-
+    minHeap->arity = arity;
+    minHeap->pos = (int *)malloc((size_t)(capacity > 0 ? capacity : 1) * sizeof(int));
+    minHeap->array = (MinHeapNode*) malloc((size_t)(capacity > 0 ? capacity : 1) * sizeof(MinHeapNode));
+    if (!minHeap->pos || !minHeap->array) {
+        freeMinHeap(minHeap);
+        return NULL;
+    }
 
-MinHeapNode* newMinHeapNode(int node_id, double dist) {
-    MinHeapNode* minHeapNode = (MinHeapNode*) malloc(sizeof(MinHeapNode));
-    minHeapNode->node_id = node_id;
-    minHeapNode->dist = dist;
-    return minHeapNode;
+    for (int i = 0; i < capacity; i++) {
+        minHeap->pos[i] = -1;
+    }
+    return minHeap;
 }
 
-void swapMinHeapNode(MinHeapNode** a, MinHeapNode** b) {
-    MinHeapNode* t = *a;
-    *a = *b;
-    *b = t;
+/* Move entry up from index i; the entry is held aside and written once */
+static void siftUp(MinHeap* minHeap, int i, MinHeapNode node) {
+    const int d = minHeap->arity;
+    MinHeapNode* a = minHeap->array;
+
+    while (i > 0) {
+        int parent = (i - 1) / d;
+        if (!(node.dist < a[parent].dist)) break;
+        a[i] = a[parent];
+        minHeap->pos[a[i].node_id] = i;
+        i = parent;
+    }
+    a[i] = node;
+    minHeap->pos[node.node_id] = i;
 }
 
-void minHeapify(MinHeap* minHeap, int idx) {
-    int smallest = idx;
-    int left = 2 * idx + 1;
-    int right = 2 * idx + 2;
-
-    if (left < minHeap->size &&
-        minHeap->array[left]->dist < minHeap->array[smallest]->dist)
-        smallest = left;
+/* Move entry down from index i (iterative) */
+static void siftDown(MinHeap* minHeap, int i, MinHeapNode node) {
+    const int d = minHeap->arity;
+    const int n = minHeap->size;
+    MinHeapNode* a = minHeap->array;
 
-    if (right < minHeap->size &&
-        minHeap->array[right]->dist < minHeap->array[smallest]->dist)
-        smallest = right;
+    while (1) {
+        int first = d * i + 1;
+        if (first >= n) break;
 
-    if (smallest != idx) {
-        MinHeapNode *smallestNode = minHeap->array[smallest];
-        MinHeapNode *idxNode = minHeap->array[idx];
+        int last = first + d;
+        if (last > n) last = n;
 
-        minHeap->pos[smallestNode->node_id] = idx;
-        minHeap->pos[idxNode->node_id] = smallest;
+        int smallest = first;
+        for (int c = first + 1; c < last; c++) {
+            if (a[c].dist < a[smallest].dist) smallest = c;
+        }
 
-        swapMinHeapNode(&minHeap->array[smallest], &minHeap->array[idx]);
-
-        minHeapify(minHeap, smallest);
+        if (!(a[smallest].dist < node.dist)) break;
+        a[i] = a[smallest];
+        minHeap->pos[a[i].node_id] = i;
+        i = smallest;
     }
+    a[i] = node;
+    minHeap->pos[node.node_id] = i;
 }
 
 int isEmpty(MinHeap* minHeap) {
     return minHeap->size == 0;
 }
 
-MinHeapNode* extractMin(MinHeap* minHeap) {
+int extractMin(MinHeap* minHeap, double* out_dist) {
     if (isEmpty(minHeap))
-        return NULL;
-
-    MinHeapNode* root = minHeap->array[0];
+        return -1;
 
-    MinHeapNode* lastNode = minHeap->array[minHeap->size - 1];
-    minHeap->array[0] = lastNode;
-
-    minHeap->pos[root->node_id] = minHeap->size - 1;
-    minHeap->pos[lastNode->node_id] = 0;
+    MinHeapNode root = minHeap->array[0];
+    minHeap->pos[root.node_id] = -1;
 
     minHeap->size--;
-    minHeapify(minHeap, 0);
+    if (minHeap->size > 0) {
+        siftDown(minHeap, 0, minHeap->array[minHeap->size]);
+    }
 
-    return root;
+    if (out_dist) *out_dist = root.dist;
+    return root.node_id;
 }
 
-void decreaseKey(MinHeap* minHeap, int node_id, double dist) {
-    int i = minHeap->pos[node_id]; 
-
-    minHeap->array[i]->dist = dist;
-
-    while (i && minHeap->array[i]->dist < minHeap->array[(i - 1) / 2]->dist) {
-        minHeap->pos[minHeap->array[i]->node_id] = (i - 1) / 2;
-        minHeap->pos[minHeap->array[(i - 1) / 2]->node_id] = i;
+void insertMinHeap(MinHeap* minHeap, int node_id, double dist) {
+    MinHeapNode node;
+    node.dist = dist;
+    node.node_id = node_id;
+    siftUp(minHeap, minHeap->size++, node);
+}
 
-        swapMinHeapNode(&minHeap->array[i], &minHeap->array[(i - 1) / 2]);
+void decreaseKey(MinHeap* minHeap, int node_id, double dist) {
+    int i = minHeap->pos[node_id];
+    MinHeapNode node = minHeap->array[i];
+    node.dist = dist;
+    siftUp(minHeap, i, node);
+}
 
-        i = (i - 1) / 2;
+void updateKey(MinHeap* minHeap, int node_id, double dist) {
+    int i = minHeap->pos[node_id];
+    MinHeapNode node = minHeap->array[i];
+    double old = node.dist;
+    node.dist = dist;
+    if (dist < old) {
+        siftUp(minHeap, i, node);
+    } else {
+        siftDown(minHeap, i, node);
     }
 }
 
 int isInMinHeap(MinHeap *minHeap, int node_id) {
-    if (minHeap->pos[node_id] < minHeap->size)
-        return 1;
-    return 0;
+    return minHeap->pos[node_id] >= 0;
+}
+
+void clearMinHeap(MinHeap* minHeap) {
+    for (int i = 0; i < minHeap->size; i++) {
+        minHeap->pos[minHeap->array[i].node_id] = -1;
+    }
+    minHeap->size = 0;
 }
 
 void freeMinHeap(MinHeap* minHeap) {
+    if (!minHeap) return;
     free(minHeap->pos);
     free(minHeap->array);
     free(minHeap);
-}
\ No newline at end of file
+}
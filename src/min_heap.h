@@ -1,27 +1,45 @@
 #ifndef MIN_HEAP_H
 #define MIN_HEAP_H
 
+/* Default branching factor; 4-ary keeps a node's children in one cache line */
+#ifndef MIN_HEAP_DEFAULT_ARITY
+#define MIN_HEAP_DEFAULT_ARITY 4
+#endif
+
+/* Heap entry: key and id stored inline, no per-node allocation */
 typedef struct {
+    double dist;
     int node_id;
-    double dist; 
 } MinHeapNode;
 
+/*
+ * Indexed d-ary min-heap over node ids [0, capacity). Nodes are inserted
+ * lazily as they are discovered; pos[] tracks where each queued node sits
+ * so decreaseKey/isInMinHeap are O(1) lookups.
+ */
 typedef struct {
     int capacity;    
     int size;        
-    int *pos;        // position of each node in the heap
-    MinHeapNode **array; 
+    int arity;       // children per node (2 = binary, 4 = 4-ary)
+    int *pos;        // heap index of each node_id, -1 if not queued
+    MinHeapNode *array; 
 } MinHeap;
 
 
-MinHeap* createMinHeap(int capacity);
-MinHeapNode* newMinHeapNode(int node_id, double dist);
-void swapMinHeapNode(MinHeapNode** a, MinHeapNode** b);
-void minHeapify(MinHeap* minHeap, int idx);
+/* Returns NULL on allocation failure or arity < 2. */
+MinHeap* createMinHeap(int capacity, int arity);
 int isEmpty(MinHeap* minHeap);
-MinHeapNode* extractMin(MinHeap* minHeap);
+/* Removes the minimum; returns its node_id (-1 if empty), key in *out_dist */
+int extractMin(MinHeap* minHeap, double* out_dist);
+/* Queues node_id, which must not already be in the heap */
+void insertMinHeap(MinHeap* minHeap, int node_id, double dist);
+/* Lowers the key of a queued node_id */
 void decreaseKey(MinHeap* minHeap, int node_id, double dist);
+/* Sets the key of a queued node_id, moving it up or down as needed */
+void updateKey(MinHeap* minHeap, int node_id, double dist);
 int isInMinHeap(MinHeap *minHeap, int node_id);
+/* Empties the heap in O(size) */
+void clearMinHeap(MinHeap* minHeap);
 void freeMinHeap(MinHeap* minHeap);
 
-#endif
\ No newline at end of file
+#endif
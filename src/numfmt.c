@@ -0,0 +1,87 @@
+#include "numfmt.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Writes u right-aligned so that it ends at end; returns its first byte */
+static char* put_digits_back(char* end, uint64_t u) {
+    while (u >= 100) {
+        unsigned int r = (unsigned int)(u % 100);
+        u /= 100;
+        end -= 2;
+        memcpy(end, DIGIT_PAIRS + r * 2, 2);
+    }
+    if (u >= 10) {
+        end -= 2;
+        memcpy(end, DIGIT_PAIRS + u * 2, 2);
+    } else {
+        *--end = (char)('0' + u);
+    }
+    return end;
+}
+
+static char* put_uint(char* out, uint64_t u) {
+    char tmp[NUMFMT_INT_MAX];
+    char* start = put_digits_back(tmp + sizeof(tmp), u);
+    size_t n = (size_t)(tmp + sizeof(tmp) - start);
+    memcpy(out, start, n);
+    return out + n;
+}
+
+char* fmt_int(char* out, long long v) {
+    uint64_t u = (uint64_t)v;
+    if (v < 0) {
+        *out++ = '-';
+        u = 0 - u; /* also right for LLONG_MIN */
+    }
+    return put_uint(out, u);
+}
+
+char* fmt_fixed(char* out, double v, int decimals) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+    };
+
+    if (decimals < 0 || decimals > NUMFMT_DECIMALS_MAX) return NULL;
+    if (!(fabs(v) < 1e15)) return NULL; /* also NaN */
+
+    /* Below 2^53 the integer part and the fraction are exact; scaling the
+       fraction rounds once, by far less than the margin kept around .5,
+       so the side of the tie is the same as for the exact value */
+    double a = fabs(v);
+    double whole = floor(a);
+    double scaled = (a - whole) * pow10[decimals];
+    double lower = floor(scaled);
+    double rest = scaled - lower;
+    if (fabs(rest - 0.5) < 1e-6) return NULL;
+
+    uint64_t ip = (uint64_t)whole;
+    uint64_t frac = (uint64_t)lower + (rest > 0.5);
+    if (frac == (uint64_t)pow10[decimals]) {
+        ip++;
+        frac = 0;
+    }
+
+    if (signbit(v)) *out++ = '-';
+    out = put_uint(out, ip);
+    if (decimals > 0) {
+        *out++ = '.';
+        memset(out, '0', (size_t)decimals); /* leading zeros of the fraction */
+        put_digits_back(out + decimals, frac);
+        out += decimals;
+    }
+    return out;
+}
@@ -0,0 +1,29 @@
+#ifndef NUMFMT_H
+#define NUMFMT_H
+
+/*
+ * Number formatting for replies, without printf's format parsing and
+ * locale lookups. Output is what printf would produce; nothing is
+ * NUL-terminated.
+ */
+
+/* Longest output of fmt_int, and of fmt_fixed when it succeeds */
+#define NUMFMT_INT_MAX   20
+#define NUMFMT_FIXED_MAX 32
+
+/* Most fraction digits fmt_fixed takes */
+#define NUMFMT_DECIMALS_MAX 9
+
+/* Writes v in decimal at out; returns the end of the output */
+char* fmt_int(char* out, long long v);
+
+/*
+ * Writes v with decimals fraction digits, as "%.*f" would. Returns the
+ * end of the output, or NULL without writing when v is outside the fast
+ * path (not finite, |v| >= 1e15, more than NUMFMT_DECIMALS_MAX digits,
+ * or too close to a rounding tie to settle in double arithmetic); the
+ * caller then falls back to snprintf.
+ */
+char* fmt_fixed(char* out, double v, int decimals);
+
+#endif
@@ -6,124 +6,267 @@
 #include "graph.h"
 #include "min_heap.h"
 #include "routing.h"
+#include "alt.h"
 
-/*
-// heuristic is on Euclidean distance
-double get_heuristic(Node* a, Node* b) {
-    return sqrt(pow(a->x - b->x, 2) + pow(a->y - b->y, 2));
+static int search_space_init(SearchSpace* sp, int num_nodes)
+{
+    sp->seen        = (unsigned int*)calloc((size_t)num_nodes, sizeof(unsigned int));
+    sp->g_score     = (double*)malloc(sizeof(double) * (size_t)num_nodes);
+    sp->parent_slot = (int*)malloc(sizeof(int) * (size_t)num_nodes);
+    sp->heap        = createMinHeap(num_nodes, MIN_HEAP_DEFAULT_ARITY);
+
+    if (!sp->seen || !sp->g_score || !sp->parent_slot || !sp->heap) {
+        return 1;
+    }
+    return 0;
 }
 
-// finel print
-void print_path(int current_node, int* parent) {
-    if (current_node == -1) {
-        return;
+static void search_space_free(SearchSpace* sp)
+{
+    free(sp->seen);
+    free(sp->g_score);
+    free(sp->parent_slot);
+    freeMinHeap(sp->heap);
+    memset(sp, 0, sizeof(*sp));
+}
+
+int routing_workspace_init(RouteWorkspace* ws, int num_nodes)
+{
+    if (!ws || num_nodes <= 0) return 1;
+
+    memset(ws, 0, sizeof(*ws));
+    ws->num_nodes = num_nodes;
+    ws->generation = 0;
+
+    ws->path_cap   = 256;
+    ws->path_edges = (int*)malloc(sizeof(int) * (size_t)ws->path_cap);
+
+    if (search_space_init(&ws->fwd, num_nodes) != 0 || !ws->path_edges) {
+        routing_workspace_free(ws);
+        return 2;
     }
-    print_path(parent[current_node], parent);
-    printf("%d -> ", current_node);
+    return 0;
+}
+
+void routing_workspace_free(RouteWorkspace* ws)
+{
+    if (!ws) return;
+    search_space_free(&ws->fwd);
+    search_space_free(&ws->bwd);
+    free(ws->path_edges);
+    memset(ws, 0, sizeof(*ws));
 }
 
-// A* Search
-void find_route_a_star(Graph* graph, int start_id, int target_id) {
-    int V = graph->num_nodes;
-    
-    double* g_score = (double*)malloc(V * sizeof(double));
-    double* f_score = (double*)malloc(V * sizeof(double));
-    int* parent = (int*)malloc(V * sizeof(int));
-
-    MinHeap* minHeap = createMinHeap(V);
-
-    // initialize
-    for (int i = 0; i < V; i++) {
-        g_score[i] = DBL_MAX;
-        f_score[i] = DBL_MAX;
-        parent[i] = -1;
-        
-        // initialize each node to infinity
-        minHeap->array[i] = newMinHeapNode(i, DBL_MAX);
-        minHeap->pos[i] = i;
+int routing_workspace_set_heuristic(RouteWorkspace* ws, RouteHeuristic h,
+                                    const struct Landmarks* landmarks)
+{
+    if (!ws) return 1;
+    if (h == ROUTE_HEURISTIC_ALT &&
+        (!landmarks || landmarks->num_nodes != ws->num_nodes)) {
+        return 2;
     }
-    minHeap->size = V; 
+    ws->heuristic = h;
+    ws->landmarks = h == ROUTE_HEURISTIC_ALT ? landmarks : NULL;
+    return 0;
+}
 
-    //  start node
-    g_score[start_id] = 0.0;
-    f_score[start_id] = get_heuristic(&graph->nodes[start_id], &graph->nodes[target_id]);
-    decreaseKey(minHeap, start_id, f_score[start_id]);
+void routing_workspace_set_weights(RouteWorkspace* ws, const double* weights,
+                                   const GraphStats* stats)
+{
+    ws->weights = weights;
+    ws->stats = stats;
+}
 
-    printf("Starting A* Search from node %d to %d...\n", start_id, target_id);
+const double* routing_weights(const Graph* g, const RouteWorkspace* ws)
+{
+    return ws->weights ? ws->weights : g->out_weights;
+}
 
-    while (!isEmpty(minHeap)) {
-        // extractMin
-        MinHeapNode* minNode = extractMin(minHeap);
-        int u = minNode->node_id;
+int routing_mode_parse(const char* name, RouteMode* out)
+{
+    if (!name || !out) return 1;
+    if (strcmp(name, "astar") == 0) {
+        *out = ROUTE_MODE_ASTAR;
+    } else if (strcmp(name, "bidir") == 0) {
+        *out = ROUTE_MODE_BIDIR;
+    } else if (strcmp(name, "ch") == 0) {
+        *out = ROUTE_MODE_CH;
+    } else if (strcmp(name, "cch") == 0) {
+        *out = ROUTE_MODE_CCH;
+    } else {
+        return 2;
+    }
+    return 0;
+}
 
-        
-        if (g_score[u] == DBL_MAX) break;
+const char* routing_mode_name(RouteMode mode)
+{
+    switch (mode) {
+    case ROUTE_MODE_ASTAR: return "astar";
+    case ROUTE_MODE_BIDIR: return "bidir";
+    case ROUTE_MODE_CH:    return "ch";
+    case ROUTE_MODE_CCH:   return "cch";
+    }
+    return "unknown";
+}
 
-        // in the target
-        if (u == target_id) {
-            printf("\nDestination reached! Cost: %.2f\n", g_score[u]);
-            printf("Path: ");
-            print_path(target_id, parent);
-            printf("END\n");
-            
-            free(g_score); free(f_score); free(parent);
-            freeMinHeap(minHeap);free(minNode);
-            return;
-        }
+int routing_heuristic_parse(const char* name, RouteHeuristic* out)
+{
+    if (!name || !out) return 1;
+    if (strcmp(name, "euclid") == 0) {
+        *out = ROUTE_HEURISTIC_EUCLIDEAN;
+    } else if (strcmp(name, "alt") == 0) {
+        *out = ROUTE_HEURISTIC_ALT;
+    } else {
+        return 2;
+    }
+    return 0;
+}
 
-        // explore neighbors
-        EdgeNode* curr_edge = graph->nodes[u].out_edges;
-        while (curr_edge != NULL) {
-            int v = curr_edge->edge_data.to_node;
-            double weight = curr_edge->edge_data.current_travel_time;
+const char* routing_heuristic_name(RouteHeuristic h)
+{
+    switch (h) {
+    case ROUTE_HEURISTIC_EUCLIDEAN: return "euclid";
+    case ROUTE_HEURISTIC_ALT:       return "alt";
+    }
+    return "unknown";
+}
 
-            // g score
-            double tentative_g = g_score[u] + weight;
+/*
+ * Per-query heuristic state. The anchor node's coordinates and the
+ * distance scale are read once, so a Euclidean evaluation is a handful of
+ * flops on the node being relaxed. Bounds are towards the anchor, or from
+ * it when reverse is set (backward potential of the bidirectional search).
+ */
+typedef struct {
+    RouteHeuristic kind;
+    const Graph* graph;
+    const GraphStats* stats;
+    const Landmarks* landmarks;
+    int anchor;
+    int reverse;
+    double x, y;
+    double scale;
+} Estimator;
+
+static void estimator_init(Estimator* e, const Graph* graph, const RouteWorkspace* ws,
+                           int anchor, int reverse)
+{
+    e->kind = ws->heuristic;
+    e->graph = graph;
+    e->stats = ws->stats ? ws->stats : &graph->stats;
+    e->landmarks = ws->landmarks;
+    e->anchor = anchor;
+    e->reverse = reverse;
+    e->x = graph->nodes[anchor].x;
+    e->y = graph->nodes[anchor].y;
+    e->scale = e->stats->time_scale;
+}
 
-            if (tentative_g < g_score[v]) {
-                // found a better path
-                g_score[v] = tentative_g;
-                double h = get_heuristic(&graph->nodes[v], &graph->nodes[target_id]);
-                f_score[v] = g_score[v] + h;
-                parent[v] = u;
+static inline double estimate(const Estimator* e, int v)
+{
+    if (e->kind == ROUTE_HEURISTIC_ALT) {
+        return e->reverse ? alt_lower_bound(e->landmarks, e->stats, e->anchor, v)
+                          : alt_lower_bound(e->landmarks, e->stats, v, e->anchor);
+    }
+    double dx = e->graph->nodes[v].x - e->x;
+    double dy = e->graph->nodes[v].y - e->y;
+    return sqrt(dx * dx + dy * dy) * e->scale;
+}
 
-                // update in min heap
-                if (isInMinHeap(minHeap, v)) {
-                    decreaseKey(minHeap, v, f_score[v]);
-                }
-            }
-            curr_edge = curr_edge->next;
+/* Start a new query: bump the generation instead of clearing V entries */
+void routing_workspace_begin(RouteWorkspace* ws)
+{
+    ws->generation++;
+    if (ws->generation == 0) {
+        /* Stamp wrapped around; old stamps could alias, so clear once */
+        memset(ws->fwd.seen, 0, sizeof(unsigned int) * (size_t)ws->num_nodes);
+        if (ws->bwd.seen) {
+            memset(ws->bwd.seen, 0, sizeof(unsigned int) * (size_t)ws->num_nodes);
         }
+        ws->generation = 1;
     }
-
-    printf("No path found.\n");
-    free(g_score); free(f_score); free(parent); 
- 
+    clearMinHeap(ws->fwd.heap);
+    if (ws->bwd.heap) {
+        clearMinHeap(ws->bwd.heap);
+    }
+    ws->path_len = 0;
+    ws->path_cost = 0.0;
+    ws->settled = 0;
 }
-    */
 
+int routing_workspace_ensure_backward(RouteWorkspace* ws)
+{
+    if (ws->bwd.seen) return 0;
+    if (search_space_init(&ws->bwd, ws->num_nodes) != 0) {
+        search_space_free(&ws->bwd);
+        return 12;
+    }
+    return 0;
+}
 
+int routing_workspace_reserve_path(RouteWorkspace* ws, int len)
+{
+    if (len <= ws->path_cap) return 0;
+
+    int cap = ws->path_cap;
+    while (cap < len) cap *= 2;
+    int* grown = (int*)realloc(ws->path_edges, sizeof(int) * (size_t)cap);
+    if (!grown) return 14;
+    ws->path_edges = grown;
+    ws->path_cap = cap;
+    return 0;
+}
 
 /*
- * Print path from start to current_node using parent[] array
+ * Store the path start -> meet (forward parents) followed by
+ * meet -> target (backward parents, if bwd is non-NULL).
  */
-static void print_path(int current_node, const int* parent)
+static int workspace_store_path(Graph* g, RouteWorkspace* ws,
+                                const SearchSpace* bwd,
+                                int start_id, int meet_id, int target_id)
 {
-    if (current_node == -1) return;
-    print_path(parent[current_node], parent);
-    printf("%d ", current_node);
+    const int* fwd_parent = ws->fwd.parent_slot;
+
+    int len = 0;
+    for (int v = meet_id; v != start_id; ) {
+        v = g->edges[g->out_edge_ids[fwd_parent[v]]].from_node;
+        len++;
+    }
+    int fwd_len = len;
+    if (bwd) {
+        for (int v = meet_id; v != target_id; ) {
+            v = g->out_targets[bwd->parent_slot[v]];
+            len++;
+        }
+    }
+
+    int rc = routing_workspace_reserve_path(ws, len);
+    if (rc != 0) return rc;
+
+    int k = fwd_len;
+    for (int v = meet_id; v != start_id; ) {
+        int eid = g->out_edge_ids[fwd_parent[v]];
+        ws->path_edges[--k] = eid;
+        v = g->edges[eid].from_node;
+    }
+    k = fwd_len;
+    if (bwd) {
+        for (int v = meet_id; v != target_id; ) {
+            int slot = bwd->parent_slot[v];
+            ws->path_edges[k++] = g->out_edge_ids[slot];
+            v = g->out_targets[slot];
+        }
+    }
+
+    ws->path_len = len;
+    return 0;
 }
 
 /*
  * A* Search
- * Finds route from start_id to target_id using:
- *  - g_score: cost-so-far
- *  - f_score: g_score + heuristic
- *
- * Graph neighbors:
- *  - adjacency list: g->nodes[u].out_edges (list of edge_ids)
- * Edge weight:
- *  - g->edges[edge_id].current_travel_time via get_edge_weight()
+ * Finds route from start_id to target_id and prints it.
+ * Thin wrapper over find_route_a_star_path() with a temporary workspace.
  */
 void find_route_a_star(Graph* graph, int start_id, int target_id)
 {
@@ -132,310 +275,247 @@ void find_route_a_star(Graph* graph, int start_id, int target_id)
         return;
     }
 
-    if (start_id < 0 || start_id >= graph->num_nodes ||
-        target_id < 0 || target_id >= graph->num_nodes) {
-        fprintf(stderr, "find_route_a_star: invalid start/target\n");
+    RouteWorkspace ws;
+    if (routing_workspace_init(&ws, graph->num_nodes) != 0) {
+        fprintf(stderr, "find_route_a_star: malloc failed\n");
         return;
     }
 
-    int V = graph->num_nodes;
-
-    double* g_score = (double*)malloc(sizeof(double) * V);
-    double* f_score = (double*)malloc(sizeof(double) * V);
-    int* parent      = (int*)malloc(sizeof(int) * V);
+    printf("Starting A* Search from %d to %d...\n", start_id, target_id);
 
-    if (!g_score || !f_score || !parent) {
-        fprintf(stderr, "find_route_a_star: malloc failed\n");
-        free(g_score); free(f_score); free(parent);
-        return;
+    int rc = find_route_a_star_path(graph, &ws, start_id, target_id);
+    if (rc == 0) {
+        printf("Destination reached! Cost: %.4f\n", ws.path_cost);
+        printf("Path: %d ", start_id);
+        for (int i = 0; i < ws.path_len; i++) {
+            printf("%d ", graph->edges[ws.path_edges[i]].to_node);
+        }
+        printf("\n");
+    } else if (rc == 1) {
+        printf("No path found.\n");
+    } else {
+        fprintf(stderr, "find_route_a_star: invalid start/target\n");
     }
 
-    MinHeap* minHeap = createMinHeap(V);
-    if (!minHeap) {
-        fprintf(stderr, "find_route_a_star: createMinHeap failed\n");
-        free(g_score); free(f_score); free(parent);
-        return;
-    }
+    routing_workspace_free(&ws);
+}
 
-    /* Initialize */
-    for (int i = 0; i < V; i++) {
-        g_score[i] = DBL_MAX;
-        f_score[i] = DBL_MAX;
-        parent[i] = -1;
+/**
+ * A* Search using the caller's workspace.
+ *  - g_score: cost-so-far
+ *  - heap key: g_score + heuristic
+ *
+ * Graph neighbors:
+ *  - CSR slots [g->out_offsets[u], g->out_offsets[u+1])
+ * Edge weight:
+ *  - weights[slot] (packed travel time, see routing_weights)
+ *
+ * Returns 0 on success, 1 if no path, non-zero on error.
+ */
+int find_route_a_star_path(Graph* graph,
+                           RouteWorkspace* ws,
+                           int start_id,
+                           int target_id)
+{
+    if (!graph || !ws) return 10;
 
-        minHeap->array[i] = newMinHeapNode(i, DBL_MAX);
-        minHeap->pos[i] = i;
+    if (start_id < 0 || start_id >= graph->num_nodes ||
+        target_id < 0 || target_id >= graph->num_nodes ||
+        ws->num_nodes != graph->num_nodes) {
+        return 11;
     }
-    minHeap->size = V;
 
-    /* Start node */
-    g_score[start_id] = 0.0;
-    f_score[start_id] = heuristic(graph, start_id, target_id);
-    decreaseKey(minHeap, start_id, f_score[start_id]);
+    routing_workspace_begin(ws);
 
-    printf("Starting A* Search from %d to %d...\n", start_id, target_id);
+    const unsigned int gen = ws->generation;
+    unsigned int* seen = ws->fwd.seen;
+    double* g_score = ws->fwd.g_score;
+    int* parent_slot = ws->fwd.parent_slot;
+    MinHeap* heap = ws->fwd.heap;
 
-    while (!isEmpty(minHeap)) {
-        MinHeapNode* minNode = extractMin(minHeap);
-        if (!minNode) break;
+    seen[start_id] = gen;
+    g_score[start_id] = 0.0;
+    parent_slot[start_id] = -1;
 
-        int u = minNode->node_id;
-        double u_f = minNode->dist;
+    const double* weights = routing_weights(graph, ws);
+    Estimator to_target;
+    estimator_init(&to_target, graph, ws, target_id, 0);
+    insertMinHeap(heap, start_id, estimate(&to_target, start_id));
 
-        /* If u is unreachable */
-        if (u_f == DBL_MAX) {
-            free(minNode);
-            break;
-        }
+    int found = 0;
+
+    while (!isEmpty(heap)) {
+        int u = extractMin(heap, NULL);
+        ws->settled++;
 
-        /* Goal reached */
         if (u == target_id) {
-            printf("Destination reached! Cost: %.4f\n", g_score[u]);
-            printf("Path: ");
-            print_path(target_id, parent);
-            printf("\n");
-
-            free(minNode);
-            free(g_score); free(f_score); free(parent);
-            freeMinHeap(minHeap);
-            return;
+            found = 1;
+            break;
         }
 
-        /* Explore neighbors via adjacency list */
-        EdgeNode* curr = graph->nodes[u].out_edges;
-        while (curr != NULL) {
-            int edge_id = curr->edge_id;
-
-            /* edge_id must be valid */
-            if (edge_id < 0 || edge_id >= graph->num_edges) {
-                curr = curr->next;
-                continue;
-            }
-
-            int v = graph->edges[edge_id].to_node;         /* neighbor */
-            double w = get_edge_weight(graph, edge_id);     /* weight */
+        double g_u = g_score[u];
+        int end = graph->out_offsets[u + 1];
+        for (int slot = graph->out_offsets[u]; slot < end; slot++) {
+            int v = graph->out_targets[slot];      /* neighbor */
+            double w = weights[slot];              /* weight */
+            double tentative_g = g_u + w;
 
-            if (v < 0 || v >= V) {
-                curr = curr->next;
-                continue;
-            }
-
-            if (g_score[u] != DBL_MAX) {
-                double tentative_g = g_score[u] + w;
-
-                if (tentative_g < g_score[v]) {
-                    g_score[v] = tentative_g;
-                    double h = heuristic(graph, v, target_id);
-                    f_score[v] = tentative_g + h;
-                    parent[v] = u;
+            if (seen[v] != gen) {
+                /* First time this query discovers v */
+                seen[v] = gen;
+                g_score[v] = tentative_g;
+                parent_slot[v] = slot;
+                insertMinHeap(heap, v, tentative_g + estimate(&to_target, v));
+            } else if (tentative_g < g_score[v]) {
+                g_score[v] = tentative_g;
+                parent_slot[v] = slot;
+                double f = tentative_g + estimate(&to_target, v);
 
-                    if (isInMinHeap(minHeap, v)) {
-                        decreaseKey(minHeap, v, f_score[v]);
-                    }
+                if (isInMinHeap(heap, v)) {
+                    decreaseKey(heap, v, f);
+                } else {
+                    insertMinHeap(heap, v, f); /* reopen */
                 }
             }
-
-            curr = curr->next;
         }
-
-        free(minNode);
     }
 
-    printf("No path found.\n");
+    if (!found) {
+        return 1; /* no path */
+    }
 
-    free(g_score); free(f_score); free(parent);
-    freeMinHeap(minHeap);
+    ws->path_cost = g_score[target_id];
+    return workspace_store_path(graph, ws, NULL, start_id, target_id, target_id);
 }
 
-/* Helper: find edge_id for directed edge from 'from' to 'to'. Returns -1 if not found. */
-static int find_edge_id(Graph* g, int from, int to)
+/* Relax v from one side; returns 1 if v's label improved */
+static int relax(SearchSpace* sp, unsigned int gen, int v, double g, int slot, double key)
 {
-    EdgeNode* cur = g->nodes[from].out_edges;
-    while (cur) {
-        int eid = cur->edge_id;
-        if (eid >= 0 && eid < g->num_edges && g->edges[eid].to_node == to) {
-            return eid;
+    if (sp->seen[v] != gen) {
+        sp->seen[v] = gen;
+        sp->g_score[v] = g;
+        sp->parent_slot[v] = slot;
+        insertMinHeap(sp->heap, v, key);
+        return 1;
+    }
+    if (g < sp->g_score[v]) {
+        sp->g_score[v] = g;
+        sp->parent_slot[v] = slot;
+        if (isInMinHeap(sp->heap, v)) {
+            decreaseKey(sp->heap, v, key);
+        } else {
+            insertMinHeap(sp->heap, v, key);
         }
-        cur = cur->next;
+        return 1;
     }
-    return -1;
+    return 0;
 }
 
-/**
- * A* variant that returns cost and edge path instead of printing.
- * Returns 0 on success, 1 if no path, non-zero on error.
- */
-int find_route_a_star_path(Graph* graph,
-                           int start_id,
-                           int target_id,
-                           double* out_cost,
-                           int* out_edges,
-                           int max_edges,
-                           int* out_edge_count,
-                           int* out_nodes,
-                           int max_nodes,
-                           int* out_node_count)
+int find_route_bidir_path(Graph* graph,
+                          RouteWorkspace* ws,
+                          int start_id,
+                          int target_id)
 {
-    if (!graph || !out_cost || !out_edges || !out_edge_count) return 10;
+    if (!graph || !ws) return 10;
 
     if (start_id < 0 || start_id >= graph->num_nodes ||
-        target_id < 0 || target_id >= graph->num_nodes) {
+        target_id < 0 || target_id >= graph->num_nodes ||
+        ws->num_nodes != graph->num_nodes) {
         return 11;
     }
 
-    int V = graph->num_nodes;
+    int rc = routing_workspace_ensure_backward(ws);
+    if (rc != 0) return rc;
 
-    double* g_score = (double*)malloc(sizeof(double) * V);
-    double* f_score = (double*)malloc(sizeof(double) * V);
-    int* parent      = (int*)malloc(sizeof(int) * V);
+    routing_workspace_begin(ws);
 
-    if (!g_score || !f_score || !parent) {
-        free(g_score); free(f_score); free(parent);
-        return 12;
-    }
+    const unsigned int gen = ws->generation;
+    SearchSpace* fwd = &ws->fwd;
+    SearchSpace* bwd = &ws->bwd;
 
-    MinHeap* minHeap = createMinHeap(V);
-    if (!minHeap) {
-        free(g_score); free(f_score); free(parent);
-        return 13;
-    }
+    /* pf(v) = (h(v,t) - h(s,v)) / 2 ; backward potential is -pf(v) */
+    const double* weights = routing_weights(graph, ws);
+    Estimator to_target, from_start;
+    estimator_init(&to_target, graph, ws, target_id, 0);
+    estimator_init(&from_start, graph, ws, start_id, 1);
+    #define POT_F(v) (0.5 * (estimate(&to_target, (v)) - estimate(&from_start, (v))))
 
-    for (int i = 0; i < V; i++) {
-        g_score[i] = DBL_MAX;
-        f_score[i] = DBL_MAX;
-        parent[i] = -1;
+    relax(fwd, gen, start_id, 0.0, -1, POT_F(start_id));
+    relax(bwd, gen, target_id, 0.0, -1, -POT_F(target_id));
 
-        minHeap->array[i] = newMinHeapNode(i, DBL_MAX);
-        minHeap->pos[i] = i;
+    double best = DBL_MAX;     /* mu: shortest start->target length seen */
+    int meet = -1;
+    if (start_id == target_id) {
+        best = 0.0;
+        meet = start_id;
     }
-    minHeap->size = V;
-
-    g_score[start_id] = 0.0;
-    f_score[start_id] = heuristic(graph, start_id, target_id);
-    decreaseKey(minHeap, start_id, f_score[start_id]);
-
-    int found = 0;
-
-    while (!isEmpty(minHeap)) {
-        MinHeapNode* minNode = extractMin(minHeap);
-        if (!minNode) break;
-
-        int u = minNode->node_id;
-        double u_f = minNode->dist;
-        free(minNode);
-
-        if (u_f == DBL_MAX) break;
 
-        if (u == target_id) {
-            found = 1;
-            break;
-        }
+    while (!isEmpty(fwd->heap) && !isEmpty(bwd->heap)) {
+        double top_f = fwd->heap->array[0].dist;
+        double top_b = bwd->heap->array[0].dist;
 
-        EdgeNode* curr = graph->nodes[u].out_edges;
-        while (curr != NULL) {
-            int edge_id = curr->edge_id;
+        /* Both sides search the same reduced-cost graph, so the plain
+           bidirectional Dijkstra stopping rule applies to the keys */
+        if (top_f + top_b >= best) break;
 
-            if (edge_id < 0 || edge_id >= graph->num_edges) {
-                curr = curr->next;
-                continue;
-            }
+        if (top_f <= top_b) {
+            int u = extractMin(fwd->heap, NULL);
+            ws->settled++;
+            double g_u = fwd->g_score[u];
 
-            int v = graph->edges[edge_id].to_node;         /* neighbor */
-            double w = get_edge_weight(graph, edge_id);     /* weight */
+            int end = graph->out_offsets[u + 1];
+            for (int slot = graph->out_offsets[u]; slot < end; slot++) {
+                int v = graph->out_targets[slot];
+                double g_v = g_u + weights[slot];
 
-            if (v < 0 || v >= V) {
-                curr = curr->next;
-                continue;
+                if (relax(fwd, gen, v, g_v, slot, g_v + POT_F(v)) &&
+                    bwd->seen[v] == gen && g_v + bwd->g_score[v] < best) {
+                    best = g_v + bwd->g_score[v];
+                    meet = v;
+                }
             }
-
-            if (g_score[u] != DBL_MAX) {
-                double tentative_g = g_score[u] + w;
-
-                if (tentative_g < g_score[v]) {
-                    g_score[v] = tentative_g;
-                    double h = heuristic(graph, v, target_id);
-                    f_score[v] = tentative_g + h;
-                    parent[v] = u;
-
-                    if (isInMinHeap(minHeap, v)) {
-                        decreaseKey(minHeap, v, f_score[v]);
-                    }
+        } else {
+            int u = extractMin(bwd->heap, NULL);
+            ws->settled++;
+            double g_u = bwd->g_score[u];
+
+            int end = graph->in_offsets[u + 1];
+            for (int i = graph->in_offsets[u]; i < end; i++) {
+                int v = graph->in_sources[i];
+                int slot = graph->in_slots[i];
+                double g_v = g_u + weights[slot];
+
+                if (relax(bwd, gen, v, g_v, slot, g_v - POT_F(v)) &&
+                    fwd->seen[v] == gen && g_v + fwd->g_score[v] < best) {
+                    best = g_v + fwd->g_score[v];
+                    meet = v;
                 }
             }
-
-            curr = curr->next;
         }
     }
 
-    if (!found) {
-        free(g_score); free(f_score); free(parent);
-        freeMinHeap(minHeap);
-        return 1; /* no path */
-    }
-
-    /* Reconstruct node path from target back to start */
-    int* node_path = (int*)malloc(sizeof(int) * V);
-    if (!node_path) {
-        free(g_score); free(f_score); free(parent);
-        freeMinHeap(minHeap);
-        return 14;
-    }
-
-    int path_len = 0;
-    for (int v = target_id; v != -1; v = parent[v]) {
-        node_path[path_len++] = v;
-    }
+    #undef POT_F
 
-    /* Reverse to get start -> target */
-    for (int i = 0; i < path_len / 2; i++) {
-        int tmp = node_path[i];
-        node_path[i] = node_path[path_len - 1 - i];
-        node_path[path_len - 1 - i] = tmp;
-    }
-
-    /* Copy node path to caller if requested */
-    if (out_nodes && out_node_count) {
-        if (path_len > max_nodes) {
-            free(node_path);
-            free(g_score); free(f_score); free(parent);
-            freeMinHeap(minHeap);
-            return 17; /* node buffer too small */
-        }
-        for (int i = 0; i < path_len; i++) {
-            out_nodes[i] = node_path[i];
-        }
-        *out_node_count = path_len;
+    if (meet < 0) {
+        return 1; /* no path */
     }
 
-    /* Convert node path to edge ids */
-    int edge_count = 0;
-    for (int i = 0; i < path_len - 1; i++) {
-        int from = node_path[i];
-        int to = node_path[i + 1];
-        int eid = find_edge_id(graph, from, to);
-        if (eid < 0) {
-            free(node_path);
-            free(g_score); free(f_score); free(parent);
-            freeMinHeap(minHeap);
-            return 15;
-        }
-
-        if (edge_count >= max_edges) {
-            free(node_path);
-            free(g_score); free(f_score); free(parent);
-            freeMinHeap(minHeap);
-            return 16; /* path too long for out_edges capacity */
-        }
+    ws->path_cost = best;
+    return workspace_store_path(graph, ws, bwd, start_id, meet, target_id);
+}
 
-        out_edges[edge_count++] = eid;
+int find_route_path(Graph* graph,
+                    RouteWorkspace* ws,
+                    RouteMode mode,
+                    int start_id,
+                    int target_id)
+{
+    switch (mode) {
+    case ROUTE_MODE_BIDIR:
+        return find_route_bidir_path(graph, ws, start_id, target_id);
+    case ROUTE_MODE_ASTAR:
+        return find_route_a_star_path(graph, ws, start_id, target_id);
+    default:
+        return 13;
     }
-
-    free(node_path);
-
-    *out_cost = g_score[target_id];
-    *out_edge_count = edge_count;
-
-    free(g_score); free(f_score); free(parent);
-    freeMinHeap(minHeap);
-    return 0;
 }
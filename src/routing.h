@@ -2,26 +2,132 @@
 #define ROUTING_H
 
 #include "graph.h"
+#include "min_heap.h"
+
+struct Landmarks;
+
+/* Search algorithm used for route queries (selected per server instance) */
+typedef enum {
+    ROUTE_MODE_ASTAR = 0,   /* unidirectional A* */
+    ROUTE_MODE_BIDIR = 1,   /* bidirectional A* over the incoming index */
+    ROUTE_MODE_CH    = 2,   /* contraction hierarchy query (ch.h) */
+    ROUTE_MODE_CCH   = 3    /* customizable CH over live weights (cch.h) */
+} RouteMode;
+
+/* Lower bound guiding the A* modes */
+typedef enum {
+    ROUTE_HEURISTIC_EUCLIDEAN = 0,  /* straight-line distance / max speed */
+    ROUTE_HEURISTIC_ALT       = 1   /* landmark triangle inequality (alt.h) */
+} RouteHeuristic;
+
+/* One search direction's per-node state */
+typedef struct {
+    unsigned int* seen;     /* generation stamp per node */
+    double* g_score;        /* cost-so-far, valid when seen */
+    int* parent_slot;       /* CSR slot used to reach node, -1 at the root */
+    MinHeap* heap;
+} SearchSpace;
+
+/*
+ * Reusable search state, one per routing thread. Arrays are sized for the
+ * graph once; seen[v] == generation marks the entries that belong to the
+ * current query, so a search only touches the nodes it actually visits and
+ * allocates nothing (the path buffer only grows when a longer route shows up).
+ * The backward space is allocated on the first bidirectional query.
+ */
+typedef struct {
+    int num_nodes;
+    unsigned int generation;
+    SearchSpace fwd;
+    SearchSpace bwd;
+
+    RouteHeuristic heuristic;
+    const struct Landmarks* landmarks;  /* set for ROUTE_HEURISTIC_ALT */
+
+    /* Travel times (by CSR slot) and bounds queries read; NULL means the
+       graph's live out_weights and stats */
+    const double* weights;
+    const GraphStats* stats;
+
+    /* Result of the last successful query */
+    int* path_edges;        /* edge_ids along the path (src -> dst order) */
+    int path_len;
+    int path_cap;
+    double path_cost;       /* total travel time */
+    int settled;            /* nodes settled by the last query (both sides) */
+} RouteWorkspace;
+
+/* Returns 0 on success, non-zero on allocation failure. */
+int routing_workspace_init(RouteWorkspace* ws, int num_nodes);
+void routing_workspace_free(RouteWorkspace* ws);
+
+/*
+ * Building blocks for search engines that keep their state in a
+ * RouteWorkspace (e.g. ch.c). A search calls routing_workspace_begin()
+ * once per query; the parent arrays may hold engine-specific ids.
+ */
+void routing_workspace_begin(RouteWorkspace* ws);
+/* Allocates the backward search space if needed; 0 on success */
+int routing_workspace_ensure_backward(RouteWorkspace* ws);
+/* Grows path_edges to hold at least len entries; 0 on success */
+int routing_workspace_reserve_path(RouteWorkspace* ws, int len);
+
+/* Selects the A* lower bound (Euclidean by default). ALT needs landmarks
+   built for a graph of ws->num_nodes nodes. 0 on success. */
+int routing_workspace_set_heuristic(RouteWorkspace* ws, RouteHeuristic h,
+                                    const struct Landmarks* landmarks);
+
+/*
+ * Points the workspace's queries at a weight snapshot (e.g. weights.h)
+ * instead of the graph's live array; stats must be the bounds that go with
+ * those weights. Pass NULLs to go back to the live graph.
+ */
+void routing_workspace_set_weights(RouteWorkspace* ws, const double* weights,
+                                   const GraphStats* stats);
+
+/* Travel-time array the workspace's queries use, indexed by CSR slot */
+const double* routing_weights(const Graph* g, const RouteWorkspace* ws);
+
+/* Parses "astar" / "bidir" / "ch" / "cch". Returns 0 on success, non-zero if unknown. */
+int routing_mode_parse(const char* name, RouteMode* out);
+const char* routing_mode_name(RouteMode mode);
+
+/* Parses "euclid" / "alt". Returns 0 on success, non-zero if unknown. */
+int routing_heuristic_parse(const char* name, RouteHeuristic* out);
+const char* routing_heuristic_name(RouteHeuristic h);
 
 /* Routing API */
 void find_route_a_star(Graph* graph, int start_id, int target_id);
 /**
- * A* that returns total cost and edge path.
- *  - out_cost: total travel time
- *  - out_edges: edge_ids along the path (src -> dst order)
- *  - max_edges: capacity of out_edges
- *  - out_edge_count: number of edges written
+ * A* guided by the workspace's heuristic (routing_workspace_set_heuristic);
+ * stores total cost and edge path in the workspace:
+ *  - ws->path_cost: total travel time
+ *  - ws->path_edges / ws->path_len: edge_ids along the path
  * Returns 0 on success, 1 if no path, non-zero on error.
  */
 int find_route_a_star_path(Graph* graph,
+                           RouteWorkspace* ws,
                            int start_id,
-                           int target_id,
-                           double* out_cost,
-                           int* out_edges,
-                           int max_edges,
-                           int* out_edge_count,
-                           int* out_nodes,
-                           int max_nodes,
-                           int* out_node_count);
+                           int target_id);
+
+/**
+ * Bidirectional A*: a forward search over out-edges and a backward search
+ * over the incoming index, both guided by the average potential
+ * pf(v) = (h(v,target) - h(start,v)) / 2, which keeps reduced edge costs
+ * non-negative on both sides. Same result contract as find_route_a_star_path.
+ */
+int find_route_bidir_path(Graph* graph,
+                          RouteWorkspace* ws,
+                          int start_id,
+                          int target_id);
+
+/* Dispatches to the graph search selected by mode; ROUTE_MODE_CH and
+   ROUTE_MODE_CCH need a hierarchy and are answered by ch_query() and
+   cch_query() instead (returns 13 here) */
+int find_route_path(Graph* graph,
+                    RouteWorkspace* ws,
+                    RouteMode mode,
+                    int start_id,
+                    int target_id);
 
 #endif
@@ -3,20 +3,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include <ctype.h>
+#include <math.h>
 
 #include <unistd.h>
+#include <time.h>
+#include <sched.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "server.h"
+#include "command.h"
+#include "wire.h"
+#include "numfmt.h"
 #include "routing.h"
+#include "traffic.h"
+#include "work_queue.h"
+#include "weights.h"
 
 /* ---------------- configuration ---------------- */
 
+/* Default pool sizes; ServerConfig overrides them at run time */
 #ifndef ROUTE_WORKERS
 #define ROUTE_WORKERS 8
 #endif
@@ -25,88 +38,82 @@
 #define TRAFFIC_WORKERS 2
 #endif
 
-/* ---------------- helpers ---------------- */
+/* Upper bound for --traffic-batch */
+#ifndef TRAFFIC_BATCH_MAX
+#define TRAFFIC_BATCH_MAX 4096
+#endif
 
-static void trim_crlf(char* s) {
-    size_t n = strlen(s);
-    while (n > 0 && (s[n-1] == '\n' || s[n-1] == '\r')) {
-        s[n-1] = '\0';
-        n--;
-    }
-}
+/* How often the weight publisher rebuilds the graph bounds (GraphStats) */
+#ifndef STATS_REBUILD_MS
+#define STATS_REBUILD_MS 1000
+#endif
 
-/* Reads one line ending with '\n' into buf (null-terminated).
-   Returns length, 0 if connection closed, -1 on error. */
-static int recv_line(int client_fd, char* buf, int cap) {
-    int pos = 0;
-    while (pos < cap - 1) {
-        char c;
-        int r = (int)recv(client_fd, &c, 1, 0);
-        if (r == 0) { /* peer closed */
-            if (pos == 0) return 0;
-            break;
-        }
-        if (r < 0) return -1;
+/* Event-loop threads; each accepts on its own SO_REUSEPORT listener */
+#ifndef IO_THREADS
+#define IO_THREADS 4
+#endif
 
-        buf[pos++] = c;
-        if (c == '\n') break;
-    }
-    buf[pos] = '\0';
-    return pos;
-}
+/* Default listen backlog of each listener */
+#ifndef LISTEN_BACKLOG
+#define LISTEN_BACKLOG 1024
+#endif
 
-static int send_all(int client_fd, const char* s) {
-    int len = (int)strlen(s);
-    int sent = 0;
-    while (sent < len) {
-        int r = (int)send(client_fd, s + sent, len - sent, 0);
-        if (r <= 0) return -1;
-        sent += r;
-    }
-    return 0;
-}
+/* Connections an I/O thread accepts per wakeup before serving the others */
+#ifndef IO_ACCEPT_BATCH
+#define IO_ACCEPT_BATCH 64
+#endif
 
-static int json_extract_int(const char* json, const char* key, int* out) {
-    char pat[128];
-    snprintf(pat, sizeof(pat), "\"%s\"", key);
-    const char* p = strstr(json, pat);
-    if (!p) return 0;
-    p = strchr(p, ':');
-    if (!p) return 0;
-    p++;
-    while (*p && isspace((unsigned char)*p)) p++;
-    char* endp = NULL;
-    long v = strtol(p, &endp, 10);
-    if (endp == p) return 0;
-    *out = (int)v;
-    return 1;
-}
+/* Longest accepted command line; longer ones are rejected and skipped */
+#ifndef CONN_LINE_MAX
+#define CONN_LINE_MAX 65536
+#endif
 
-static int json_extract_double(const char* json, const char* key, double* out) {
-    char pat[128];
-    snprintf(pat, sizeof(pat), "\"%s\"", key);
-    const char* p = strstr(json, pat);
-    if (!p) return 0;
-    p = strchr(p, ':');
-    if (!p) return 0;
-    p++;
-    while (*p && isspace((unsigned char)*p)) p++;
-    char* endp = NULL;
-    double v = strtod(p, &endp);
-    if (endp == p) return 0;
-    *out = v;
-    return 1;
+/* Commands a connection may have queued or running at once (power of two) */
+#ifndef CONN_PIPELINE_MAX
+#define CONN_PIPELINE_MAX 64
+#endif
+
+/* Unsent output above which a connection stops taking new commands */
+#ifndef CONN_OUT_HIGH
+#define CONN_OUT_HIGH (256 * 1024)
+#endif
+
+/* Recycled Tasks kept per I/O thread, and the largest reply buffer kept with one */
+#ifndef IO_TASK_CACHE
+#define IO_TASK_CACHE 4096
+#endif
+#ifndef TASK_REPLY_KEEP
+#define TASK_REPLY_KEEP (64 * 1024)
+#endif
+
+/* Buffer for a command's error reply */
+#ifndef PARSE_ERROR_MAX
+#define PARSE_ERROR_MAX 128
+#endif
+
+/* Replies handed to one sendmsg() */
+#ifndef CONN_IOV_MAX
+#define CONN_IOV_MAX 64
+#endif
+
+/* Read buffer growth step and the least free space handed to recv() */
+#ifndef CONN_READ_CHUNK
+#define CONN_READ_CHUNK 4096
+#endif
+
+/* ---------------- helpers ---------------- */
+
+/* Length of s[0, n) without trailing CR/LF; the cut is NUL-terminated */
+static size_t trim_crlf(char* s, size_t n) {
+    while (n > 0 && (s[n-1] == '\n' || s[n-1] == '\r')) n--;
+    s[n] = '\0';
+    return n;
 }
 
-static char* build_error_response(const char* code, int user_id, int car_id) {
-    char* resp = (char*)malloc(160);
-    if (!resp) return strdup("{\"error\":\"NO_MEM\"}\n");
-    if (user_id >= 0 && car_id >= 0) {
-        snprintf(resp, 160, "{\"error\":\"%s\",\"user_id\":%d,\"car_id\":%d}\n", code, user_id, car_id);
-    } else {
-        snprintf(resp, 160, "{\"error\":\"%s\"}\n", code);
-    }
-    return resp;
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
 }
 
 /* ---------------- task + queues ---------------- */
@@ -117,13 +124,20 @@ typedef enum {
     TASK_PRED = 3
 } TaskType;
 
+struct Conn;
+
 typedef struct Task {
     TaskType type;
 
-    Graph* g;
-    pthread_rwlock_t* graph_lock;
+    struct Conn* conn;  /* connection the response goes back to */
 
-    int client_fd;
+    /* pipelining */
+    long long req_id;   /* echoed back when the client sent one */
+    int has_req_id;
+    int ordered;        /* reply goes through the connection's reorder ring */
+    int binary;         /* reply as a wire.h frame instead of text */
+    unsigned int seq;   /* position in that ring */
+    long long queued_us; /* when a REQ was queued, if requests expire */
 
     /* REQ payload */
     int user_id;
@@ -140,468 +154,1670 @@ typedef struct Task {
     /* PRED payload */
     int pred_edge_id;
 
-    /* result */
-    char* response;     /* malloc'ed string to send back */
-    int done;           /* 0/1 */
-
-    pthread_mutex_t mu;
-    pthread_cond_t  cv;
+    /* result: reply text, kept with its capacity when the task is recycled */
+    char* reply;
+    size_t reply_len;
+    size_t reply_cap;
 
     struct Task* next;
 } Task;
 
-typedef struct {
-    Task* head;
-    Task* tail;
-    pthread_mutex_t mu;
-    pthread_cond_t  cv;
-} TaskQueue;
+/* ---------------- protocol execution (workers) ---------------- */
 
-static void queue_init(TaskQueue* q) {
-    q->head = q->tail = NULL;
-    pthread_mutex_init(&q->mu, NULL);
-    pthread_cond_init(&q->cv, NULL);
+/* Make room for extra more reply bytes (plus the terminator). 0 on success. */
+static int task_reply_reserve(Task* t, size_t extra) {
+    size_t need = t->reply_len + extra + 1;
+    if (need <= t->reply_cap) return 0;
+    size_t cap = t->reply_cap ? t->reply_cap : 128;
+    while (cap < need) cap *= 2;
+    char* grown = (char*)realloc(t->reply, cap);
+    if (!grown) return 1;
+    t->reply = grown;
+    t->reply_cap = cap;
+    return 0;
 }
 
-static void queue_push(TaskQueue* q, Task* t) {
-    t->next = NULL;
-    pthread_mutex_lock(&q->mu);
-    if (!q->tail) {
-        q->head = q->tail = t;
-    } else {
-        q->tail->next = t;
-        q->tail = t;
-    }
-    pthread_cond_signal(&q->cv);
-    pthread_mutex_unlock(&q->mu);
+/* Replace the reply with n bytes of data */
+static int task_reply_set_bytes(Task* t, const char* data, size_t n) {
+    t->reply_len = 0;
+    if (task_reply_reserve(t, n) != 0) return 1;
+    memcpy(t->reply, data, n);
+    t->reply_len = n;
+    return 0;
 }
 
-static Task* queue_pop(TaskQueue* q) {
-    pthread_mutex_lock(&q->mu);
-    while (!q->head) {
-        pthread_cond_wait(&q->cv, &q->mu);
-    }
-    Task* t = q->head;
-    q->head = t->next;
-    if (!q->head) q->tail = NULL;
-    pthread_mutex_unlock(&q->mu);
-    t->next = NULL;
-    return t;
+static void task_reply_set(Task* t, const char* text) {
+    task_reply_set_bytes(t, text, strlen(text));
 }
 
-/* Complete a task and wake the waiting client thread */
-static void task_complete(Task* t, char* resp) {
-    pthread_mutex_lock(&t->mu);
-    t->response = resp;
-    t->done = 1;
-    pthread_cond_signal(&t->cv);
-    pthread_mutex_unlock(&t->mu);
-}
-
-static Task* task_create(Graph* g, pthread_rwlock_t* lock, int client_fd) {
-    Task* t = (Task*)calloc(1, sizeof(Task));
-    if (!t) return NULL;
-    t->g = g;
-    t->graph_lock = lock;
-    t->client_fd = client_fd;
-    t->response = NULL;
-    t->done = 0;
-    pthread_mutex_init(&t->mu, NULL);
-    pthread_cond_init(&t->cv, NULL);
-    return t;
+/* Reply with a frame of at most cap bytes built by the caller at the
+   returned position; NULL (and an empty reply) if out of memory */
+static unsigned char* task_reply_frame(Task* t, size_t cap) {
+    t->reply_len = 0;
+    if (task_reply_reserve(t, cap) != 0) return NULL;
+    return (unsigned char*)t->reply;
 }
 
-static void task_destroy(Task* t) {
-    if (!t) return;
-    free(t->response);
-    pthread_mutex_destroy(&t->mu);
-    pthread_cond_destroy(&t->cv);
-    free(t);
+/*
+ * Text replies are written straight into the reply buffer: the builder
+ * reserves its worst case once, then appends with the helpers below,
+ * which do not check for room. task_reply_open starts a JSON object,
+ * echoing the request's req_id, and returns where the first field goes;
+ * task_reply_close records the length. On allocation failure the reply
+ * stays empty and the I/O thread answers NO_MEM instead.
+ */
+
+/* Worst case of the "{"req_id":N," opening */
+#define REPLY_OPEN_MAX (12 + NUMFMT_INT_MAX)
+
+/* Worst case of put_fixed3: "%.3f" of the largest double */
+#define REPLY_DOUBLE_MAX 320
+
+#define put_lit(p, s) (memcpy((p), (s), sizeof(s) - 1), (p) + sizeof(s) - 1)
+
+static char* put_fixed3(char* p, double v) {
+    char* end = fmt_fixed(p, v, 3);
+    if (end) return end;
+    int n = snprintf(p, REPLY_DOUBLE_MAX, "%.3f", v);
+    return p + (n > 0 && n < REPLY_DOUBLE_MAX ? n : 0);
 }
 
-/* ---------------- protocol execution (workers) ---------------- */
+static char* task_reply_open(Task* t, size_t cap) {
+    t->reply_len = 0;
+    if (task_reply_reserve(t, REPLY_OPEN_MAX + cap) != 0) return NULL;
+    char* p = t->reply;
+    *p++ = '{';
+    if (t->has_req_id) {
+        p = put_lit(p, "\"req_id\":");
+        p = fmt_int(p, t->req_id);
+        *p++ = ',';
+    }
+    return p;
+}
 
-static char* build_route_response(Graph* g, int user_id, int car_id, int src, int dst) {
-    if (src < 0 || src >= g->num_nodes || dst < 0 || dst >= g->num_nodes) {
-        return build_error_response("BAD_NODES", user_id, car_id);
+static void task_reply_close(Task* t, const char* end) {
+    t->reply_len = (size_t)(end - t->reply);
+}
+
+static void build_error_response(Task* t, const char* code, int user_id, int car_id) {
+    if (t->binary) {
+        unsigned char* out = task_reply_frame(t, WIRE_SMALL_MAX);
+        if (out) {
+            t->reply_len = wire_encode_error(out, (uint32_t)t->req_id, wire_error_from_name(code),
+                                             user_id, car_id);
+        }
+        return;
+    }
+
+    size_t code_len = strlen(code);
+    char* p = task_reply_open(t, 64 + code_len);
+    if (!p) return;
+    p = put_lit(p, "\"error\":\"");
+    memcpy(p, code, code_len);
+    p += code_len;
+    *p++ = '"';
+    if (user_id >= 0 && car_id >= 0) {
+        p = put_lit(p, ",\"user_id\":");
+        p = fmt_int(p, user_id);
+        p = put_lit(p, ",\"car_id\":");
+        p = fmt_int(p, car_id);
     }
+    p = put_lit(p, "}\n");
+    task_reply_close(t, p);
+}
 
-    int max_edges = (g->num_nodes > 0) ? g->num_nodes : 1;
-    int* path_edges = (int*)malloc(sizeof(int) * max_edges);
-    int* path_nodes = (int*)malloc(sizeof(int) * g->num_nodes);
-    if (!path_edges || !path_nodes) {
-        free(path_edges);
-        free(path_nodes);
-        return build_error_response("NO_MEM", user_id, car_id);
+static void build_route_response(Task* t, Graph* g, RouteWorkspace* ws,
+                                 RouteMode mode, const ContractionHierarchy* ch,
+                                 CustomizableCH* cch) {
+    int user_id = t->user_id, car_id = t->car_id, src = t->src, dst = t->dst;
+    if (src < 0 || src >= g->num_nodes || dst < 0 || dst >= g->num_nodes) {
+        build_error_response(t, "BAD_NODES", user_id, car_id);
+        return;
     }
 
-    double cost = 0.0;
-    int edge_count = 0;
-    int node_count = 0;
-    int rc = find_route_a_star_path(g, src, dst,
-                                    &cost,
-                                    path_edges, max_edges, &edge_count,
-                                    path_nodes, g->num_nodes, &node_count);
+    int rc;
+    if (mode == ROUTE_MODE_CH) {
+        rc = ch_query(ch, g, ws, src, dst);
+    } else if (mode == ROUTE_MODE_CCH) {
+        rc = cch_query(cch, g, ws, src, dst);
+    } else {
+        rc = find_route_path(g, ws, mode, src, dst);
+    }
 
     if (rc == 1) {
-        free(path_edges);
-        free(path_nodes);
-        return build_error_response("NO_ROUTE", user_id, car_id);
+        build_error_response(t, "NO_ROUTE", user_id, car_id);
+        return;
     }
     if (rc != 0) {
-        free(path_edges);
-        free(path_nodes);
-        return build_error_response("ROUTE_FAIL", user_id, car_id);
+        build_error_response(t, "ROUTE_FAIL", user_id, car_id);
+        return;
     }
 
-    /* Safety: ensure edge_count fits what we allocated */
-    if (edge_count < 0 || edge_count > max_edges) {
-        free(path_edges);
-        free(path_nodes);
-        return build_error_response("ROUTE_FAIL", user_id, car_id);
-    }
+    const int* path_edges = ws->path_edges;
+    int edge_count = ws->path_len;
 
-    if (node_count < 0 || node_count > g->num_nodes) {
-        free(path_edges);
-        free(path_nodes);
-        return build_error_response("ROUTE_FAIL", user_id, car_id);
+    if (t->binary) {
+        unsigned char* out = task_reply_frame(t, wire_route_max(edge_count));
+        if (out) {
+            t->reply_len = wire_encode_route(out, (uint32_t)t->req_id, user_id, car_id,
+                                             ws->path_cost, path_edges, edge_count);
+        }
+        return;
     }
 
-    size_t buf_sz = 128 + (size_t)edge_count * 16;
-    char* resp = (char*)malloc(buf_sz);
-    if (!resp) {
-        free(path_edges);
-        free(path_nodes);
-        return build_error_response("NO_MEM", user_id, car_id);
+    /* ids are ints: 11 characters and a comma at most */
+    char* p = task_reply_open(t, 64 + 2 * NUMFMT_INT_MAX + (size_t)edge_count * 12 +
+                                 REPLY_DOUBLE_MAX);
+    if (!p) return;
+    p = put_lit(p, "\"user_id\":");
+    p = fmt_int(p, user_id);
+    p = put_lit(p, ",\"car_id\":");
+    p = fmt_int(p, car_id);
+    p = put_lit(p, ",\"route_edges\":[");
+    for (int i = 0; i < edge_count; i++) {
+        if (i) *p++ = ',';
+        p = fmt_int(p, path_edges[i]);
     }
+    p = put_lit(p, "],\"eta\":");
+    p = put_fixed3(p, ws->path_cost);
+    p = put_lit(p, "}\n");
+    task_reply_close(t, p);
+}
 
-    int n = snprintf(resp, buf_sz, "{\"user_id\":%d,\"car_id\":%d,\"route_edges\":[", user_id, car_id);
-    for (int i = 0; i < edge_count && n > 0 && (size_t)n < buf_sz; i++) {
-        n += snprintf(resp + n, buf_sz - (size_t)n, "%s%d", (i == 0 ? "" : ","), path_edges[i]);
+/* Checks an UPD; on failure the task already holds its error reply */
+static int update_is_valid(Task* t, const Graph* g) {
+    if (t->edge_id < 0 || t->edge_id >= g->num_edges) {
+        build_error_response(t, "BAD_EDGE", t->user_id, t->car_id);
+        return 0;
     }
-    if (n > 0 && (size_t)n < buf_sz) {
-        snprintf(resp + n, buf_sz - (size_t)n, "],\"eta\":%.3f}\n", cost);
-    } else {
-        free(path_edges);
-        free(path_nodes);
-        free(resp);
-        return build_error_response("ROUTE_FAIL", user_id, car_id);
+    /* Binary frames and the legacy text form can carry NaN or inf; the
+       JSON parser already refuses them */
+    if (!isfinite(t->speed) || t->speed <= 0.0) {
+        build_error_response(t, "BAD_SPEED", t->user_id, t->car_id);
+        return 0;
     }
+    return 1;
+}
 
-    free(path_edges);
-    free(path_nodes);
-    return resp;
+static void build_update_ack(Task* t) {
+    if (t->binary) {
+        unsigned char* out = task_reply_frame(t, WIRE_SMALL_MAX);
+        if (out) t->reply_len = wire_encode_ack(out, (uint32_t)t->req_id, t->user_id, t->car_id);
+        return;
+    }
+    char* p = task_reply_open(t, 48 + 2 * NUMFMT_INT_MAX);
+    if (!p) return;
+    p = put_lit(p, "\"status\":\"ACK\",\"user_id\":");
+    p = fmt_int(p, t->user_id);
+    p = put_lit(p, ",\"car_id\":");
+    p = fmt_int(p, t->car_id);
+    p = put_lit(p, "}\n");
+    task_reply_close(t, p);
 }
 
-static char* apply_update(Graph* g, int user_id, int car_id, int edge_id, double speed) {
+static void build_pred_response(Task* t, Graph* g, const TrafficTable* traffic) {
+    int edge_id = t->pred_edge_id;
     if (edge_id < 0 || edge_id >= g->num_edges) {
-        return build_error_response("BAD_EDGE", user_id, car_id);
+        if (t->binary) build_error_response(t, "BAD_EDGE", -1, -1);
+        else task_reply_set(t, "ERR BAD_EDGE\n");
+        return;
     }
-    if (speed <= 0.0) {
-        return build_error_response("BAD_SPEED", user_id, car_id);
-    }
-
-    const double min_speed = 1e-6;
-    if (speed < min_speed) speed = min_speed;
-
-    Edge* e = &g->edges[edge_id];
-    const double alpha = (e->observation_count == 0) ? 1.0 : 0.2;
-    double measured = e->base_length / speed;
+    double pred = traffic_predict(traffic, edge_id);
 
-    e->ema_travel_time = alpha * measured + (1.0 - alpha) * e->ema_travel_time;
-    e->current_travel_time = e->ema_travel_time;
-    e->observation_count++;
+    if (t->binary) {
+        unsigned char* out = task_reply_frame(t, WIRE_SMALL_MAX);
+        if (out) t->reply_len = wire_encode_prediction(out, (uint32_t)t->req_id, edge_id, pred);
+        return;
+    }
 
-    char* ack = (char*)malloc(96);
-    if (!ack) return build_error_response("NO_MEM", user_id, car_id);
-    snprintf(ack, 96, "{\"status\":\"ACK\",\"user_id\":%d,\"car_id\":%d}\n", user_id, car_id);
-    return ack;
+    t->reply_len = 0;
+    if (task_reply_reserve(t, 8 + NUMFMT_INT_MAX + REPLY_DOUBLE_MAX) != 0) return;
+    char* p = put_lit(t->reply, "PRED ");
+    p = fmt_int(p, edge_id);
+    *p++ = ' ';
+    p = put_fixed3(p, pred);
+    *p++ = '\n';
+    task_reply_close(t, p);
 }
 
-static char* build_pred_response(Graph* g, int edge_id) {
-    if (edge_id < 0 || edge_id >= g->num_edges) {
-        return strdup("ERR BAD_EDGE\n");
+/* ---------------- connections ---------------- */
+
+struct ServerState;
+
+/*
+ * Event-loop thread. Accepts on its own listening socket and owns the
+ * connections registered with its epoll set; workers hand finished tasks
+ * back through the done list and wake it via the eventfd, so connection
+ * state is only ever touched by this thread.
+ */
+typedef struct IoThread {
+    struct ServerState* st;
+    int epfd;
+    int wake_fd;
+    int listen_fd;          /* SO_REUSEPORT socket; the kernel picks the thread */
+
+    pthread_mutex_t done_mu;
+    Task* done_head;
+    Task* done_tail;
+
+    /* Recycled tasks; only this thread creates and destroys them */
+    Task* free_tasks;
+    int free_count;
+
+    /* Connections closed during the current epoll batch; freed once the
+       batch is done, since a later event in it may still name them */
+    struct Conn* released;
+
+    pthread_t thread;
+} IoThread;
+
+/*
+ * Non-blocking client connection. Up to CONN_PIPELINE_MAX commands can be
+ * in flight at once. In ordered mode (the default) every reply gets a
+ * sequence number and waits in ring[] until those before it are written;
+ * after "MODE UNORDERED" replies go out as soon as they are ready and the
+ * client matches them by req_id. A connection closed while tasks are
+ * still running is freed when the last one comes back.
+ *
+ * Replies are not copied into an output buffer: the Task that carries
+ * one waits in the out queue until the socket has taken all of it, and
+ * conn_flush hands the queue to the kernel as one gather write.
+ *
+ * The read buffer grows on demand up to CONN_LINE_MAX + CONN_READ_CHUNK.
+ * Lines are cut in place: [in_off, in_len) is unread input and in_scan is
+ * where the next newline search resumes, so a line arriving in many
+ * pieces is scanned once.
+ */
+typedef struct Conn {
+    int fd;
+    IoThread* io;
+
+    char* in;
+    size_t in_off;
+    size_t in_len;
+    size_t in_scan;
+    size_t in_cap;
+    int discarding;         /* skipping the rest of an over-long line */
+
+    Task* out_head;         /* replies waiting for the socket, in order */
+    Task* out_tail;
+    size_t out_off;         /* bytes of out_head already sent */
+    size_t out_bytes;       /* unsent bytes over the whole queue */
+
+    int in_flight;          /* tasks handed to workers, not yet returned */
+    int ordered;
+    int binary;             /* after "PROTO BINARY": wire.h frames both ways */
+    unsigned int seq_next;  /* next ordered reply's sequence number */
+    unsigned int seq_out;   /* next ordered reply to write */
+    Task* ring[CONN_PIPELINE_MAX]; /* finished replies waiting their turn */
+
+    int peer_closed;        /* EOF seen; close after the pending work */
+    int closed;
+    unsigned int events;    /* current epoll interest */
+    struct Conn* next_dirty; /* completion batch, see io_drain_completions */
+    struct Conn* next_released; /* IoThread.released */
+    int released;
+    int dirty;
+} Conn;
+
+/* Take a task from the I/O thread's freelist, allocating only when it is empty */
+static Task* task_create(Conn* conn) {
+    IoThread* io = conn->io;
+    Task* t = io->free_tasks;
+    if (t) {
+        io->free_tasks = t->next;
+        io->free_count--;
+        char* reply = t->reply;
+        size_t reply_cap = t->reply_cap;
+        memset(t, 0, sizeof(*t));
+        t->reply = reply;
+        t->reply_cap = reply_cap;
+    } else {
+        t = (Task*)calloc(1, sizeof(Task));
+        if (!t) return NULL;
     }
-    Edge* e = &g->edges[edge_id];
-    double pred = (e->observation_count > 0) ? e->ema_travel_time : e->current_travel_time;
+    t->conn = conn;
+    return t;
+}
 
-    char* resp = (char*)malloc(64);
-    if (!resp) return strdup("ERR NO_MEM\n");
-    snprintf(resp, 64, "PRED %d %.3f\n", edge_id, pred);
-    return resp;
+/* Return a task to its I/O thread's freelist. Must run on that thread. */
+static void task_destroy(Task* t) {
+    if (!t) return;
+    IoThread* io = t->conn->io;
+    if (io->free_count >= IO_TASK_CACHE) {
+        free(t->reply);
+        free(t);
+        return;
+    }
+    if (t->reply_cap > TASK_REPLY_KEEP) {
+        free(t->reply); /* do not pin a buffer sized for a freak route */
+        t->reply = NULL;
+        t->reply_cap = 0;
+    }
+    t->next = io->free_tasks;
+    io->free_tasks = t;
+    io->free_count++;
 }
 
 /* ---------------- server shared state ---------------- */
 
-typedef struct {
+typedef struct ServerState {
     Graph* g;
-    pthread_rwlock_t graph_lock;
+    RouteMode route_mode;
+    const ContractionHierarchy* ch;
+    CustomizableCH* cch;
+    int cch_interval_ms;
+
+    /* Routing reads published snapshots; g's live travel times are only
+       written by the publisher thread */
+    WeightStore weights;
+    int publish_interval_ms;
+
+    TrafficTable traffic;   /* per-edge EMA state; one writer per edge */
+    int traffic_batch;      /* most UPDs a traffic worker applies at once */
+    int traffic_flush_us;   /* how long it waits to fill a batch */
 
-    TaskQueue routing_q;
-    TaskQueue traffic_q;
+    WorkPool routing_q;     /* per-worker lock-free queues with stealing */
+    WorkPool traffic_q;     /* sharded by edge_id, no stealing (traffic_shard) */
 
-    pthread_t routing_workers[ROUTE_WORKERS];
-    pthread_t traffic_workers[TRAFFIC_WORKERS];
+    /* Load shedding, reported by STATS */
+    long long deadline_us;  /* REQs queued longer are not routed (0: off) */
+    atomic_ullong rejected; /* commands refused because a queue was full */
+    atomic_ullong expired;  /* REQs dropped past the deadline */
+
+    pthread_t customizer;
+    pthread_t publisher;
+
+    IoThread* io;
+    int io_threads;
 } ServerState;
 
+/* Per routing worker: persistent A* workspace reused across queries */
+typedef struct {
+    ServerState* st;
+    int index;              /* own queue in st->routing_q */
+    RouteWorkspace ws;
+    pthread_t thread;
+} RoutingWorker;
+
+/* Per traffic worker: scratch for grouping one batch by edge */
+typedef struct {
+    ServerState* st;
+    int index;              /* own queue in st->traffic_q */
+    Task** batch;           /* traffic_batch entries */
+    double* speeds;         /* one edge's speeds, in arrival order */
+    int* next_same;         /* per batch entry: next entry on the same edge */
+    int* touched;           /* distinct edges in the batch */
+    int* edge_first;        /* per edge: first and last batch entry, -1 if none */
+    int* edge_last;
+    pthread_t thread;
+} TrafficWorker;
+
 /* ---------------- worker threads ---------------- */
 
+/* Hand a finished task back to the I/O thread that owns its connection */
+static void task_complete(Task* t) {
+    IoThread* io = t->conn->io;
+    t->next = NULL;
+
+    pthread_mutex_lock(&io->done_mu);
+    if (!io->done_tail) {
+        io->done_head = io->done_tail = t;
+    } else {
+        io->done_tail->next = t;
+        io->done_tail = t;
+    }
+    pthread_mutex_unlock(&io->done_mu);
+
+    uint64_t one = 1;
+    ssize_t w = write(io->wake_fd, &one, sizeof(one));
+    (void)w; /* only fails if the counter would overflow; already signalled */
+}
+
+/* task_complete for a batch: one lock and one wake-up per I/O thread.
+   Consumes the array (entries are set to NULL). */
+static void task_complete_many(Task** tasks, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!tasks[i]) continue;
+        IoThread* io = tasks[i]->conn->io;
+
+        /* Chain this thread's tasks in batch order */
+        Task* head = NULL;
+        Task* tail = NULL;
+        for (int j = i; j < n; j++) {
+            Task* t = tasks[j];
+            if (!t || t->conn->io != io) continue;
+            t->next = NULL;
+            if (tail) tail->next = t; else head = t;
+            tail = t;
+            tasks[j] = NULL;
+        }
+
+        pthread_mutex_lock(&io->done_mu);
+        if (!io->done_tail) io->done_head = head;
+        else io->done_tail->next = head;
+        io->done_tail = tail;
+        pthread_mutex_unlock(&io->done_mu);
+
+        uint64_t one = 1;
+        ssize_t w = write(io->wake_fd, &one, sizeof(one));
+        (void)w;
+    }
+}
+
 static void* routing_worker_main(void* arg) {
-    ServerState* st = (ServerState*)arg;
+    RoutingWorker* w = (RoutingWorker*)arg;
+    ServerState* st = w->st;
 
     while (1) {
-        Task* t = queue_pop(&st->routing_q);
-        /* Execute REQ/PRED under read lock */
-        pthread_rwlock_rdlock(&st->graph_lock);
-        char* resp = NULL;
-        if (t->type == TASK_REQ) {
-            resp = build_route_response(st->g, t->user_id, t->car_id, t->src, t->dst);
+        Task* t = (Task*)work_pool_pop(&st->routing_q, w->index);
+        if (t->type == TASK_REQ && st->deadline_us > 0 &&
+            monotonic_us() - t->queued_us > st->deadline_us) {
+            /* The client has probably given up; spend the search on a
+               request that can still be answered in time */
+            atomic_fetch_add_explicit(&st->expired, 1, memory_order_relaxed);
+            build_error_response(t, "OVERLOADED", t->user_id, t->car_id);
+        } else if (t->type == TASK_REQ) {
+            /* Pin the published weights; traffic writers never block us */
+            int token;
+            const WeightSnapshot* snap = weights_acquire(&st->weights, &token);
+            routing_workspace_set_weights(&w->ws, snap->w, &snap->stats);
+            build_route_response(t, st->g, &w->ws, st->route_mode, st->ch, st->cch);
+            weights_release(&st->weights, token);
         } else if (t->type == TASK_PRED) {
-            resp = build_pred_response(st->g, t->pred_edge_id);
+            build_pred_response(t, st->g, &st->traffic);
         } else {
-            resp = build_error_response("INTERNAL", t->user_id, t->car_id);
+            build_error_response(t, "INTERNAL", t->user_id, t->car_id);
         }
-        pthread_rwlock_unlock(&st->graph_lock);
 
-        task_complete(t, resp);
-        /* IMPORTANT: client thread destroys task after sending */
+        task_complete(t);
     }
     return NULL;
 }
 
+/* Blocks for one UPD, then takes whatever else is queued (waiting up to
+   traffic_flush_us for more) until the batch is full */
+static int traffic_collect(TrafficWorker* w) {
+    ServerState* st = w->st;
+    int n = 0;
+    w->batch[n++] = (Task*)work_pool_pop(&st->traffic_q, w->index);
+
+    long long deadline = st->traffic_flush_us > 0 ? monotonic_us() + st->traffic_flush_us : 0;
+    while (n < st->traffic_batch) {
+        Task* t = (Task*)work_pool_try_pop(&st->traffic_q, w->index);
+        if (t) {
+            w->batch[n++] = t;
+        } else if (deadline && monotonic_us() < deadline) {
+            sched_yield();
+        } else {
+            break;
+        }
+    }
+    return n;
+}
+
+/*
+ * Applies a batch of UPDs. Reports on the same edge are folded into its
+ * EMA together, in arrival order, with one CAS and one dirty report; the
+ * result is the same as applying them one by one. Every task still gets
+ * its own ACK or error.
+ */
+static void traffic_apply_batch(TrafficWorker* w, int n) {
+    ServerState* st = w->st;
+    Graph* g = st->g;
+    int touched = 0;
+
+    for (int i = 0; i < n; i++) {
+        Task* t = w->batch[i];
+        w->next_same[i] = -1;
+        if (!update_is_valid(t, g)) continue;
+
+        int e = t->edge_id;
+        if (w->edge_first[e] < 0) {
+            w->edge_first[e] = i;
+            w->touched[touched++] = e;
+        } else {
+            w->next_same[w->edge_last[e]] = i;
+        }
+        w->edge_last[e] = i;
+        build_update_ack(t);
+    }
+
+    for (int k = 0; k < touched; k++) {
+        int e = w->touched[k];
+        int count = 0;
+        for (int i = w->edge_first[e]; i >= 0; i = w->next_same[i]) {
+            w->speeds[count++] = w->batch[i]->speed;
+        }
+        traffic_observe_many(&st->traffic, g, e, w->speeds, count);
+        weights_mark_dirty(&st->weights, g->edge_slot[e]);
+        w->edge_first[e] = -1;
+    }
+}
+
+/* Batch scratch is allocated once; the workers run for the server's lifetime */
+static int traffic_worker_init(TrafficWorker* w, ServerState* st, int index) {
+    size_t batch = (size_t)st->traffic_batch;
+    size_t edges = (size_t)(st->g->num_edges > 0 ? st->g->num_edges : 1);
+
+    w->st = st;
+    w->index = index;
+    w->batch = (Task**)malloc(sizeof(Task*) * batch);
+    w->speeds = (double*)malloc(sizeof(double) * batch);
+    w->next_same = (int*)malloc(sizeof(int) * batch);
+    w->touched = (int*)malloc(sizeof(int) * batch);
+    w->edge_first = (int*)malloc(sizeof(int) * edges);
+    w->edge_last = (int*)malloc(sizeof(int) * edges);
+    if (!w->batch || !w->speeds || !w->next_same || !w->touched ||
+        !w->edge_first || !w->edge_last) {
+        return 1;
+    }
+    for (size_t e = 0; e < edges; e++) w->edge_first[e] = -1;
+    return 0;
+}
+
 static void* traffic_worker_main(void* arg) {
+    TrafficWorker* w = (TrafficWorker*)arg;
+
+    while (1) {
+        int n = traffic_collect(w);
+        traffic_apply_batch(w, n);
+        task_complete_many(w->batch, n);
+    }
+    return NULL;
+}
+
+/* Copy an edge's latest EMA into g's live travel time (publisher thread) */
+static void refresh_from_traffic(void* ctx, Graph* g, int slot) {
+    const TrafficTable* traffic = (const TrafficTable*)ctx;
+    int edge_id = g->out_edge_ids[slot];
+    graph_set_travel_time(g, edge_id, traffic_predict(traffic, edge_id));
+}
+
+/* Publishes traffic changes to the routing snapshot every interval */
+static void* weights_publisher_main(void* arg) {
+    ServerState* st = (ServerState*)arg;
+    struct timespec period;
+    period.tv_sec = st->publish_interval_ms / 1000;
+    period.tv_nsec = (long)(st->publish_interval_ms % 1000) * 1000000L;
+
+    long long next_rebuild = monotonic_us() + STATS_REBUILD_MS * 1000LL;
+    while (1) {
+        nanosleep(&period, NULL);
+        /* Updates only loosen g->stats; rebuilding them over the live
+           weights lets them tighten again once an outlier report has been
+           overridden. Slots refreshed by this publish loosen them anew. */
+        long long now = monotonic_us();
+        if (now >= next_rebuild) {
+            graph_compute_stats(st->g);
+            next_rebuild = now + STATS_REBUILD_MS * 1000LL;
+        }
+        weights_publish(&st->weights, st->g, refresh_from_traffic, &st->traffic);
+    }
+    return NULL;
+}
+
+/* Re-customizes the CCH from the latest weight snapshot every interval.
+   The snapshot is only pinned while the weights are copied in; the
+   triangle pass runs on the back metric while queries use the published
+   one. */
+static void* cch_customizer_main(void* arg) {
     ServerState* st = (ServerState*)arg;
+    struct timespec period;
+    period.tv_sec = st->cch_interval_ms / 1000;
+    period.tv_nsec = (long)(st->cch_interval_ms % 1000) * 1000000L;
 
     while (1) {
-        Task* t = queue_pop(&st->traffic_q);
-        /* Execute UPD under write lock */
-        pthread_rwlock_wrlock(&st->graph_lock);
-        char* resp = apply_update(st->g, t->user_id, t->car_id, t->edge_id, t->speed);
-        pthread_rwlock_unlock(&st->graph_lock);
+        nanosleep(&period, NULL);
+
+        int token;
+        const WeightSnapshot* snap = weights_acquire(&st->weights, &token);
+        cch_customize_begin(st->cch, st->g, snap->w);
+        weights_release(&st->weights, token);
 
-        task_complete(t, resp);
-        /* client thread destroys task after sending */
+        cch_customize_finish(st->cch);
     }
     return NULL;
 }
 
-/* ---------------- per-client network thread ---------------- */
+/* ---------------- connection I/O ---------------- */
 
-typedef struct {
-    ServerState* st;
-    int client_fd;
-} ClientCtx;
+static void conn_set_events(Conn* c, unsigned int events) {
+    if (c->events == events) return;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(c->io->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+}
 
-static void* client_thread_main(void* arg) {
-    ClientCtx* ctx = (ClientCtx*)arg;
-    ServerState* st = ctx->st;
-    int client_fd = ctx->client_fd;
+static void conn_free(Conn* c) {
+    for (unsigned int seq = c->seq_out; seq != c->seq_next; seq++) {
+        task_destroy(c->ring[seq % CONN_PIPELINE_MAX]);
+    }
+    while (c->out_head) {
+        Task* t = c->out_head;
+        c->out_head = t->next;
+        task_destroy(t);
+    }
+    free(c->in);
+    free(c);
+}
+
+/* Stop serving c. The struct stays valid until no task refers to it and
+   the epoll batch that closed it is over (conn_release). */
+static void conn_close(Conn* c) {
+    if (c->closed) return;
+    fprintf(stderr, "Client disconnected (fd=%d).\n", c->fd);
+    epoll_ctl(c->io->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->closed = 1;
+}
 
-    fprintf(stderr, "Client connected (fd=%d).\n", client_fd);
+/* Hand a closed, idle connection to io_free_released */
+static void conn_release(Conn* c) {
+    if (!c->closed || c->in_flight || c->released) return;
+    c->released = 1;
+    c->next_released = c->io->released;
+    c->io->released = c;
+}
 
-    char line[1024];
-    while (1) {
-        int r = recv_line(client_fd, line, (int)sizeof(line));
-        if (r == 0) break;
+static void io_free_released(IoThread* io) {
+    while (io->released) {
+        Conn* c = io->released;
+        io->released = c->next_released;
+        conn_free(c);
+    }
+}
+
+/* Send as much pending output as the socket takes. -1 on a dead peer. */
+static int conn_flush(Conn* c) {
+    while (c->out_head) {
+        struct iovec iov[CONN_IOV_MAX];
+        size_t want = 0;
+        int n = 0;
+        for (Task* t = c->out_head; t && n < CONN_IOV_MAX; t = t->next, n++) {
+            size_t skip = n == 0 ? c->out_off : 0;
+            iov[n].iov_base = t->reply + skip;
+            iov[n].iov_len = t->reply_len - skip;
+            want += iov[n].iov_len;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)n;
+        ssize_t r = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
         if (r < 0) {
-            fprintf(stderr, "recv error (fd=%d): %s\n", client_fd, strerror(errno));
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+
+        /* Retire the replies that went out completely */
+        size_t sent = c->out_off + (size_t)r;
+        c->out_bytes -= (size_t)r;
+        while (c->out_head && sent >= c->out_head->reply_len) {
+            Task* t = c->out_head;
+            sent -= t->reply_len;
+            c->out_head = t->next;
+            task_destroy(t);
+        }
+        if (!c->out_head) c->out_tail = NULL;
+        c->out_off = sent;
+
+        if ((size_t)r < want) return 0; /* socket buffer full */
+    }
+    return 0;
+}
+
+/* Queue a task's reply behind any unsent output; conn_process sends it */
+static void conn_enqueue(Conn* c, Task* t) {
+    t->next = NULL;
+    if (c->out_tail) c->out_tail->next = t;
+    else c->out_head = t;
+    c->out_tail = t;
+    c->out_bytes += t->reply_len;
+}
+
+/*
+ * Fill r's reply with resp[0, n), echoing req's req_id into a JSON object
+ * (frames carry it already, and worker replies are built with it)
+ */
+static int task_reply_copy(Task* r, const Task* req, const char* resp, size_t n) {
+    if (!(req && req->has_req_id && !req->binary && n > 1 && resp[0] == '{')) {
+        return task_reply_set_bytes(r, resp, n);
+    }
+    r->req_id = req->req_id;
+    r->has_req_id = 1;
+    char* p = task_reply_open(r, n);
+    if (!p) return 1;
+    if (resp[1] == '}') p--; /* no field follows the req_id */
+    memcpy(p, resp + 1, n - 1);
+    task_reply_close(r, p + n - 1);
+    return 0;
+}
+
+/* Queue a worker's reply; an empty one means it ran out of memory. On
+   failure t is destroyed and the connection closed. */
+static void conn_enqueue_task(Conn* c, Task* t) {
+    static const char no_mem[] = "{\"error\":\"NO_MEM\"}\n";
+    if (t->reply_len == 0) {
+        int rc;
+        if (t->binary) {
+            unsigned char frame[WIRE_SMALL_MAX];
+            size_t n = wire_encode_error(frame, (uint32_t)t->req_id, WIRE_E_NO_MEM,
+                                         t->user_id, t->car_id);
+            rc = task_reply_set_bytes(t, (const char*)frame, n);
+        } else {
+            rc = task_reply_copy(t, t, no_mem, sizeof(no_mem) - 1);
+        }
+        if (rc != 0) {
+            task_destroy(t);
+            conn_close(c);
+            return;
+        }
+    }
+    conn_enqueue(c, t);
+}
+
+/* Move ordered replies from the front of the ring to the out queue while they are ready */
+static void conn_deliver_ordered(Conn* c) {
+    while (!c->closed && c->seq_out != c->seq_next) {
+        Task** slot = &c->ring[c->seq_out % CONN_PIPELINE_MAX];
+        Task* t = *slot;
+        if (!t) break;
+        *slot = NULL;
+        c->seq_out++;
+        conn_enqueue_task(c, t);
+    }
+}
+
+/*
+ * Answer a command on the I/O thread. The reply travels in a Task of its
+ * own (r, from task_create; NULL or an empty reply means out of memory);
+ * in ordered mode it still has to wait behind earlier commands, so it
+ * takes a ring slot.
+ */
+static void conn_reply_task(Conn* c, Task* r) {
+    if (!r || r->reply_len == 0) {
+        task_destroy(r);
+        conn_close(c); /* out of memory; the order promise cannot be kept */
+        return;
+    }
+    if (c->ordered && c->seq_out != c->seq_next) {
+        c->ring[c->seq_next++ % CONN_PIPELINE_MAX] = r;
+        return;
+    }
+    conn_enqueue(c, r);
+}
+
+static void conn_reply_bytes(Conn* c, const Task* req, const char* data, size_t n) {
+    Task* r = task_create(c);
+    if (r && task_reply_copy(r, req, data, n) == 0 && req) r->binary = req->binary;
+    conn_reply_task(c, r);
+}
+
+static void conn_reply(Conn* c, const Task* req, const char* text) {
+    conn_reply_bytes(c, req, text, strlen(text));
+}
+
+/* Room for another command: a free pipeline slot and output not backed up */
+static int conn_can_dispatch(const Conn* c) {
+    return c->in_flight < CONN_PIPELINE_MAX &&
+           c->seq_next - c->seq_out < CONN_PIPELINE_MAX &&
+           c->out_bytes < CONN_OUT_HIGH;
+}
+
+/*
+ * Traffic worker that owns edge_id. Every report on an edge goes through
+ * the same single-consumer queue, so each edge has one writer and its
+ * reports are applied in the order the I/O threads queued them.
+ */
+static int traffic_shard(int edge_id, int shards) {
+    /* Fibonacci hash; the high bits spread consecutive ids evenly */
+    uint32_t h = (uint32_t)edge_id * 2654435761u;
+    return (int)(((uint64_t)h * (uint64_t)shards) >> 32);
+}
+
+/* STATS reply: queue depth of every traffic shard and routing worker, and
+   the commands shed so far. Sized from the worker counts; stays empty if
+   out of memory. */
+static void build_stats_response(ServerState* st, Task* t) {
+    /* depths and counters are 20 digits at most, each depth plus a comma */
+    size_t workers = (size_t)st->traffic_q.workers + (size_t)st->routing_q.workers;
+    t->reply_len = 0;
+    if (task_reply_reserve(t, 80 + 2 * NUMFMT_INT_MAX + workers * (NUMFMT_INT_MAX + 1)) != 0) {
+        return;
+    }
+    char* p = t->reply;
+    p = put_lit(p, "{\"traffic_queues\":[");
+    for (int i = 0; i < st->traffic_q.workers; i++) {
+        if (i) *p++ = ',';
+        p = fmt_int(p, (long long)work_pool_depth(&st->traffic_q, i));
+    }
+    p = put_lit(p, "],\"routing_queues\":[");
+    for (int i = 0; i < st->routing_q.workers; i++) {
+        if (i) *p++ = ',';
+        p = fmt_int(p, (long long)work_pool_depth(&st->routing_q, i));
+    }
+    p = put_lit(p, "],\"rejected\":");
+    p = fmt_int(p, (long long)atomic_load_explicit(&st->rejected, memory_order_relaxed));
+    p = put_lit(p, ",\"expired\":");
+    p = fmt_int(p, (long long)atomic_load_explicit(&st->expired, memory_order_relaxed));
+    p = put_lit(p, "}\n");
+    task_reply_close(t, p);
+}
+
+/* Copy a parsed JSON command into t */
+static void task_from_json(Task* t, const JsonCommand* cmd, int* to_routing) {
+    t->user_id = cmd->user_id;
+    t->car_id = cmd->car_id;
+    t->timestamp = cmd->timestamp;
+    if (cmd->kind == CMD_ROUTE) {
+        t->type = TASK_REQ;
+        t->src = cmd->start_node;
+        t->dst = cmd->destination_node;
+        *to_routing = 1;
+    } else {
+        t->type = TASK_UPD;
+        t->edge_id = cmd->edge_id;
+        t->position = cmd->position_on_edge;
+        t->speed = cmd->speed;
+        *to_routing = 0;
+    }
+}
+
+/*
+ * Parse one command line of len bytes into t. Returns 0 when t is ready
+ * to be queued, otherwise writes the error response for the client into
+ * err. JSON objects go through the single-pass parser (command.h); the
+ * short text forms are kept for backward compatibility.
+ */
+static int parse_command(const char* line, size_t len, Task* t, int* to_routing,
+                         char* err, size_t err_cap) {
+    int src, dst;
+    int edge_id;
+    double speed;
+    double position;
+
+    const char* p = line;
+    while (*p == ' ' || *p == '\t') p++;
+
+    if (*p == '{') {
+        JsonCommand cmd;
+        CommandError rc = command_parse_json(line, len, &cmd);
+        t->has_req_id = (cmd.fields & CMD_F_REQ_ID) != 0;
+        t->req_id = cmd.req_id;
+        if (rc == CMD_OK) {
+            task_from_json(t, &cmd, to_routing);
+            return 0;
+        }
+        if (cmd.error_field) {
+            snprintf(err, err_cap, "{\"error\":\"%s\",\"field\":\"%s\"}\n",
+                     command_error_code(rc), cmd.error_field);
+        } else if (rc == CMD_ERR_SYNTAX || rc == CMD_ERR_TOO_DEEP) {
+            snprintf(err, err_cap, "{\"error\":\"%s\",\"at\":%zu}\n",
+                     command_error_code(rc), cmd.error_pos);
+        } else {
+            snprintf(err, err_cap, "{\"error\":\"%s\"}\n", command_error_code(rc));
+        }
+        return 1;
+    }
+
+    t->has_req_id = 0;
+    if (sscanf(line, "REQ %d %d", &src, &dst) == 2) {
+        /* Backward compatibility */
+        t->type = TASK_REQ;
+        t->user_id = -1;
+        t->car_id = -1;
+        t->src = src;
+        t->dst = dst;
+        *to_routing = 1;
+
+    } else if (sscanf(line, "UPD %d %lf %lf", &edge_id, &speed, &position) >= 2) {
+        /* Backward compatibility */
+        t->type = TASK_UPD;
+        t->user_id = -1;
+        t->car_id = -1;
+        t->edge_id = edge_id;
+        t->speed = speed;
+        *to_routing = 0;
+
+    } else if (sscanf(line, "PRED %d", &edge_id) == 1) {
+        t->type = TASK_PRED;
+        t->pred_edge_id = edge_id;
+        *to_routing = 1;
+
+    } else {
+        snprintf(err, err_cap, "{\"error\":\"UNKNOWN_CMD\"}\n");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Hand a parsed task to the routing pool or its traffic shard. When the
+ * queue is at its limit the command is answered OVERLOADED right away,
+ * in its turn, rather than waiting behind work the server cannot keep
+ * up with.
+ */
+static void conn_dispatch(Conn* c, Task* t, int to_routing) {
+    ServerState* st = c->io->st;
+    t->ordered = c->ordered;
+    if (t->ordered) t->seq = c->seq_next;
+    if (t->type == TASK_REQ && st->deadline_us > 0) t->queued_us = monotonic_us();
+
+    int full;
+    if (to_routing) {
+        full = work_pool_push(&st->routing_q, t);
+    } else {
+        full = work_pool_push_to(&st->traffic_q, traffic_shard(t->edge_id, st->traffic_q.workers), t);
+    }
+    if (!full) {
+        if (t->ordered) c->seq_next++;
+        c->in_flight++;
+        return;
+    }
+
+    atomic_fetch_add_explicit(&st->rejected, 1, memory_order_relaxed);
+    int known = t->type != TASK_PRED; /* PRED carries no user or car */
+    build_error_response(t, "OVERLOADED", known ? t->user_id : -1, known ? t->car_id : -1);
+    if (t->ordered) {
+        c->ring[c->seq_next++ % CONN_PIPELINE_MAX] = t;
+        conn_deliver_ordered(c);
+    } else {
+        conn_enqueue_task(c, t);
+    }
+}
+
+/* Answer a binary request with an ERROR frame from the I/O thread */
+static void conn_reply_wire_error(Conn* c, const Task* req, uint32_t req_id, WireError code) {
+    unsigned char frame[WIRE_SMALL_MAX];
+    size_t n = wire_encode_error(frame, req_id, code, -1, -1);
+    conn_reply_bytes(c, req, (const char*)frame, n);
+}
+
+/*
+ * Binary mode: take one frame off the input and answer or dispatch it.
+ * Returns 0 if a frame was consumed, 1 if more input is needed.
+ */
+static int conn_process_frame(Conn* c) {
+    size_t avail = c->in_len - c->in_off;
+    const unsigned char* p = (const unsigned char*)c->in + c->in_off;
+
+    if (avail < WIRE_LEN_BYTES) goto need_more;
+    uint32_t flen = wire_frame_length(p);
+    if (flen == 0 || flen > WIRE_FRAME_MAX) {
+        /* Framing is lost for good: answer once, then treat it as the
+           end of input so the connection closes after pending replies */
+        conn_reply_wire_error(c, NULL, 0, WIRE_E_BAD_FRAME);
+        c->in_off = c->in_scan = c->in_len;
+        c->peer_closed = 1;
+        return 1;
+    }
+    if (avail - WIRE_LEN_BYTES < flen) goto need_more;
+    c->in_off = c->in_scan = c->in_off + WIRE_LEN_BYTES + flen;
+
+    WireRequest req;
+    int err = wire_decode_request(p + WIRE_LEN_BYTES, flen, &req);
+    Task* t = task_create(c);
+    if (!t) {
+        conn_reply_wire_error(c, NULL, req.req_id, WIRE_E_NO_MEM);
+        return 0;
+    }
+    t->binary = 1;
+    t->has_req_id = 1;
+    t->req_id = req.req_id;
+    if (err != 0) {
+        conn_reply_wire_error(c, t, req.req_id, (WireError)err);
+        task_destroy(t);
+        return 0;
+    }
+
+    int to_routing = 1;
+    t->user_id = req.user_id;
+    t->car_id = req.car_id;
+    t->timestamp = req.timestamp;
+    if (req.type == WIRE_REQ) {
+        t->type = TASK_REQ;
+        t->src = req.start_node;
+        t->dst = req.destination_node;
+    } else if (req.type == WIRE_UPD) {
+        t->type = TASK_UPD;
+        t->edge_id = req.edge_id;
+        t->position = req.position_on_edge;
+        t->speed = req.speed;
+        to_routing = 0;
+    } else {
+        t->type = TASK_PRED;
+        t->pred_edge_id = req.edge_id;
+    }
+    conn_dispatch(c, t, to_routing);
+    return 0;
+
+need_more:
+    if (c->peer_closed) c->in_off = c->in_scan = c->in_len; /* truncated last frame */
+    return 1;
+}
+
+/*
+ * Dispatch buffered lines until the pipeline is full or no full line is
+ * left, send what is queued, then settle the epoll interest and close if
+ * the peer is done.
+ */
+static void conn_process(Conn* c) {
+
+    while (!c->closed && conn_can_dispatch(c)) {
+        if (c->binary) {
+            if (conn_process_frame(c) != 0) break;
+            continue;
+        }
+
+        char* line = c->in + c->in_off;
+        char* nl = NULL;
+        if (c->in_scan < c->in_len) {
+            nl = (char*)memchr(c->in + c->in_scan, '\n', c->in_len - c->in_scan);
+        }
+
+        size_t len;
+        if (nl) {
+            len = (size_t)(nl - line);
+            c->in_off = c->in_scan = (size_t)(nl - c->in) + 1;
+            if (c->discarding) {
+                c->discarding = 0; /* tail of an over-long line */
+                continue;
+            }
+        } else if (c->in_len - c->in_off >= CONN_LINE_MAX || (c->discarding && c->in_len > c->in_off)) {
+            /* No newline within the limit: reject once, drop until one shows up */
+            c->in_off = c->in_scan = c->in_len;
+            if (!c->discarding) {
+                c->discarding = 1;
+                conn_reply(c, NULL, "{\"error\":\"LINE_TOO_LONG\"}\n");
+            }
+            continue;
+        } else if (c->peer_closed && c->in_len > c->in_off) {
+            /* unterminated last line; recv leaves room for the NUL */
+            len = c->in_len - c->in_off;
+            c->in_off = c->in_scan = c->in_len;
+        } else {
+            c->in_scan = c->in_len;
             break;
         }
 
-        trim_crlf(line);
-        if (line[0] == '\0') {
-            send_all(client_fd, "{\"error\":\"EMPTY\"}\n");
+        len = trim_crlf(line, len);
+        if (len == 0) {
+            conn_reply(c, NULL, "{\"error\":\"EMPTY\"}\n");
             continue;
         }
 
-        Task* t = task_create(st->g, &st->graph_lock, client_fd);
-        if (!t) {
-            send_all(client_fd, "{\"error\":\"NO_MEM\"}\n");
+        if (strcmp(line, "STATS") == 0) {
+            Task* r = task_create(c);
+            if (r) build_stats_response(c->io->st, r);
+            conn_reply_task(c, r);
             continue;
         }
 
-        int src, dst;
-        int edge_id;
-        int user_id;
-        int car_id;
-        double speed;
-        double position;
-        double timestamp;
-
-        if (json_extract_int(line, "start_node", &src) &&
-            json_extract_int(line, "destination_node", &dst) &&
-            json_extract_int(line, "user_id", &user_id) &&
-            json_extract_int(line, "car_id", &car_id) &&
-            json_extract_double(line, "timestamp", &timestamp)) {
-            t->type = TASK_REQ;
-            t->user_id = user_id;
-            t->car_id = car_id;
-            t->timestamp = timestamp;
-            t->src = src;
-            t->dst = dst;
-
-            queue_push(&st->routing_q, t);
-
-        } else if (json_extract_int(line, "edge_id", &edge_id) &&
-                   json_extract_double(line, "speed", &speed) &&
-                   json_extract_double(line, "position_on_edge", &position) &&
-                   json_extract_int(line, "user_id", &user_id) &&
-                   json_extract_int(line, "car_id", &car_id) &&
-                   json_extract_double(line, "timestamp", &timestamp)) {
-            t->type = TASK_UPD;
-            t->user_id = user_id;
-            t->car_id = car_id;
-            t->timestamp = timestamp;
-            t->edge_id = edge_id;
-            t->position = position;
-            t->speed = speed;
-
-            queue_push(&st->traffic_q, t);
-
-        } else if (sscanf(line, "REQ %d %d", &src, &dst) == 2) {
-            /* Backward compatibility */
-            t->type = TASK_REQ;
-            t->user_id = -1;
-            t->car_id = -1;
-            t->src = src;
-            t->dst = dst;
-            queue_push(&st->routing_q, t);
-
-        } else if (sscanf(line, "UPD %d %lf %lf", &edge_id, &speed, &position) >= 2) {
-            /* Backward compatibility */
-            t->type = TASK_UPD;
-            t->user_id = -1;
-            t->car_id = -1;
-            t->edge_id = edge_id;
-            t->speed = speed;
-
-            queue_push(&st->traffic_q, t);
-
-        } else if (sscanf(line, "PRED %d", &edge_id) == 1) {
-            t->type = TASK_PRED;
-            t->pred_edge_id = edge_id;
-
-            queue_push(&st->routing_q, t);
+        if (strcmp(line, "PROTO BINARY") == 0) {
+            /* Acknowledged in text; everything after it is framed */
+            conn_reply(c, NULL, "PROTO BINARY\n");
+            c->binary = 1;
+            continue;
+        }
 
-        } else {
-            task_destroy(t);
-            send_all(client_fd, "{\"error\":\"UNKNOWN_CMD\"}\n");
+        if (strncmp(line, "MODE ", 5) == 0) {
+            /* The acknowledgement is still delivered under the old mode */
+            const char* mode = line + 5;
+            if (strcmp(mode, "ORDERED") == 0) {
+                conn_reply(c, NULL, "MODE ORDERED\n");
+                c->ordered = 1;
+            } else if (strcmp(mode, "UNORDERED") == 0) {
+                conn_reply(c, NULL, "MODE UNORDERED\n");
+                c->ordered = 0;
+            } else {
+                conn_reply(c, NULL, "{\"error\":\"BAD_MODE\"}\n");
+            }
             continue;
         }
 
-        /* Wait for worker to finish this task (preserves per-connection order) */
-        pthread_mutex_lock(&t->mu);
-        while (!t->done) {
-            pthread_cond_wait(&t->cv, &t->mu);
+        Task* t = task_create(c);
+        if (!t) {
+            conn_reply(c, NULL, "{\"error\":\"NO_MEM\"}\n");
+            continue;
         }
-        char* resp = t->response;
-        pthread_mutex_unlock(&t->mu);
 
-        if (resp) {
-            send_all(client_fd, resp);
-        } else {
-            send_all(client_fd, "{\"error\":\"INTERNAL\"}\n");
+        int to_routing = 0;
+        char err[PARSE_ERROR_MAX];
+        if (parse_command(line, len, t, &to_routing, err, sizeof(err)) != 0) {
+            conn_reply(c, t, err);
+            task_destroy(t);
+            continue;
         }
 
-        task_destroy(t);
+        conn_dispatch(c, t, to_routing);
     }
 
-    fprintf(stderr, "Client disconnected (fd=%d).\n", client_fd);
-    close(client_fd);
-    free(ctx);
-    return NULL;
+    if (c->closed) return;
+    if (conn_flush(c) != 0) {
+        conn_close(c);
+        return;
+    }
+    if (c->peer_closed && !c->in_flight && c->seq_out == c->seq_next && !c->out_head) {
+        conn_close(c);
+        return;
+    }
+
+    if (c->in_off == c->in_len) c->in_off = c->in_scan = c->in_len = 0;
+
+    unsigned int events = 0;
+    if (conn_can_dispatch(c) && !c->peer_closed && c->in_len - c->in_off < CONN_LINE_MAX) {
+        events |= EPOLLIN;
+    }
+    if (c->out_head) events |= EPOLLOUT;
+    conn_set_events(c, events);
 }
 
-/* ---------------- server_run ---------------- */
+/*
+ * Room for the next recv(): slide unread input to the front when the tail
+ * is short, then grow the buffer. One byte is always kept spare so an
+ * unterminated last line can be NUL-terminated in place.
+ */
+static size_t conn_reserve(Conn* c) {
+    if (c->in_cap - c->in_len < CONN_READ_CHUNK && c->in_off > 0) {
+        memmove(c->in, c->in + c->in_off, c->in_len - c->in_off);
+        c->in_len -= c->in_off;
+        c->in_scan -= c->in_off;
+        c->in_off = 0;
+    }
 
-int server_run(Graph* g, int port) {
-    ServerState st;
-    memset(&st, 0, sizeof(st));
-    st.g = g;
+    const size_t max_cap = (size_t)CONN_LINE_MAX + CONN_READ_CHUNK;
+    if (c->in_cap - c->in_len < CONN_READ_CHUNK && c->in_cap < max_cap) {
+        size_t cap = c->in_cap ? c->in_cap * 2 : CONN_READ_CHUNK;
+        if (cap > max_cap) cap = max_cap;
+        char* in = (char*)realloc(c->in, cap);
+        if (in) {
+            c->in = in;
+            c->in_cap = cap;
+        }
+    }
+    return c->in_cap > c->in_len ? c->in_cap - c->in_len - 1 : 0;
+}
 
-    queue_init(&st.routing_q);
-    queue_init(&st.traffic_q);
+/* Pull what the socket has, stopping once a full line's worth is queued */
+static void conn_on_readable(Conn* c) {
+    while (c->in_len - c->in_off < CONN_LINE_MAX) {
+        size_t room = conn_reserve(c);
+        if (room == 0) {
+            if (c->in_cap == 0) {
+                conn_close(c); /* could not allocate a read buffer */
+                return;
+            }
+            break;
+        }
 
-    if (pthread_rwlock_init(&st.graph_lock, NULL) != 0) {
-        fprintf(stderr, "pthread_rwlock_init failed\n");
-        return 5;
+        ssize_t r = recv(c->fd, c->in + c->in_len, room, 0);
+        if (r == 0) {
+            c->peer_closed = 1;
+            break;
+        }
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            fprintf(stderr, "recv error (fd=%d): %s\n", c->fd, strerror(errno));
+            conn_close(c);
+            return;
+        }
+        c->in_len += (size_t)r;
+        if ((size_t)r < room) break; /* socket drained */
     }
+    conn_process(c);
+}
 
-    /* Start worker pools */
-    for (int i = 0; i < ROUTE_WORKERS; i++) {
-        if (pthread_create(&st.routing_workers[i], NULL, routing_worker_main, &st) != 0) {
-            fprintf(stderr, "pthread_create routing worker failed\n");
-            return 6;
+/*
+ * Move finished tasks from the workers into their connections. Each
+ * connection touched is processed once at the end, so a burst of replies
+ * to a pipelining client goes out in one gather write.
+ */
+static void io_drain_completions(IoThread* io) {
+    uint64_t count;
+    ssize_t r = read(io->wake_fd, &count, sizeof(count));
+    (void)r;
+
+    pthread_mutex_lock(&io->done_mu);
+    Task* t = io->done_head;
+    io->done_head = io->done_tail = NULL;
+    pthread_mutex_unlock(&io->done_mu);
+
+    Conn* dirty = NULL;
+    while (t) {
+        Task* next = t->next;
+        Conn* c = t->conn;
+        c->in_flight--;
+
+        if (c->closed) {
+            task_destroy(t);
+        } else if (t->ordered) {
+            c->ring[t->seq % CONN_PIPELINE_MAX] = t;
+            conn_deliver_ordered(c);
+        } else {
+            conn_enqueue_task(c, t);
+        }
+
+        if (!c->dirty) {
+            c->dirty = 1;
+            c->next_dirty = dirty;
+            dirty = c;
         }
-        pthread_detach(st.routing_workers[i]);
+        t = next;
     }
-    for (int i = 0; i < TRAFFIC_WORKERS; i++) {
-        if (pthread_create(&st.traffic_workers[i], NULL, traffic_worker_main, &st) != 0) {
-            fprintf(stderr, "pthread_create traffic worker failed\n");
-            return 7;
+
+    while (dirty) {
+        Conn* c = dirty;
+        dirty = c->next_dirty;
+        c->dirty = 0;
+        conn_process(c);
+        conn_release(c);
+    }
+}
+
+/* Register a freshly accepted, non-blocking socket with its I/O thread */
+static int io_add_connection(IoThread* io, int fd) {
+    Conn* c = (Conn*)calloc(1, sizeof(Conn));
+    if (!c) return 1;
+    c->fd = fd;
+    c->io = io;
+    c->ordered = 1;
+    c->events = EPOLLIN;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        free(c);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Take pending connections off this thread's listener. The listener is
+ * level-triggered, so stopping after IO_ACCEPT_BATCH leaves the rest for
+ * the next round instead of starving established connections.
+ */
+static void io_accept(IoThread* io) {
+    for (int i = 0; i < IO_ACCEPT_BATCH; i++) {
+        int fd = accept4(io->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+            return;
         }
-        pthread_detach(st.traffic_workers[i]);
+        if (io_add_connection(io, fd) != 0) {
+            fprintf(stderr, "failed to register client (fd=%d)\n", fd);
+            close(fd);
+            continue;
+        }
+        fprintf(stderr, "Client connected (fd=%d).\n", fd);
     }
+}
 
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd < 0) {
-        perror("socket");
-        return 2;
+static void* io_thread_main(void* arg) {
+    IoThread* io = (IoThread*)arg;
+    struct epoll_event events[64];
+
+    while (1) {
+        int n = epoll_wait(io->epfd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            continue;
+        }
+
+        for (int i = 0; i < n; i++) {
+            void* ptr = events[i].data.ptr;
+            if (!ptr) {
+                io_drain_completions(io);
+                continue;
+            }
+            if (ptr == io) {
+                io_accept(io);
+                continue;
+            }
+
+            Conn* c = (Conn*)ptr;
+            unsigned int ev = events[i].events;
+            if ((ev & (EPOLLERR | EPOLLHUP)) && !(ev & EPOLLIN)) {
+                conn_close(c);
+            }
+            if ((ev & EPOLLOUT) && !c->closed) {
+                conn_process(c);
+            }
+            if ((ev & EPOLLIN) && !c->closed) {
+                conn_on_readable(c);
+            }
+            conn_release(c);
+        }
+        io_free_released(io);
     }
+    return NULL;
+}
 
-    int opt = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+static int io_thread_init(IoThread* io, ServerState* st, int listen_fd) {
+    io->st = st;
+    io->listen_fd = listen_fd;
+    io->done_head = io->done_tail = NULL;
+    io->free_tasks = NULL;
+    io->free_count = 0;
+    io->released = NULL;
+    pthread_mutex_init(&io->done_mu, NULL);
+
+    io->epfd = epoll_create1(0);
+    io->wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (io->epfd < 0 || io->wake_fd < 0) return 1;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; /* marks the wakeup fd */
+    if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, io->wake_fd, &ev) != 0) return 1;
+
+    ev.data.ptr = io; /* marks the listener */
+    return epoll_ctl(io->epfd, EPOLL_CTL_ADD, listen_fd, &ev) != 0;
+}
 
+static int bind_port(int fd, int port) {
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_port = htons((unsigned short)port);
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    return bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+/*
+ * SO_REUSEPORT would also let a second server started by mistake share
+ * the port and take a share of the clients. A plain bind first makes
+ * that fail as it always did. 0 if the port is free.
+ */
+static int port_probe(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 2;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    int rc = bind_port(fd, port) < 0 ? 3 : 0;
+    if (rc) perror("bind");
+    close(fd);
+    return rc;
+}
+
+/*
+ * One listening socket on port per I/O thread. SO_REUSEPORT lets them
+ * share the port; the kernel hashes each incoming connection to one of
+ * them, so accepting and its backlog are spread over the threads.
+ * Returns the socket, or -1 with the failure reported and *rc set.
+ */
+static int open_listener(int port, int backlog, int* rc) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        *rc = 2;
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(fd);
+        *rc = 3;
+        return -1;
+    }
 
-    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    if (bind_port(fd, port) < 0) {
         perror("bind");
-        close(listen_fd);
-        return 3;
+        close(fd);
+        *rc = 3;
+        return -1;
     }
 
-    if (listen(listen_fd, 64) < 0) {
+    if (listen(fd, backlog) < 0) {
         perror("listen");
-        close(listen_fd);
-        return 4;
+        close(fd);
+        *rc = 4;
+        return -1;
     }
+    return fd;
+}
+
+/* ---------------- thread placement ---------------- */
+
+/*
+ * Parses a CPU list such as "0-3,8,10-11" into set. NULL leaves the set
+ * empty (no pinning). 0 on success; a malformed list is reported.
+ */
+static int cpu_list_parse(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    if (!list) return 0;
+
+    const char* p = list;
+    while (*p) {
+        char* end = NULL;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (end == p) break;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1) break;
+            p = end;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) break;
+        for (long c = lo; c <= hi; c++) CPU_SET((int)c, set);
 
-    fprintf(stderr, "Server listening on port %d...\n", port);
+        if (*p == '\0') return 0;
+        if (*p != ',') break;
+        p++;
+    }
+    fprintf(stderr, "server_run: bad CPU list '%s' (expected e.g. 0-3,8)\n", list);
+    return 1;
+}
 
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_len);
-        if (client_fd < 0) {
-            perror("accept");
-            continue;
+/* Starts a detached thread, restricted to cpus unless that is NULL */
+static int spawn_thread(pthread_t* th, void* (*fn)(void*), void* arg, const cpu_set_t* cpus) {
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) != 0) return 1;
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (cpus && pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), cpus) != 0) {
+        pthread_attr_destroy(&attr);
+        return 1;
+    }
+    int rc = pthread_create(th, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return rc != 0;
+}
+
+/* ---------------- server_run ---------------- */
+
+void server_config_defaults(ServerConfig* cfg) {
+    cfg->port = 8080;
+    cfg->backlog = LISTEN_BACKLOG;
+    cfg->io_threads = IO_THREADS;
+    cfg->routing_workers = ROUTE_WORKERS;
+    cfg->traffic_workers = TRAFFIC_WORKERS;
+    cfg->io_cpus = NULL;
+    cfg->routing_cpus = NULL;
+    cfg->traffic_cpus = NULL;
+    cfg->route_mode = ROUTE_MODE_ASTAR;
+    cfg->heuristic = ROUTE_HEURISTIC_EUCLIDEAN;
+    cfg->landmarks = NULL;
+    cfg->ch = NULL;
+    cfg->cch = NULL;
+    cfg->cch_interval_ms = 1000;
+    cfg->publish_interval_ms = 5;
+    cfg->traffic_batch = 64;
+    cfg->traffic_flush_us = 0;
+    cfg->routing_queue_limit = WORK_QUEUE_CAPACITY;
+    cfg->traffic_queue_limit = WORK_QUEUE_CAPACITY;
+    cfg->queue_deadline_ms = 0;
+}
+
+int server_run(Graph* g, const ServerConfig* cfg) {
+    ServerState st;
+    memset(&st, 0, sizeof(st));
+    st.g = g;
+    st.route_mode = cfg->route_mode;
+    st.ch = cfg->ch;
+    st.cch = cfg->cch;
+    st.cch_interval_ms = cfg->cch_interval_ms > 0 ? cfg->cch_interval_ms : 1000;
+    st.publish_interval_ms = cfg->publish_interval_ms > 0 ? cfg->publish_interval_ms : 5;
+    st.traffic_batch = cfg->traffic_batch > 0 ? cfg->traffic_batch : 1;
+    if (st.traffic_batch > TRAFFIC_BATCH_MAX) st.traffic_batch = TRAFFIC_BATCH_MAX;
+    st.traffic_flush_us = cfg->traffic_flush_us > 0 ? cfg->traffic_flush_us : 0;
+    st.deadline_us = cfg->queue_deadline_ms > 0 ? cfg->queue_deadline_ms * 1000LL : 0;
+    atomic_init(&st.rejected, 0);
+    atomic_init(&st.expired, 0);
+    int port = cfg->port;
+    int backlog = cfg->backlog > 0 ? cfg->backlog : LISTEN_BACKLOG;
+
+    if (st.route_mode == ROUTE_MODE_CH && !st.ch) {
+        fprintf(stderr, "server_run: CH routing needs a contraction hierarchy\n");
+        return 10;
+    }
+    if (st.route_mode == ROUTE_MODE_CCH && !st.cch) {
+        fprintf(stderr, "server_run: CCH routing needs a customizable hierarchy\n");
+        return 10;
+    }
+
+    int routing_workers = cfg->routing_workers > 0 ? cfg->routing_workers : ROUTE_WORKERS;
+    int traffic_workers = cfg->traffic_workers > 0 ? cfg->traffic_workers : TRAFFIC_WORKERS;
+    st.io_threads = cfg->io_threads > 0 ? cfg->io_threads : IO_THREADS;
+
+    /* Checked before anything starts so a typo is not a half-pinned server */
+    cpu_set_t io_cpus, routing_cpus, traffic_cpus;
+    if (cpu_list_parse(cfg->io_cpus, &io_cpus) != 0 ||
+        cpu_list_parse(cfg->routing_cpus, &routing_cpus) != 0 ||
+        cpu_list_parse(cfg->traffic_cpus, &traffic_cpus) != 0) {
+        return 14;
+    }
+
+    size_t routing_limit = cfg->routing_queue_limit > 0 ? (size_t)cfg->routing_queue_limit
+                                                        : WORK_QUEUE_CAPACITY;
+    size_t traffic_limit = cfg->traffic_queue_limit > 0 ? (size_t)cfg->traffic_queue_limit
+                                                        : WORK_QUEUE_CAPACITY;
+    if (work_pool_init(&st.routing_q, routing_workers, routing_limit, 1) != 0 ||
+        work_pool_init(&st.traffic_q, traffic_workers, traffic_limit, 0) != 0) {
+        fprintf(stderr, "work_pool_init failed\n");
+        return 5;
+    }
+
+    if (traffic_init(&st.traffic, g) != 0) {
+        return 8;
+    }
+
+    if (weights_init(&st.weights, g) != 0) {
+        return 5;
+    }
+
+    /* Workspaces are allocated up front so a failure is reported here */
+    RoutingWorker* routing_ctx = (RoutingWorker*)calloc((size_t)routing_workers, sizeof(RoutingWorker));
+    TrafficWorker* traffic_ctx = (TrafficWorker*)calloc((size_t)traffic_workers, sizeof(TrafficWorker));
+    st.io = (IoThread*)calloc((size_t)st.io_threads, sizeof(IoThread));
+    if (!routing_ctx || !traffic_ctx || !st.io) {
+        fprintf(stderr, "server_run: thread state allocation failed\n");
+        return 9;
+    }
+    for (int i = 0; i < routing_workers; i++) {
+        routing_ctx[i].st = &st;
+        routing_ctx[i].index = i;
+        if (routing_workspace_init(&routing_ctx[i].ws, g->num_nodes) != 0) {
+            fprintf(stderr, "routing_workspace_init failed\n");
+            return 9;
         }
+        if (routing_workspace_set_heuristic(&routing_ctx[i].ws, cfg->heuristic, cfg->landmarks) != 0) {
+            fprintf(stderr, "server_run: %s heuristic needs matching landmarks\n",
+                    routing_heuristic_name(cfg->heuristic));
+            return 9;
+        }
+    }
 
-        ClientCtx* ctx = (ClientCtx*)malloc(sizeof(ClientCtx));
-        if (!ctx) {
-            fprintf(stderr, "malloc failed\n");
-            close(client_fd);
-            continue;
+    /* Start worker pools */
+    for (int i = 0; i < routing_workers; i++) {
+        if (spawn_thread(&routing_ctx[i].thread, routing_worker_main, &routing_ctx[i],
+                         cfg->routing_cpus ? &routing_cpus : NULL) != 0) {
+            fprintf(stderr, "pthread_create routing worker failed\n");
+            return 6;
+        }
+    }
+    for (int i = 0; i < traffic_workers; i++) {
+        if (traffic_worker_init(&traffic_ctx[i], &st, i) != 0) {
+            fprintf(stderr, "traffic worker allocation failed\n");
+            return 7;
+        }
+        if (spawn_thread(&traffic_ctx[i].thread, traffic_worker_main, &traffic_ctx[i],
+                         cfg->traffic_cpus ? &traffic_cpus : NULL) != 0) {
+            fprintf(stderr, "pthread_create traffic worker failed\n");
+            return 7;
         }
-        ctx->st = &st;
-        ctx->client_fd = client_fd;
+    }
+    if (spawn_thread(&st.publisher, weights_publisher_main, &st, NULL) != 0) {
+        fprintf(stderr, "pthread_create weights publisher failed\n");
+        return 13;
+    }
+    if (st.route_mode == ROUTE_MODE_CCH) {
+        if (spawn_thread(&st.customizer, cch_customizer_main, &st, NULL) != 0) {
+            fprintf(stderr, "pthread_create CCH customizer failed\n");
+            return 11;
+        }
+    }
 
-        pthread_t tid;
-        if (pthread_create(&tid, NULL, client_thread_main, ctx) != 0) {
-            fprintf(stderr, "pthread_create client thread failed\n");
-            close(client_fd);
-            free(ctx);
-            continue;
+    /* All listeners are bound before any accepts, so a port conflict is
+       reported once and no thread serves a half-started server */
+    int probe_rc = port_probe(port);
+    if (probe_rc != 0) return probe_rc;
+    for (int i = 0; i < st.io_threads; i++) {
+        int rc = 0;
+        st.io[i].listen_fd = open_listener(port, backlog, &rc);
+        if (st.io[i].listen_fd < 0) return rc;
+    }
+
+    for (int i = 0; i < st.io_threads; i++) {
+        if (io_thread_init(&st.io[i], &st, st.io[i].listen_fd) != 0) {
+            perror("io thread setup");
+            return 12;
+        }
+        if (spawn_thread(&st.io[i].thread, io_thread_main, &st.io[i],
+                         cfg->io_cpus ? &io_cpus : NULL) != 0) {
+            fprintf(stderr, "pthread_create I/O thread failed\n");
+            return 12;
         }
-        pthread_detach(tid);
     }
 
+    fprintf(stderr, "Server listening on port %d (routing: %s, heuristic: %s, "
+            "threads: %d I/O, %d routing, %d traffic)...\n",
+            port, routing_mode_name(st.route_mode), routing_heuristic_name(cfg->heuristic),
+            st.io_threads, routing_workers, traffic_workers);
+
+    /* Accepting happens on the I/O threads; this one only keeps st alive */
+    while (1) pause();
+
     /* Unreachable in this assignment version */
-    close(listen_fd);
-    pthread_rwlock_destroy(&st.graph_lock);
+    for (int i = 0; i < st.io_threads; i++) {
+        close(st.io[i].listen_fd);
+    }
+    weights_free(&st.weights);
+    traffic_free(&st.traffic);
+    work_pool_free(&st.routing_q);
+    work_pool_free(&st.traffic_q);
+    for (int i = 0; i < routing_workers; i++) {
+        routing_workspace_free(&routing_ctx[i].ws);
+    }
+    free(routing_ctx);
+    free(traffic_ctx);
+    free(st.io);
     return 0;
 }
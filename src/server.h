@@ -2,7 +2,55 @@
 #define SERVER_H
 
 #include "graph.h"
+#include "routing.h"
+#include "ch.h"
+#include "cch.h"
+#include "alt.h"
 
-int server_run(Graph* g, int port);
+/* Upper bound for each thread count below */
+#define SERVER_THREADS_MAX 1024
+
+/* Upper bound for the listen backlog (the kernel caps it at somaxconn) */
+#define SERVER_BACKLOG_MAX 65535
+
+/* Upper bound for the per-worker queue limits */
+#define SERVER_QUEUE_LIMIT_MAX (1 << 24)
+
+/* Per-instance server settings */
+typedef struct {
+    int port;
+    int backlog;            /* pending connections per listening socket */
+    int io_threads;         /* event-loop threads, each with its own listener */
+    int routing_workers;    /* REQ / PRED pool */
+    int traffic_workers;    /* UPD pool, one edge shard per worker */
+    /* CPU lists such as "0-3,8" each pool's threads are restricted to;
+       NULL leaves the pool unpinned */
+    const char* io_cpus;
+    const char* routing_cpus;
+    const char* traffic_cpus;
+    RouteMode route_mode;   /* search used for REQ commands */
+    RouteHeuristic heuristic;           /* lower bound for the A* modes */
+    const Landmarks* landmarks;         /* required for ROUTE_HEURISTIC_ALT */
+    const ContractionHierarchy* ch;  /* required for ROUTE_MODE_CH */
+    CustomizableCH* cch;    /* required for ROUTE_MODE_CCH */
+    int cch_interval_ms;    /* period of CCH re-customization with live weights */
+    int publish_interval_ms; /* period of weight snapshot publication */
+    int traffic_batch;      /* most UPDs a traffic worker applies together */
+    int traffic_flush_us;   /* time a traffic worker waits to fill a batch (0: none) */
+    /* Load shedding: commands beyond a queue's limit are answered
+       OVERLOADED at once, and routing requests that waited longer than
+       the deadline are answered OVERLOADED instead of being routed */
+    int routing_queue_limit; /* per routing worker */
+    int traffic_queue_limit; /* per traffic shard */
+    int queue_deadline_ms;  /* 0: requests never expire */
+} ServerConfig;
+
+/* Fills cfg with the defaults (port 8080, backlog 1024, 4 I/O threads, 8 routing and
+   2 traffic workers, unpinned, unidirectional A* with the Euclidean
+   bound, 1 s CCH period, traffic batches of up to 64 taken from what is
+   already queued, 4096 queued commands per worker, no deadline) */
+void server_config_defaults(ServerConfig* cfg);
+
+int server_run(Graph* g, const ServerConfig* cfg);
 
 #endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "traffic.h"
+
+static uint64_t double_bits(double v)
+{
+    uint64_t b;
+    memcpy(&b, &v, sizeof(b));
+    return b;
+}
+
+static double bits_double(uint64_t b)
+{
+    double v;
+    memcpy(&v, &b, sizeof(v));
+    return v;
+}
+
+int traffic_init(TrafficTable* t, const Graph* g)
+{
+    if (!t || !g) {
+        fprintf(stderr, "traffic_init: NULL argument\n");
+        return 1;
+    }
+
+    t->num_edges = g->num_edges;
+    t->stats = (EdgeStats*)malloc(sizeof(EdgeStats) * (size_t)(g->num_edges > 0 ? g->num_edges : 1));
+    if (!t->stats) {
+        fprintf(stderr, "traffic_init: failed to allocate edge stats\n");
+        return 2;
+    }
+
+    for (int i = 0; i < g->num_edges; i++) {
+        atomic_init(&t->stats[i].ema_bits, TRAFFIC_EMA_NONE);
+        t->stats[i].seed = g->out_weights[g->edge_slot[i]];
+    }
+
+    return 0;
+}
+
+
+void traffic_free(TrafficTable* t)
+{
+    if (!t) return;
+    free(t->stats);
+    t->stats = NULL;
+    t->num_edges = 0;
+}
+
+
+/* Clamps a reported speed as described in traffic.h (NaN becomes the minimum) */
+static double clamp_speed(const Edge* e, double speed)
+{
+    if (!(speed >= TRAFFIC_SPEED_MIN)) return TRAFFIC_SPEED_MIN;
+    double max_speed = TRAFFIC_SPEED_FACTOR_MAX * e->base_speed_limit;
+    if (max_speed > 0.0 && speed > max_speed) return max_speed;
+    return speed;
+}
+
+double traffic_observe(TrafficTable* t, const Graph* g, int edge_id, double speed)
+{
+    const Edge* e = &g->edges[edge_id];
+    speed = clamp_speed(e, speed);
+
+    EdgeStats* s = &t->stats[edge_id];
+    const double alpha = 0.2;
+    double measured = e->base_length / speed;
+
+    /* The first observation replaces the seed; later ones blend in. If
+       another report lands in between, the CAS fails and we fold into
+       its result instead, so no observation is lost. */
+    uint64_t old = atomic_load_explicit(&s->ema_bits, memory_order_relaxed);
+    for (;;) {
+        double next = (old == TRAFFIC_EMA_NONE)
+                    ? measured
+                    : alpha * measured + (1.0 - alpha) * bits_double(old);
+        if (atomic_compare_exchange_weak_explicit(&s->ema_bits, &old, double_bits(next),
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+            return next;
+        }
+    }
+}
+
+
+double traffic_observe_many(TrafficTable* t, const Graph* g, int edge_id,
+                            const double* speeds, int n)
+{
+    const double alpha = 0.2;
+    const Edge* e = &g->edges[edge_id];
+    double length = e->base_length;
+
+    /* k single steps from e0 expand to
+         e_k = (1-a)^k e0 + sum_i a (1-a)^(k-i) x_i
+       so the batch reduces to one decay factor and one sum. With no prior
+       observation x_1 stands in for e0, as in traffic_observe. */
+    double decay = 1.0, sum = 0.0, first = 0.0;
+    for (int i = 0; i < n; i++) {
+        double measured = length / clamp_speed(e, speeds[i]);
+        if (i == 0) first = measured;
+        sum = alpha * measured + (1.0 - alpha) * sum;
+        decay *= 1.0 - alpha;
+    }
+
+    EdgeStats* s = &t->stats[edge_id];
+    uint64_t old = atomic_load_explicit(&s->ema_bits, memory_order_relaxed);
+    for (;;) {
+        double base = (old == TRAFFIC_EMA_NONE) ? first : bits_double(old);
+        double next = decay * base + sum;
+        if (atomic_compare_exchange_weak_explicit(&s->ema_bits, &old, double_bits(next),
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+            return next;
+        }
+    }
+}
+
+double traffic_predict(const TrafficTable* t, int edge_id)
+{
+    const EdgeStats* s = &t->stats[edge_id];
+    uint64_t b = atomic_load_explicit(&s->ema_bits, memory_order_acquire);
+    return (b == TRAFFIC_EMA_NONE) ? s->seed : bits_double(b);
+}
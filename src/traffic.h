@@ -0,0 +1,71 @@
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <stdatomic.h>
+#include "graph.h"
+
+/*
+ * Historical statistics for one edge (for traffic updates / prediction).
+ * The EMA is a double stored as its bit pattern in one atomic word, so
+ * concurrent reports on the same edge fold in with a compare-and-swap and
+ * readers never see a torn value. TRAFFIC_EMA_NONE marks an edge with no
+ * observation yet; its travel time is then still the seed.
+ */
+typedef struct {
+    atomic_uint_least64_t ema_bits;
+    double seed;            /* travel time when the table was created */
+} EdgeStats;
+
+#define TRAFFIC_EMA_NONE UINT64_MAX
+
+/*
+ * Reported speeds are clamped to [TRAFFIC_SPEED_MIN, TRAFFIC_SPEED_FACTOR_MAX
+ * x the edge's speed limit] before they are folded in, so one bogus
+ * report cannot drive an edge's travel time (and the graph-wide bounds
+ * derived from it) to zero. Edges without a positive limit are only
+ * clamped from below.
+ */
+#define TRAFFIC_SPEED_MIN 1e-6
+#ifndef TRAFFIC_SPEED_FACTOR_MAX
+#define TRAFFIC_SPEED_FACTOR_MAX 3.0
+#endif
+
+/*
+ * Cold per-edge traffic state, indexed by edge_id. Kept apart from the
+ * graph so the routing loop never pulls statistics into cache. Safe to
+ * update and read from any number of threads without a lock.
+ */
+typedef struct {
+    EdgeStats* stats;
+    int num_edges;
+} TrafficTable;
+
+/**
+ * Allocates one EdgeStats per graph edge, seeded with the edge's current
+ * travel time. Returns 0 on success, non-zero on error.
+ */
+int traffic_init(TrafficTable* t, const Graph* g);
+void traffic_free(TrafficTable* t);
+
+/**
+ * Folds one speed observation for edge_id into its EMA and returns the new
+ * value. Lock-free; the graph is only read (edge lengths). Publishing the
+ * result as the edge's travel time is up to the caller, e.g. through
+ * graph_set_travel_time or a weight snapshot (weights.h).
+ * Caller validates edge_id and speed.
+ */
+double traffic_observe(TrafficTable* t, const Graph* g, int edge_id, double speed);
+
+/**
+ * Folds n observations for edge_id, in order, with a single CAS. The
+ * result equals n successive traffic_observe calls (up to rounding), so
+ * a batch of reports on one edge costs one contended write.
+ * n >= 1; caller validates edge_id and speeds.
+ */
+double traffic_observe_many(TrafficTable* t, const Graph* g, int edge_id,
+                            const double* speeds, int n);
+
+/* Predicted travel time: EMA if observed, the seed otherwise */
+double traffic_predict(const TrafficTable* t, int edge_id);
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <stdint.h>
+#include "weights.h"
+
+int weights_init(WeightStore* ws, const Graph* g)
+{
+    if (!ws || !g) {
+        fprintf(stderr, "weights_init: NULL argument\n");
+        return 1;
+    }
+    memset(ws, 0, sizeof(*ws));
+
+    size_t n = (size_t)(g->num_edges > 0 ? g->num_edges : 1);
+    ws->num_slots = g->num_edges;
+    ws->snap[0].w = (double*)malloc(sizeof(double) * n);
+    ws->snap[1].w = (double*)malloc(sizeof(double) * n);
+    ws->dirty_prev = (int*)malloc(sizeof(int) * n);
+    ws->dirty_cur = (int*)malloc(sizeof(int) * n);
+    ws->dirty_epoch = (unsigned long*)calloc(n, sizeof(unsigned long));
+    ws->pending = (atomic_uchar*)malloc(sizeof(atomic_uchar) * n);
+    if (!ws->snap[0].w || !ws->snap[1].w || !ws->dirty_prev || !ws->dirty_cur ||
+        !ws->dirty_epoch || !ws->pending || mpmc_init(&ws->changed, n) != 0) {
+        fprintf(stderr, "weights_init: allocation failed\n");
+        weights_free(ws);
+        return 2;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        memcpy(ws->snap[i].w, g->out_weights, sizeof(double) * (size_t)g->num_edges);
+        ws->snap[i].stats = g->stats;
+        ws->snap[i].epoch = 0;
+    }
+    for (size_t i = 0; i < n; i++) atomic_init(&ws->pending[i], 0);
+    ws->interval = 1;
+
+    atomic_init(&ws->current, 0);
+    atomic_init(&ws->readers[0], 0);
+    atomic_init(&ws->readers[1], 0);
+    return 0;
+}
+
+void weights_free(WeightStore* ws)
+{
+    if (!ws) return;
+    free(ws->snap[0].w);
+    free(ws->snap[1].w);
+    free(ws->dirty_prev);
+    free(ws->dirty_cur);
+    free(ws->dirty_epoch);
+    free((void*)ws->pending);
+    mpmc_free(&ws->changed);
+    ws->snap[0].w = ws->snap[1].w = NULL;
+    ws->dirty_prev = ws->dirty_cur = NULL;
+    ws->dirty_epoch = NULL;
+    ws->pending = NULL;
+}
+
+void weights_mark_dirty(WeightStore* ws, int slot)
+{
+    /* A slot sits in the queue at most once, so it never overflows. The
+       publisher clears the flag before it reads the new value; a change
+       made after that read finds the flag clear and queues the slot again. */
+    if (atomic_exchange(&ws->pending[slot], 1)) return;
+    while (mpmc_push(&ws->changed, (void*)(intptr_t)(slot + 1)) != 0) sched_yield();
+}
+
+/* Move reported slots onto the publisher's dirty list */
+static void weights_collect(WeightStore* ws, Graph* g, WeightRefreshFn refresh, void* ctx)
+{
+    /* Bounded so a stream of reports on hot edges cannot hold up publishing */
+    for (int n = 0; n < ws->num_slots; n++) {
+        void* item = mpmc_pop(&ws->changed);
+        if (!item) break;
+        int slot = (int)(intptr_t)item - 1;
+        atomic_store(&ws->pending[slot], 0);
+        if (refresh) refresh(ctx, g, slot);
+
+        if (ws->dirty_epoch[slot] != ws->interval) {
+            ws->dirty_epoch[slot] = ws->interval;
+            ws->dirty_cur[ws->dirty_cur_len++] = slot;
+        }
+    }
+}
+
+int weights_publish(WeightStore* ws, Graph* g, WeightRefreshFn refresh, void* ctx)
+{
+    /* Queries that pinned the back snapshot before the last swap finish
+       on their own; new ones cannot pin it while it is not current. */
+    int back = 1 - atomic_load(&ws->current);
+    while (atomic_load(&ws->readers[back]) != 0) sched_yield();
+
+    weights_collect(ws, g, refresh, ctx);
+    int cur = 1 - back;
+    if (ws->dirty_cur_len == 0 &&
+        memcmp(&ws->snap[cur].stats, &g->stats, sizeof(GraphStats)) == 0) {
+        return 0;
+    }
+
+    /* back is two publishes old: it lacks both the previous interval's
+       changes and this one's */
+    WeightSnapshot* s = &ws->snap[back];
+    if ((size_t)ws->dirty_prev_len + (size_t)ws->dirty_cur_len > (size_t)ws->num_slots / 2) {
+        memcpy(s->w, g->out_weights, sizeof(double) * (size_t)ws->num_slots);
+    } else {
+        for (int i = 0; i < ws->dirty_prev_len; i++) {
+            int slot = ws->dirty_prev[i];
+            s->w[slot] = g->out_weights[slot];
+        }
+        for (int i = 0; i < ws->dirty_cur_len; i++) {
+            int slot = ws->dirty_cur[i];
+            s->w[slot] = g->out_weights[slot];
+        }
+    }
+    s->stats = g->stats;
+    s->epoch = ws->interval;
+
+    int* t = ws->dirty_prev;
+    ws->dirty_prev = ws->dirty_cur;
+    ws->dirty_prev_len = ws->dirty_cur_len;
+    ws->dirty_cur = t;
+    ws->dirty_cur_len = 0;
+    ws->interval++;
+
+    atomic_store(&ws->current, back);
+    return 1;
+}
+
+const WeightSnapshot* weights_acquire(WeightStore* ws, int* token)
+{
+    /* Re-check after registering so the publisher cannot have started
+       rewriting the buffer we are about to read */
+    int idx;
+    for (;;) {
+        idx = atomic_load(&ws->current);
+        atomic_fetch_add(&ws->readers[idx], 1);
+        if (atomic_load(&ws->current) == idx) break;
+        atomic_fetch_sub(&ws->readers[idx], 1);
+    }
+    *token = idx;
+    return &ws->snap[idx];
+}
+
+void weights_release(WeightStore* ws, int token)
+{
+    atomic_fetch_sub(&ws->readers[token], 1);
+}
@@ -0,0 +1,81 @@
+#ifndef WEIGHTS_H
+#define WEIGHTS_H
+
+#include <stdatomic.h>
+
+#include "graph.h"
+#include "work_queue.h"
+
+/* One published version of the travel times, indexed by CSR slot like
+   g->out_weights, with the graph bounds that were current alongside them */
+typedef struct {
+    double* w;
+    GraphStats stats;
+    unsigned long epoch;
+} WeightSnapshot;
+
+/*
+ * Refreshes g's live travel time for one CSR slot (typically
+ * graph_set_travel_time from the latest traffic EMA). Called by
+ * weights_publish for every slot reported since the last publish.
+ */
+typedef void (*WeightRefreshFn)(void* ctx, Graph* g, int slot);
+
+/*
+ * Double-buffered travel-time snapshots for lock-free routing.
+ *
+ * Any thread may report a changed edge with weights_mark_dirty; reports
+ * go through a per-slot pending flag and a lock-free queue, so concurrent
+ * writers on different edges never contend. weights_publish, run
+ * periodically by one thread, drains the reports, refreshes g's live
+ * arrays for those slots, brings the back snapshot up to date and swaps
+ * it in atomically. The publisher is the only thread that writes g's live
+ * travel times and stats while the store is in use.
+ *
+ * Readers pin the published snapshot for the duration of a query and
+ * never block; the publisher only reuses a buffer once its readers are
+ * gone. The back buffer missed the changes of the last two publish
+ * intervals, so only slots dirtied in those intervals are copied.
+ */
+typedef struct {
+    int num_slots;
+    WeightSnapshot snap[2];
+    atomic_int current;         /* index of the published snapshot */
+    atomic_int readers[2];      /* queries pinning each snapshot */
+
+    /* writer side */
+    atomic_uchar* pending;      /* per slot: queued in changed */
+    MpmcQueue changed;          /* reported slots (slot + 1) */
+
+    /* publisher side */
+    int* dirty_prev;            /* slots changed in the previous interval */
+    int dirty_prev_len;
+    int* dirty_cur;             /* slots changed since the last publish */
+    int dirty_cur_len;
+    unsigned long* dirty_epoch; /* per slot: interval it was last listed in */
+    unsigned long interval;     /* current interval, = last published epoch + 1 */
+} WeightStore;
+
+/* Both snapshots start as copies of the graph's current travel times. 0 on success. */
+int weights_init(WeightStore* ws, const Graph* g);
+void weights_free(WeightStore* ws);
+
+/* Reports that the travel time of a CSR slot changed. Lock-free, any thread. */
+void weights_mark_dirty(WeightStore* ws, int slot);
+
+/*
+ * Publishes the reported changes if there are any, or g->stats alone if
+ * they differ from the published ones (e.g. rebuilt by
+ * graph_compute_stats). refresh (if non-NULL)
+ * is called for each reported slot first; with NULL, g's live arrays are
+ * assumed to be current already. Waits for queries still pinning the back
+ * snapshot. Returns 1 if a new snapshot was published, 0 otherwise.
+ * Only one thread may publish.
+ */
+int weights_publish(WeightStore* ws, Graph* g, WeightRefreshFn refresh, void* ctx);
+
+/* Pins the published snapshot; *token is passed back to weights_release */
+const WeightSnapshot* weights_acquire(WeightStore* ws, int* token);
+void weights_release(WeightStore* ws, int token);
+
+#endif
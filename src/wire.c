@@ -0,0 +1,173 @@
+#include "wire.h"
+
+#include <string.h>
+
+/* ---------------- little-endian fields ---------------- */
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int32_t get_i32(const unsigned char* p) {
+    return (int32_t)get_u32(p);
+}
+
+static double get_f64(const unsigned char* p) {
+    uint64_t b = (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+    double v;
+    memcpy(&v, &b, sizeof(v));
+    return v;
+}
+
+static unsigned char* put_u8(unsigned char* p, uint8_t v) {
+    *p = v;
+    return p + 1;
+}
+
+static unsigned char* put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+    return p + 4;
+}
+
+static unsigned char* put_i32(unsigned char* p, int32_t v) {
+    return put_u32(p, (uint32_t)v);
+}
+
+static unsigned char* put_f64(unsigned char* p, double v) {
+    uint64_t b;
+    memcpy(&b, &v, sizeof(b));
+    p = put_u32(p, (uint32_t)b);
+    return put_u32(p, (uint32_t)(b >> 32));
+}
+
+/* Small signed deltas become small unsigned values: 0,-1,1,-2 -> 0,1,2,3 */
+static unsigned char* put_zigzag(unsigned char* p, int64_t v) {
+    uint64_t u = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    while (u >= 0x80) {
+        *p++ = (unsigned char)(u | 0x80);
+        u >>= 7;
+    }
+    *p++ = (unsigned char)u;
+    return p;
+}
+
+/* Writes the length once the frame's end is known */
+static size_t finish_frame(unsigned char* out, unsigned char* end) {
+    size_t n = (size_t)(end - out);
+    put_u32(out, (uint32_t)(n - WIRE_LEN_BYTES));
+    return n;
+}
+
+/* ---------------- requests ---------------- */
+
+uint32_t wire_frame_length(const unsigned char* p) {
+    return get_u32(p);
+}
+
+int wire_decode_request(const unsigned char* body, size_t len, WireRequest* out) {
+    memset(out, 0, sizeof(*out));
+    if (len < 1) return WIRE_E_BAD_FRAME;
+    out->type = (WireType)body[0];
+    const unsigned char* p = body + 1;
+    size_t n = len - 1;
+    if (n >= 4) out->req_id = get_u32(p);
+
+    switch (out->type) {
+    case WIRE_REQ:
+        if (n != WIRE_REQ_SIZE) return WIRE_E_BAD_FRAME;
+        out->user_id = get_i32(p + 4);
+        out->car_id = get_i32(p + 8);
+        out->timestamp = get_f64(p + 12);
+        out->start_node = get_i32(p + 20);
+        out->destination_node = get_i32(p + 24);
+        return 0;
+    case WIRE_UPD:
+        if (n != WIRE_UPD_SIZE) return WIRE_E_BAD_FRAME;
+        out->user_id = get_i32(p + 4);
+        out->car_id = get_i32(p + 8);
+        out->timestamp = get_f64(p + 12);
+        out->edge_id = get_i32(p + 20);
+        out->position_on_edge = get_f64(p + 24);
+        out->speed = get_f64(p + 32);
+        return 0;
+    case WIRE_PRED:
+        if (n != WIRE_PRED_SIZE) return WIRE_E_BAD_FRAME;
+        out->edge_id = get_i32(p + 4);
+        return 0;
+    default:
+        return WIRE_E_UNKNOWN_TYPE;
+    }
+}
+
+/* ---------------- replies ---------------- */
+
+size_t wire_route_max(int edge_count) {
+    /* header, fixed fields, and at most 5 varint bytes per 32-bit delta */
+    return WIRE_LEN_BYTES + 1 + 4 + 4 + 4 + 8 + 4 + (size_t)edge_count * 5;
+}
+
+size_t wire_encode_route(unsigned char* out, uint32_t req_id, int32_t user_id, int32_t car_id,
+                         double eta, const int* edges, int edge_count) {
+    unsigned char* p = out + WIRE_LEN_BYTES;
+    p = put_u8(p, WIRE_ROUTE);
+    p = put_u32(p, req_id);
+    p = put_i32(p, user_id);
+    p = put_i32(p, car_id);
+    p = put_f64(p, eta);
+    p = put_u32(p, (uint32_t)edge_count);
+
+    int64_t prev = 0;
+    for (int i = 0; i < edge_count; i++) {
+        p = put_zigzag(p, (int64_t)edges[i] - prev);
+        prev = edges[i];
+    }
+    return finish_frame(out, p);
+}
+
+size_t wire_encode_ack(unsigned char* out, uint32_t req_id, int32_t user_id, int32_t car_id) {
+    unsigned char* p = out + WIRE_LEN_BYTES;
+    p = put_u8(p, WIRE_ACK);
+    p = put_u32(p, req_id);
+    p = put_i32(p, user_id);
+    p = put_i32(p, car_id);
+    return finish_frame(out, p);
+}
+
+size_t wire_encode_prediction(unsigned char* out, uint32_t req_id, int32_t edge_id, double value) {
+    unsigned char* p = out + WIRE_LEN_BYTES;
+    p = put_u8(p, WIRE_PREDICTION);
+    p = put_u32(p, req_id);
+    p = put_i32(p, edge_id);
+    p = put_f64(p, value);
+    return finish_frame(out, p);
+}
+
+size_t wire_encode_error(unsigned char* out, uint32_t req_id, WireError code,
+                         int32_t user_id, int32_t car_id) {
+    unsigned char* p = out + WIRE_LEN_BYTES;
+    p = put_u8(p, WIRE_ERROR);
+    p = put_u32(p, req_id);
+    p = put_u8(p, (uint8_t)code);
+    p = put_i32(p, user_id);
+    p = put_i32(p, car_id);
+    return finish_frame(out, p);
+}
+
+WireError wire_error_from_name(const char* name) {
+    static const struct { const char* name; WireError code; } names[] = {
+        { "NO_MEM", WIRE_E_NO_MEM },
+        { "BAD_NODES", WIRE_E_BAD_NODES },
+        { "NO_ROUTE", WIRE_E_NO_ROUTE },
+        { "ROUTE_FAIL", WIRE_E_ROUTE_FAIL },
+        { "BAD_EDGE", WIRE_E_BAD_EDGE },
+        { "BAD_SPEED", WIRE_E_BAD_SPEED },
+        { "OVERLOADED", WIRE_E_OVERLOADED },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i].name) == 0) return names[i].code;
+    }
+    return WIRE_E_INTERNAL;
+}
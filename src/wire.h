@@ -0,0 +1,110 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary protocol, enabled per connection with the text command
+ * "PROTO BINARY". Every message in either direction is a frame:
+ *
+ *   u32 length    bytes that follow (type + payload)
+ *   u8  type
+ *   payload       fixed layout per type
+ *
+ * All integers are little-endian, doubles are IEEE-754 binary64 sent as
+ * their little-endian bit pattern. Every request carries a u32 req_id
+ * that its reply echoes.
+ *
+ * Requests:
+ *   REQ   req_id u32, user_id i32, car_id i32, timestamp f64,
+ *         start_node i32, destination_node i32
+ *   UPD   req_id u32, user_id i32, car_id i32, timestamp f64,
+ *         edge_id i32, position_on_edge f64, speed f64
+ *   PRED  req_id u32, edge_id i32
+ *
+ * Replies:
+ *   ROUTE       req_id u32, user_id i32, car_id i32, eta f64,
+ *               edge_count u32, edge ids as zigzag LEB128 varints of the
+ *               difference to the previous id (the first to 0)
+ *   ACK         req_id u32, user_id i32, car_id i32
+ *   PREDICTION  req_id u32, edge_id i32, travel_time f64
+ *   ERROR       req_id u32, code u8 (WireError), user_id i32, car_id i32
+ */
+
+#define WIRE_LEN_BYTES 4
+
+/* Largest frame length a peer may announce */
+#define WIRE_FRAME_MAX 4096
+
+typedef enum {
+    WIRE_REQ = 0x01,
+    WIRE_UPD = 0x02,
+    WIRE_PRED = 0x03,
+
+    WIRE_ROUTE = 0x81,
+    WIRE_ACK = 0x82,
+    WIRE_PREDICTION = 0x83,
+    WIRE_ERROR = 0xff
+} WireType;
+
+/* ERROR codes; each matches the JSON protocol's error of the same name */
+typedef enum {
+    WIRE_E_INTERNAL = 1,
+    WIRE_E_NO_MEM,
+    WIRE_E_BAD_FRAME,       /* length or payload size wrong for the type */
+    WIRE_E_UNKNOWN_TYPE,
+    WIRE_E_BAD_NODES,
+    WIRE_E_NO_ROUTE,
+    WIRE_E_ROUTE_FAIL,
+    WIRE_E_BAD_EDGE,
+    WIRE_E_BAD_SPEED,
+    WIRE_E_OVERLOADED       /* shed: queue at its limit or deadline passed */
+} WireError;
+
+/* Payload sizes of the requests, without length and type */
+#define WIRE_REQ_SIZE  28
+#define WIRE_UPD_SIZE  40
+#define WIRE_PRED_SIZE 8
+
+/* Bound on the ACK, PREDICTION and ERROR frames */
+#define WIRE_SMALL_MAX 32
+
+typedef struct {
+    WireType type;
+    uint32_t req_id;
+    int32_t user_id;
+    int32_t car_id;
+    double timestamp;
+    int32_t start_node;
+    int32_t destination_node;
+    int32_t edge_id;
+    double position_on_edge;
+    double speed;
+} WireRequest;
+
+/* Length field of the frame starting at p (WIRE_LEN_BYTES readable) */
+uint32_t wire_frame_length(const unsigned char* p);
+
+/*
+ * Decodes a frame body (type + payload, len bytes). Returns 0, or
+ * WIRE_E_UNKNOWN_TYPE / WIRE_E_BAD_FRAME. req_id is filled whenever the
+ * body is long enough to hold it, so errors can still be matched.
+ */
+int wire_decode_request(const unsigned char* body, size_t len, WireRequest* out);
+
+/* Upper bound on the ROUTE frame for edge_count edges */
+size_t wire_route_max(int edge_count);
+
+/* Encoders write a whole frame to out and return its size */
+size_t wire_encode_route(unsigned char* out, uint32_t req_id, int32_t user_id, int32_t car_id,
+                         double eta, const int* edges, int edge_count);
+size_t wire_encode_ack(unsigned char* out, uint32_t req_id, int32_t user_id, int32_t car_id);
+size_t wire_encode_prediction(unsigned char* out, uint32_t req_id, int32_t edge_id, double value);
+size_t wire_encode_error(unsigned char* out, uint32_t req_id, WireError code,
+                         int32_t user_id, int32_t car_id);
+
+/* WireError for a JSON error name such as "NO_ROUTE" (WIRE_E_INTERNAL if none) */
+WireError wire_error_from_name(const char* name);
+
+#endif
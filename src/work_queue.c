@@ -0,0 +1,216 @@
+#include "work_queue.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() ((void)0)
+#endif
+
+/* ---------------- bounded MPMC ring ---------------- */
+
+int mpmc_init(MpmcQueue* q, size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+
+    q->cells = (MpmcCell*)malloc(cap * sizeof(MpmcCell));
+    if (!q->cells) return 1;
+    for (size_t i = 0; i < cap; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].item = NULL;
+    }
+    q->mask = cap - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return 0;
+}
+
+void mpmc_free(MpmcQueue* q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+int mpmc_push(MpmcQueue* q, void* item) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        MpmcCell* cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->item = item;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+            /* lost the race; pos was reloaded by the CAS */
+        } else if (diff < 0) {
+            return 1; /* the cell a full lap back is still occupied */
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+void* mpmc_pop(MpmcQueue* q) {
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        MpmcCell* cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                void* item = cell->item;
+                atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+                return item;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+size_t mpmc_size(MpmcQueue* q) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+/* ---------------- worker pool ---------------- */
+
+int work_pool_init(WorkPool* p, int workers, size_t limit, int steal) {
+    p->workers = workers;
+    p->steal = steal;
+    p->limit = limit ? limit : 1;
+    p->queues = (MpmcQueue*)calloc((size_t)workers, sizeof(MpmcQueue));
+    p->park = (WorkPark*)aligned_alloc(64, sizeof(WorkPark) * (size_t)workers);
+    if (!p->queues || !p->park) {
+        free(p->queues);
+        free(p->park);
+        return 1;
+    }
+    for (int i = 0; i < workers; i++) {
+        if (mpmc_init(&p->queues[i], p->limit) != 0) {
+            for (int j = 0; j < i; j++) mpmc_free(&p->queues[j]);
+            free(p->queues);
+            free(p->park);
+            return 1;
+        }
+        atomic_init(&p->park[i].sleeping, 0);
+        sem_init(&p->park[i].sem, 0, 0);
+    }
+    atomic_init(&p->next, 0);
+    atomic_init(&p->parked, 0);
+    return 0;
+}
+
+void work_pool_free(WorkPool* p) {
+    for (int i = 0; i < p->workers; i++) {
+        mpmc_free(&p->queues[i]);
+        sem_destroy(&p->park[i].sem);
+    }
+    free(p->queues);
+    free(p->park);
+    p->queues = NULL;
+    p->park = NULL;
+}
+
+/* Claim worker i's parked flag; the caller then owes it one sem_post */
+static int work_pool_unpark(WorkPool* p, int i) {
+    if (atomic_load_explicit(&p->park[i].sleeping, memory_order_relaxed) &&
+        atomic_exchange(&p->park[i].sleeping, 0)) {
+        atomic_fetch_sub(&p->parked, 1);
+        return 1;
+    }
+    return 0;
+}
+
+/* Wake a parked worker after an item went into queue target */
+static void work_pool_wake(WorkPool* p, int target) {
+    /* Pairs with the fence in work_pool_pop: either we see the parked
+       worker or it sees the item on its last check before sleeping. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&p->parked, memory_order_relaxed) == 0) return;
+
+    /* Prefer the owner of the queue; anyone awake will steal it anyway.
+       Without stealing only the owner can take it. */
+    int candidates = p->steal ? p->workers : 1;
+    for (int k = 0; k < candidates; k++) {
+        int i = (target + k) % p->workers;
+        if (work_pool_unpark(p, i)) {
+            sem_post(&p->park[i].sem);
+            return;
+        }
+    }
+}
+
+/* The ring is rounded up to a power of two, so the limit is checked
+   separately; the size is approximate, which a limit can live with */
+static int work_pool_push_one(WorkPool* p, int worker, void* item) {
+    MpmcQueue* q = &p->queues[worker];
+    if (mpmc_size(q) >= p->limit || mpmc_push(q, item) != 0) return 1;
+    work_pool_wake(p, worker);
+    return 0;
+}
+
+int work_pool_push(WorkPool* p, void* item) {
+    unsigned int start = atomic_fetch_add_explicit(&p->next, 1, memory_order_relaxed);
+    for (int k = 0; k < p->workers; k++) {
+        int target = (int)((start + (unsigned int)k) % (unsigned int)p->workers);
+        if (work_pool_push_one(p, target, item) == 0) return 0;
+    }
+    return 1;
+}
+
+int work_pool_push_to(WorkPool* p, int worker, void* item) {
+    return work_pool_push_one(p, worker, item);
+}
+
+size_t work_pool_depth(WorkPool* p, int worker) {
+    return mpmc_size(&p->queues[worker]);
+}
+
+/* Own queue first, then (if stealing) the others starting with the next worker */
+void* work_pool_try_pop(WorkPool* p, int self) {
+    int queues = p->steal ? p->workers : 1;
+    for (int k = 0; k < queues; k++) {
+        void* item = mpmc_pop(&p->queues[(self + k) % p->workers]);
+        if (item) return item;
+    }
+    return NULL;
+}
+
+void* work_pool_pop(WorkPool* p, int self) {
+    WorkPark* park = &p->park[self];
+
+    for (;;) {
+        for (int spin = 0; spin < WORK_POOL_SPIN; spin++) {
+            void* item = work_pool_try_pop(p, self);
+            if (item) return item;
+            cpu_relax();
+        }
+
+        atomic_fetch_add(&p->parked, 1);
+        atomic_store(&park->sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        void* item = work_pool_try_pop(p, self);
+        if (item) {
+            if (!work_pool_unpark(p, self)) {
+                /* a producer claimed us first; absorb its post */
+                while (sem_wait(&park->sem) != 0 && errno == EINTR) {}
+            }
+            return item;
+        }
+
+        while (sem_wait(&park->sem) != 0 && errno == EINTR) {}
+    }
+}
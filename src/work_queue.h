@@ -0,0 +1,98 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+/* Default limit of items per worker queue */
+#ifndef WORK_QUEUE_CAPACITY
+#define WORK_QUEUE_CAPACITY 4096
+#endif
+
+/* Empty polls of every queue before an idle worker parks */
+#ifndef WORK_POOL_SPIN
+#define WORK_POOL_SPIN 2000
+#endif
+
+/*
+ * Bounded lock-free multi-producer multi-consumer FIFO (Vyukov's
+ * sequence-numbered ring). Each cell's seq says whose turn it is: equal
+ * to the position when free for a producer, position + 1 when it holds
+ * an item for a consumer. Push and pop are one CAS on the shared index
+ * in the uncontended case; the two indices live on separate cache lines.
+ */
+typedef struct {
+    atomic_size_t seq;
+    void* item;
+} MpmcCell;
+
+typedef struct {
+    MpmcCell* cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t head;    /* next position to pop */
+    _Alignas(64) atomic_size_t tail;    /* next position to push */
+} MpmcQueue;
+
+/* capacity is rounded up to a power of two. 0 on success. */
+int mpmc_init(MpmcQueue* q, size_t capacity);
+void mpmc_free(MpmcQueue* q);
+/* 0 on success, 1 if the queue is full */
+int mpmc_push(MpmcQueue* q, void* item);
+/* NULL if the queue is empty */
+void* mpmc_pop(MpmcQueue* q);
+/* Approximate number of queued items */
+size_t mpmc_size(MpmcQueue* q);
+
+/* Idle worker's parking spot */
+typedef struct {
+    _Alignas(64) atomic_int sleeping;
+    sem_t sem;
+} WorkPark;
+
+/*
+ * Work distribution for a fixed pool of consumer threads. Every worker
+ * owns an MpmcQueue; producers spread items over them round-robin and an
+ * idle worker drains its own queue first, then steals from the others.
+ * A worker with nothing to do polls for WORK_POOL_SPIN rounds before it
+ * parks on its semaphore, so bursts are picked up without a syscall on
+ * either side; a producer only posts when it sees a parked worker.
+ *
+ * A pool created without stealing is sharded instead: producers choose
+ * the queue with work_pool_push_to and each queue has a single consumer,
+ * so items pushed to one worker are handled in order by that worker.
+ *
+ * Queues hold at most limit items each. Producers never wait for room: a
+ * push that finds no queue below its limit fails, and the caller decides
+ * what to do with the item (the server rejects the command).
+ */
+typedef struct {
+    int workers;
+    int steal;                      /* idle workers take from other queues */
+    size_t limit;                   /* items per queue before pushes fail */
+    MpmcQueue* queues;
+    WorkPark* park;
+    atomic_uint next;               /* round-robin cursor for producers */
+    _Alignas(64) atomic_int parked; /* workers currently asleep */
+} WorkPool;
+
+/* limit is the most items each worker's queue takes. 0 on success. */
+int work_pool_init(WorkPool* p, int workers, size_t limit, int steal);
+void work_pool_free(WorkPool* p);
+
+/* Queues item for any worker. 0 on success, 1 if every queue is at its limit. */
+int work_pool_push(WorkPool* p, void* item);
+
+/* Queues item for one worker. 0 on success, 1 if that queue is at its limit. */
+int work_pool_push_to(WorkPool* p, int worker, void* item);
+
+/* Blocks until an item is available to worker self */
+void* work_pool_pop(WorkPool* p, int self);
+
+/* Like work_pool_pop but returns NULL instead of waiting */
+void* work_pool_try_pop(WorkPool* p, int self);
+
+/* Approximate number of items waiting in one worker's queue */
+size_t work_pool_depth(WorkPool* p, int worker);
+
+#endif